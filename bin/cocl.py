@@ -57,6 +57,8 @@ Usage: cocl [options] <targetfile>
   -c compile to .o only, dont link
   -o final output filepath
   --clang-home Path to llvm4.0
+  --aot generate the OpenCL for each kernel at build time, rather than on first launch
+  --aot-manifest <file> which clmem patterns to generate each kernel for, with --aot
 
   Options passed through to clang compiler:
     -fPIC
@@ -83,6 +85,8 @@ PASS_THRU = []
 COMPILE_ONLY = False
 OPT_G = []
 OUTPATH = ''
+AOT = False
+AOT_MANIFEST = ''
 COCL_HOME = os.environ.get('COCL_HOME', '')
 COCL_LIB = os.environ.get('COCL_LIB', '')
 COCL_INCLUDE = os.environ.get('COCL_INCLUDE', '')
@@ -142,6 +146,12 @@ while len(args) > 0:
         elif THISARG == '--cocl-include':
             COCL_INCLUDE = args[1]
             args = args[1:]
+        elif THISARG == '--aot':
+            AOT = True
+        elif THISARG == '--aot-manifest':
+            AOT = True
+            AOT_MANIFEST = args[1]
+            args = args[1:]
         elif THISARG in ['-?', '-h', '-help']:
             display_help()
             sys.exit(0)
@@ -376,13 +386,26 @@ for infile in INFILES:
         ])
     run(cmdline_list)
 
+    # ir-to-opencl: -device.ll => -aot.txt
+    AOT_ARGS = []
+    if AOT:
+        cmdline_list = [
+            join(COCL_BIN, 'ir-to-opencl'),
+            '--inputfile', '%s-device.ll' % OUTPUTBASEPATH,
+            '--aot-outputfile', '%s-aot.txt' % OUTPUTBASEPATH
+        ]
+        if AOT_MANIFEST != '':
+            cmdline_list += ['--aot-manifest', AOT_MANIFEST]
+        run(cmdline_list)
+        AOT_ARGS = ['--aotfile', '%s-aot.txt' % OUTPUTBASEPATH]
+
     # patch_hostside: -hostraw.ll => -hostpatched.ll
     run([
             join(COCL_BIN, 'patch_hostside'),
             '--hostrawfile', '%s-hostraw.ll' % OUTPUTBASEPATH,
             '--devicellfile', '%s-device.ll' % OUTPUTBASEPATH,
             '--hostpatchedfile', '%s-hostpatched.ll' % OUTPUTBASEPATH
-        ])
+        ] + AOT_ARGS)
 
     # -hostpatched.ll => .o
     run(
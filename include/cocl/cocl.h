@@ -19,6 +19,9 @@
 #include "cocl/cocl_properties.h"
 // #include "cocl/cocl_blas.h"
 #include "cocl/cocl_kernellaunch.h"
+#include "cocl/cocl_graph.h"
+#include "cocl/cocl_occupancy.h"
+#include "cocl/cocl_warmup.h"
 #include "cocl/cocl_funcs.h"
 #include "cocl/hostside_opencl_funcs_ext.h"
 #include "cocl/vector_types.h"
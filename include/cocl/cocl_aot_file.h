@@ -0,0 +1,47 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The file cocl --aot builds, holding the opencl generated ahead of time for each kernel and clmem
+// pattern.  ir-to-opencl --aot-outputfile writes it, and patch_hostside --aotfile reads it back, to
+// embed the opencl in the program.
+//
+// It's a magic line, then for each kernel a header line, followed by exactly numBytes of opencl, and a
+// newline, so the opencl can contain anything.  Doesnt need llvm, since patch_hostside doesnt link
+// with the cocl library.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+namespace cocl {
+    class AotKernel {
+    public:
+        std::string kernelName;
+        std::string clmemIndexes; // comma-separated, as makeClmemIndexesString. empty if no clmem args
+        int uniqueClmemCount = 0;
+        bool offsets32bit = false;
+        bool usesVmem = false;
+        bool usesScratch = false;
+        bool usesDynamicShared = false;
+        int numClmemArgs = 0;
+        std::string clSourcecode;
+    };
+
+    void writeAotFileMagic(std::ostream &os);
+    void writeAotKernel(std::ostream &os, const AotKernel &kernel);
+    // throws if the file cant be opened, is from a different version of Coriander, or is truncated
+    std::vector<AotKernel> readAotFile(std::string filename);
+}
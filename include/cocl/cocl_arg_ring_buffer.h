@@ -0,0 +1,65 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-stream upload arena for by-value struct kernel args
+//
+// Rather than a clCreateBuffer, a blocking write, and a release, for every struct arg of every
+// launch, each stream has one device buffer, which we hand out in 128-byte aligned pieces, going
+// round and round.  Each struct is copied into a host-side shadow of the buffer, and written from
+// there with one non-blocking write.  The kernel gets the ring buffer's clmem, and the struct's
+// offset in it, so the generated code is the same as before.
+//
+// The ring is divided into segments.  When we move on from a segment, we enqueue a marker, and
+// before reusing that segment, a lap later, we wait on it.  That keeps us from overwriting shadow
+// memory that a pending write still has to read from.  On the device side, the queue is in-order,
+// so a write can't overtake kernels that are still reading the old contents.  Normally the marker
+// completed long ago, so we dont actually wait.
+//
+// Structs too big for a segment dont go in the ring; the caller should use its own buffer.
+
+#pragma once
+
+#include "EasyCL/EasyCL.h"
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace cocl {
+    class ArgRingBuffer {
+    public:
+        ArgRingBuffer(easycl::EasyCL *cl, cl_command_queue queue, size_t bytes=defaultBytes, int numSegments=defaultNumSegments);
+        ~ArgRingBuffer(); // caller should make sure the queue is finished first
+
+        // copies data into the ring, and enqueues a non-blocking write of it. returns the offset
+        // in clmem, or -1 if its too big, in which case nothing was written
+        long long write(const void *data, size_t bytes);
+
+        static const size_t defaultBytes = 1024 * 1024;
+        static const int defaultNumSegments = 8;
+        static const size_t alignment = 128;
+
+        cl_mem clmem;
+        size_t bytes;
+        size_t segmentBytes;
+
+    protected:
+        cl_command_queue queue;
+        std::vector<char> shadow;
+        std::vector<cl_event> segmentFences; // 0 if nothing to wait for
+        int segment = 0;
+        size_t head = 0; // next free offset, within the current segment
+        std::mutex mu;
+    };
+}
@@ -0,0 +1,75 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Caching allocator for cudaMalloc/cudaFree, along the lines of cub's CachingDeviceAllocator
+//
+// Requests are rounded up to power-of-two size classes ("bins").  When memory in a bin is freed, we
+// keep the cl_mem (and its fakePos range) around, and hand it straight back out the next time
+// someone asks for that bin, rather than going via clCreateBuffer/clReleaseMemObject.  Requests
+// bigger than the largest bin are allocated at their exact size, and never cached.
+//
+// Enabled per context by setting COCL_CACHING_ALLOCATOR=1.  The maximum number of bytes that may
+// sit idle in the cache (the high-water mark) is set by COCL_CACHING_ALLOCATOR_MAX_CACHED_BYTES.
+//
+// As for cub, freed memory may be handed out again immediately, without waiting for kernels still
+// in flight that use it.  Instead, release records a marker event on each stream, and when the
+// memory is handed out again, any stream a pending marker isnt on gets a barrier on it.  So work
+// queued after the cudaMalloc runs after work queued before the cudaFree, without free or malloc
+// ever blocking.
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+
+namespace cocl {
+    class Memory;
+    class Context;
+
+    class CachingAllocatorStats {
+    public:
+        size_t hits = 0; // allocations served from the cache
+        size_t misses = 0; // allocations that had to call clCreateBuffer
+        size_t bytesInUse = 0; // bytes currently handed out to the application
+        size_t bytesCached = 0; // bytes sitting idle in the cache
+        size_t bytesReleased = 0; // bytes given back to the driver, eg because cache was full, or trimmed
+        size_t maxCachedBytes = 0; // the high-water mark for bytesCached
+    };
+
+    class CachingAllocator {
+    public:
+        CachingAllocator(Context *context, size_t maxCachedBytes);
+        ~CachingAllocator();
+        Memory *allocate(size_t bytes);
+        void release(Memory *memory);
+        void trim(); // releases everything in the cache back to the driver
+        CachingAllocatorStats getStats();
+        size_t getLargestCachedBytes(); // caller should hold the ContextMutex
+
+        // returns 0 if bytes is bigger than the biggest bin
+        static size_t getBinBytes(size_t bytes);
+
+        static const int minBinLog2 = 9; // 512 bytes
+        static const int maxBinLog2 = 30; // 1GB
+
+    protected:
+        Context *context;
+        size_t maxCachedBytes;
+        std::multimap<size_t, Memory *> cachedMemoriesByBytes;
+        CachingAllocatorStats stats;
+    };
+
+    // for the current context. all zero if the caching allocator is not enabled
+    CachingAllocatorStats getCachingAllocatorStats();
+}
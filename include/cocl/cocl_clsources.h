@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 class MyClass {
 public:
@@ -10,11 +11,31 @@ public:
 
 extern "C" {
     void registerSourcecode(const char *filename, const char *sourcecode);
+
+    // opencl generated when the program was built, by cocl --aot, registered by the global
+    // constructor patch_hostside adds. clmemIndexes is comma-separated, one per clmem arg, as in
+    // clmemIndexByClmemArgIndex. clSourcecode, like devicellsourcecode, must live as long as the process
+    void coclRegisterPrebuiltKernel(
+        const char *devicellsourcecode, const char *kernelName, const char *clmemIndexes, int32_t uniqueClmemCount, int32_t offsets_32bit,
+        int32_t usesVmem, int32_t usesScratch, int32_t usesDynamicShared, int32_t numClmemArgs, const char *clSourcecode);
 }
 
 namespace cocl {
     std::string getClSource(int i);
     int getNumClSources();
+
+    class PrebuiltKernel {
+    public:
+        const char *clSourcecode = 0;
+        bool usesVmem = false;
+        bool usesScratch = false;
+        bool usesDynamicShared = false;
+        int numClmemArgs = 0;
+    };
+    // returns false if nothing was generated ahead of time for this kernel and clmem pattern
+    bool findPrebuiltKernel(const char *devicellsourcecode, const std::string &kernelName, int uniqueClmemCount,
+        const std::vector<int> &clmemIndexByClmemArgIndex, bool offsets_32bit, PrebuiltKernel *prebuiltKernel);
+    std::string makeClmemIndexesString(const std::vector<int> &clmemIndexByClmemArgIndex);
 }
 
 // std::vector<std::string> &getClSources();
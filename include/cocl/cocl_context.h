@@ -1,11 +1,18 @@
 #pragma once
 
 #include "cocl/cocl_device.h"
+#include "cocl/cocl_memory_stats.h"
 
+#include <atomic>
+#include <future>
 #include <map>
 #include <set>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
 
 extern "C" {
     size_t cuCtxSynchronize(void);
@@ -32,13 +39,95 @@ namespace easycl {
 
 namespace cocl {
     class Memory;
+    class HostMemory;
     class CoclStream;
+    class CachingAllocator;
+    class SlabAllocator;
+    class FillEngine;
+    class MemcpyBatchEngine;
+    class KernelDiskCache;
+    class LaunchConfiguration;
+    class DebugDumper;
 
     class KernelInfo {
     public:
         // CLKernel *kernel = 0;
         bool usesVmem = false;
         bool usesScratch = false;
+        bool usesDynamicShared = false; // has a dynamicShared local param, after the scratch
+        int numClmemArgs = 0; // kernel args that are offsets into a clmem, see KernelCacheKey
+    };
+
+    // what cudaOccupancy* need to know about a kernel, on one device. see cocl_occupancy.cpp
+    class KernelOccupancyInfo {
+    public:
+        size_t maxWorkgroupSize = 0; // CL_KERNEL_WORK_GROUP_SIZE
+        size_t workgroupSizeMultiple = 1; // CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE
+        size_t localMemSize = 0; // CL_KERNEL_LOCAL_MEM_SIZE, static local memory only
+        size_t privateMemSize = 0; // CL_KERNEL_PRIVATE_MEM_SIZE, per work-item
+        bool usesScratch = false;
+    };
+
+    // identifies one generated kernel. the kernel id comes from the launch site, see
+    // configureKernelWithId. the opencl we generate also depends on how many clmems there are,
+    // and which kernel args share a clmem, so those are part of the key too
+    class KernelCacheKey {
+    public:
+        int32_t kernelId = 0;
+        int32_t uniqueClmemCount = 0;
+        std::vector<int> clmemIndexByClmemArgIndex;
+        bool operator==(const KernelCacheKey &other) const {
+            return kernelId == other.kernelId && uniqueClmemCount == other.uniqueClmemCount &&
+                clmemIndexByClmemArgIndex == other.clmemIndexByClmemArgIndex;
+        }
+    };
+    struct KernelCacheKeyHash {
+        size_t operator()(const KernelCacheKey &key) const;
+    };
+    // a cached kernel, cloned for one stream. each stream gets its own cl_kernel, so launches on
+    // different streams dont race on its arg state. we remember the args we last set, and only call
+    // clSetKernelArg for the ones that changed. except for cl_mems: once released, a cl_mem's
+    // handle can come back for a different buffer, so those are always set
+    class StreamKernel {
+    public:
+        StreamKernel(easycl::CLKernel *kernel);
+        ~StreamKernel();
+        // value 0 is for local memory args, like clSetKernelArg. caller should hold mu
+        void setArg(cl_uint argIndex, size_t size, const void *value);
+        // always calls clSetKernelArg. caller should hold mu
+        void setMemArg(cl_uint argIndex, cl_mem clmem);
+
+        cl_kernel kernel;
+        std::mutex mu; // setting args and enqueueing have to happen together
+        int64_t numClSetKernelArgCalls = 0;
+
+    protected:
+        class ArgState {
+        public:
+            size_t size = 0; // 0 means we dont know what's set
+            bool isLocal = false;
+            uint64_t value = 0;
+        };
+        std::vector<ArgState> argStates;
+    };
+
+    // everything kernelGo needs about a generated kernel, from a single lookup
+    class KernelCacheEntry {
+    public:
+        std::string clSourcecode;
+        easycl::CLKernel *kernel = 0; // owned by the EasyCL
+        KernelInfo kernelInfo;
+        std::string uniqueKernelName;
+        // created on first launch on each stream. guarded by the Context's kernelCacheMutex
+        std::unordered_map<cocl::CoclStream *, std::unique_ptr<StreamKernel> > kernelByStream;
+    };
+
+    // which launches get a kernel generated for their particular pattern of args sharing a clmem,
+    // see assignClmemIndexes. the rest get the one with a clmem param per arg
+    enum SpecializeAliasing {
+        SpecializeAliasingShared, // only if all the clmem args are in one buffer. the default
+        SpecializeAliasingAlways, // COCL_SPECIALIZE_ALIASING=1
+        SpecializeAliasingNever // COCL_SPECIALIZE_ALIASING=0
     };
 
     class Context {
@@ -47,17 +136,59 @@ namespace cocl {
         ~Context();
         std::unique_ptr<easycl::EasyCL> cl;
         std::unique_ptr<cocl::CoclStream> default_stream;
+        // kernelCacheById, kernelCache, numKernelCalls and the hit/miss counts are shared by all
+        // threads using this context, and guarded by kernelCacheMutex
+        // kernelCacheById is what kernelGo uses. kernelCache is for compileOpenCLKernel, which is
+        // keyed on the kernel name
+        std::unordered_map<cocl::KernelCacheKey, cocl::KernelCacheEntry, cocl::KernelCacheKeyHash> kernelCacheById;
         std::map<std::string, easycl::CLKernel *> kernelCache;
-        std::map<std::string, cocl::KernelInfo> kernelInfoByUniqueName;
-        std::map<std::string, std::string > clSourceCodeCache;
+        std::unordered_map<int32_t, cocl::KernelOccupancyInfo> occupancyInfoByKernelId; // also guarded by kernelCacheMutex
+        // kernels some thread is generating and building, see getOrBuildKernelCacheEntry. also
+        // guarded by kernelCacheMutex
+        std::unordered_map<cocl::KernelCacheKey, std::shared_future<void>, cocl::KernelCacheKeyHash> kernelsBeingBuilt;
+        std::atomic<int> nextClDumpIndex; // numbers the files for COCL_DUMP_CL and COCL_LOAD_CL
+        // where generateOpenCL got the opencl for kernel cache misses, other than the disk cache
+        std::atomic<int64_t> numPrebuiltKernelsUsed;
+        std::atomic<int64_t> numKernelsGenerated;
+        int64_t numKernelCacheHits = 0;
+        int64_t numKernelCacheMisses = 0;
+        std::mutex kernelCacheMutex;
         std::set<cocl::Memory *>memories;
         long long nextAllocPos = 1;
+        // indexes used by findMemory and findMemoryByClmem. memoryByAllocPos is keyed on fakePos, and
+        // allocations never overlap, so upper_bound gives us the containing allocation in O(log n)
         std::map< long long, cocl::Memory *>memoryByAllocPos;
+        std::map< cl_mem, cocl::Memory *>memoryByClmem;
+        std::map< long long, cocl::HostMemory *>hostMemoryByHostPos; // pinned host memory, keyed on hostPointer
+        std::set<cocl::CoclStream *> streams; // from cuStreamCreate, not including default_stream. guarded by mu
+        std::unique_ptr<cocl::CachingAllocator> cachingAllocator; // only set if COCL_CACHING_ALLOCATOR=1
+        std::unique_ptr<cocl::SlabAllocator> slabAllocator; // only set if COCL_SLAB_ALLOCATOR=1
+        std::unique_ptr<cocl::FillEngine> fillEngine; // created on first use, by getFillEngine()
+        std::unique_ptr<cocl::MemcpyBatchEngine> memcpyBatchEngine; // created on first use
+        std::unique_ptr<cocl::KernelDiskCache> kernelDiskCache; // only set if COCL_KERNEL_CACHE_DIR is set
+        SpecializeAliasing specializeAliasing = SpecializeAliasingShared;
+        cocl::MemoryStats memoryStats; // updated by Memory, allocateDeviceMemory, freeDeviceMemory. guarded by mu
         int numKernelCalls = 0;
         const int gpuOrdinal;
         easycl::EasyCL *getCl() {
             return cl.get();
         }
+        // waits for everything queued on the default stream, and on all our other streams
+        void synchronize();
+        // waits for everything queued on the streams created on this context, but not the default
+        // stream. like CUDA's legacy default stream, blocking default stream work waits for these
+        void synchronizeCreatedStreams();
+        // for memory an allocator takes back while kernels might still be using it: enqueues a
+        // marker on the default stream, and on each of our other streams, and adds them to markers
+        void recordReleaseMarkers(std::vector<cl_event> &markers);
+        // for handing that memory out again: work already queued on the stream a marker is on runs
+        // first anyway, so only the other streams are made to wait for it, with a barrier. doesnt
+        // block. releases the markers
+        void waitForReleaseMarkers(std::vector<cl_event> &markers);
+        // releases, and removes, the markers whose commands have finished
+        static void releaseCompletedMarkers(std::vector<cl_event> &markers);
+        // releases the kernels cloned for stream, for when it's destroyed
+        void releaseStreamKernels(cocl::CoclStream *stream);
         std::mutex mu;
     };
 
@@ -76,9 +207,15 @@ namespace cocl {
         cocl::Context *currentContext = 0;
         int currentGpuOrdinal = 0;
         bool offsets_32bit = false;
+        // the kernel launch being built up by cudaConfigureCall, setKernelArg* and kernelGo. per
+        // thread, so threads can launch concurrently. created on first launch
+        std::unique_ptr<cocl::LaunchConfiguration> launchConfiguration;
+        std::unique_ptr<cocl::DebugDumper> debugDumper;
     };
 
     ThreadVars *getThreadVars();
+    // device memory held by every live context on gpuOrdinal, from any thread, see MemoryStats::deviceBytes
+    size_t getDeviceBytesForAllContexts(int gpuOrdinal);
 }
 
 typedef char *CUcontext;
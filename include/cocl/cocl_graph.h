@@ -0,0 +1,166 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stream capture and replay, along the lines of cuda graphs
+//
+// Between cudaStreamBeginCapture and cudaStreamEndCapture, kernel launches, async memcpys and
+// async memsets on the stream are recorded into a CoclGraph instead of being run.  Each node is
+// recorded already resolved: clmems and offsets rather than pointers, and the built kernel rather
+// than the kernel name.
+//
+// cudaGraphInstantiate gives each kernel node its own cl_kernel, with all its args set, and resolves
+// each memset node into either a clEnqueueFillBuffer or its own fill kernel, again with the args set.
+// cudaGraphLaunch then just enqueues the nodes, in order: no kernel cache lookup, no generation
+// of kernel names, no locks, and no clSetKernelArg.
+//
+// Device pointers that change from one run to the next, eg input and output buffers, can be patched
+// in an instantiated graph with coclGraphExecUpdatePointer.  Its the pointer value thats patched,
+// wherever it was used, in kernel args, memcpys and memsets.
+//
+// Host memory is read and written when the graph runs, not when it's captured, so host buffers used
+// by captured memcpys need to stay valid until the launched graph has finished.
+
+#pragma once
+
+#include "EasyCL/EasyCL.h"
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace cocl {
+    class CoclStream;
+    class StreamKernel;
+    class PreparedFill;
+    class LaunchConfiguration;
+    class CoclGraph;
+    class CoclGraphExec;
+}
+
+typedef cocl::CoclGraph *cudaGraph_t;
+typedef cocl::CoclGraphExec *cudaGraphExec_t;
+
+enum cudaStreamCaptureMode {
+    cudaStreamCaptureModeGlobal = 0,
+    cudaStreamCaptureModeThreadLocal = 1,
+    cudaStreamCaptureModeRelaxed = 2
+};
+
+enum cudaStreamCaptureStatus {
+    cudaStreamCaptureStatusNone = 0,
+    cudaStreamCaptureStatusActive = 1
+};
+
+extern "C" {
+    // mode is accepted for compatibility. we only ever record work enqueued on the stream itself
+    size_t cudaStreamBeginCapture(char *stream, int mode);
+    size_t cudaStreamEndCapture(char *stream, cudaGraph_t *pGraph);
+    size_t cudaStreamIsCapturing(char *stream, int *pCaptureStatus);
+
+    size_t cudaGraphInstantiate(cudaGraphExec_t *pGraphExec, cudaGraph_t graph, void *pErrorNode, char *pLogBuffer, size_t bufferSize);
+    // non-blocking
+    size_t cudaGraphLaunch(cudaGraphExec_t graphExec, char *stream);
+    size_t cudaGraphExecDestroy(cudaGraphExec_t graphExec);
+    size_t cudaGraphDestroy(cudaGraph_t graph);
+    size_t cudaGraphGetNumNodes(cudaGraph_t graph, size_t *pNumNodes);
+
+    // changes every use of device pointer oldPtr, in the instantiated graph, to newPtr. shouldnt be
+    // called whilst the graph is being launched from another thread
+    size_t coclGraphExecUpdatePointer(cudaGraphExec_t graphExec, const void *oldPtr, const void *newPtr);
+}
+
+namespace cocl {
+    // a kernel arg that came from a device pointer. we keep the pointer, so we can patch it
+    class GraphPointerArg {
+    public:
+        const char *ptr;
+        int clmemParam; // kernel param index of the clmem. the vmem offset is the param after it
+        int offsetParam; // kernel param index of the offset into the clmem
+    };
+
+    // one kernel parameter value, as we'll hand it to clSetKernelArg
+    class GraphKernelParam {
+    public:
+        size_t size;
+        bool isLocal; // local memory, so no value
+        uint64_t value;
+    };
+
+    class GraphNode {
+    public:
+        enum NodeType {
+            NT_Kernel,
+            NT_MemcpyHtoD,
+            NT_MemcpyDtoH,
+            NT_MemcpyDtoD,
+            NT_Memset
+        };
+        NodeType type;
+
+        // NT_Kernel
+        easycl::CLKernel *kernel = 0;  // owned by the EasyCL, via the kernel cache
+        size_t global[3];
+        size_t block[3];
+        std::vector<GraphKernelParam> params;
+        std::vector<GraphPointerArg> pointerArgs;
+        bool offsets32bit = false;
+
+        // copies, and memsets. dst and src are whichever of host or device pointers the node
+        // type says. device pointers are resolved into the clmems and offsets
+        char *dst = 0;
+        const char *src = 0;
+        cl_mem dstClmem = 0;
+        cl_mem srcClmem = 0;
+        size_t dstOffset = 0;
+        size_t srcOffset = 0;
+        size_t bytes = 0;
+        unsigned char value = 0; // NT_Memset
+    };
+
+    class CoclGraph {
+    public:
+        ~CoclGraph();
+        std::vector<GraphNode> nodes;
+        // buffers holding by-value struct args, which the captured kernels read. owned
+        std::vector<cl_mem> structBuffers;
+    };
+
+    class CoclGraphExec {
+    public:
+        CoclGraphExec(CoclGraph *graph);
+        ~CoclGraphExec();
+        void launch(cl_command_queue queue);
+        void updatePointer(const char *oldPtr, const char *newPtr);
+
+        std::vector<GraphNode> nodes;
+        // for each node, the cl_kernel with its args set, or null for non-kernel nodes
+        std::vector<std::unique_ptr<StreamKernel> > kernels;
+        // for each node, the resolved fill, or null for non-memset nodes
+        std::vector<std::unique_ptr<PreparedFill> > fills;
+        std::vector<cl_mem> structBuffers; // retained from the graph
+    };
+
+    // the graph being captured on coclStream, or 0 if not capturing. coclStream 0 means the default
+    // stream of the current context
+    CoclGraph *getCapturingGraph(char *stream);
+    // called by kernelGo, once it has resolved the kernel and the vmemlocs. takes ownership of the
+    // launch's kernelArgsToBeReleased. scratchBytes or dynamicSharedBytes 0 means the kernel doesnt have
+    // that param
+    void captureKernel(CoclGraph *graph, easycl::CLKernel *kernel, LaunchConfiguration &launchConfiguration,
+        const size_t *global, size_t scratchBytes, size_t dynamicSharedBytes, bool offsets32bit);
+    void captureMemcpyHtoD(CoclGraph *graph, char *dst, const void *src, size_t bytes);
+    void captureMemcpyDtoH(CoclGraph *graph, void *dst, const char *src, size_t bytes);
+    void captureMemcpyDtoD(CoclGraph *graph, char *dst, const char *src, size_t bytes);
+    void captureMemset(CoclGraph *graph, char *dst, unsigned char value, size_t bytes);
+}
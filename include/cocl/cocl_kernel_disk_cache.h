@@ -0,0 +1,85 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Persistent cache of generated kernels, across processes, for COCL_KERNEL_CACHE_DIR
+//
+// Each entry is one kernel variant: the generated OpenCL, the KernelInfo that goes with it, and the
+// program binary the driver built from it. A hit skips both generating the OpenCL from the device
+// IR, and compiling the OpenCL.
+//
+// Entries are keyed on a hash of everything the generated kernel depends on: the device IR, the
+// kernel name, which kernel args share a clmem, COCL_OFFSETS_32BIT, the device and driver, and the
+// Coriander library itself.  One file per entry, written to a temporary file and renamed into
+// place, so concurrent processes sharing a cache directory only ever see whole entries.  Loading
+// an entry touches its modification time, and when the directory grows beyond its maximum size,
+// the least recently used entries are deleted.
+//
+// One per context, since the device is part of the key.  Created in the Context constructor.
+
+#pragma once
+
+#include "cocl/cocl_context.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace cocl {
+
+class KernelDiskCacheEntry {
+public:
+    std::string clSourcecode;
+    KernelInfo kernelInfo;
+    std::vector<unsigned char> programBinary;
+};
+
+class KernelDiskCache {
+public:
+    // deviceIdentity should change whenever the device or driver might build something different,
+    // see getDeviceIdentity
+    KernelDiskCache(std::string cacheDir, size_t maxBytes, std::string deviceIdentity);
+
+    std::string makeKey(const std::string &devicellsourcecode, const std::string &kernelName,
+        int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex, bool offsets_32bit) const;
+    // returns false on a miss, or if the entry is unreadable
+    bool load(const std::string &key, KernelDiskCacheEntry *entry);
+    // failures to write are reported, but not thrown: the cache is only an optimization
+    void store(const std::string &key, const KernelDiskCacheEntry &entry);
+    // deletes least recently used entries, until the cache directory is within maxBytes
+    void evict();
+
+    // device name, vendor and driver version, for the key
+    static std::string getDeviceIdentity(cl_device_id deviceId);
+    // the program binary for the one device in the program's context
+    static std::vector<unsigned char> getProgramBinary(cl_program program);
+    // returns 0 if the driver wont take the binary, eg after a driver update
+    static easycl::CLKernel *buildKernelFromBinary(easycl::EasyCL *cl, const std::vector<unsigned char> &binary,
+        std::string kernelName, std::string clSourcecode);
+
+    const std::string cacheDir;
+    const size_t maxBytes;
+    const std::string deviceIdentity;
+
+    std::atomic<int64_t> numHits;
+    std::atomic<int64_t> numMisses;
+    std::atomic<int64_t> numStores;
+
+protected:
+    std::string getEntryPath(const std::string &key) const;
+};
+
+} // namespace cocl
@@ -0,0 +1,40 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// Every kernel that has a launch site, registered by the global constructor patch_hostside adds to
+// each module, see coclRegisterKernel in cocl_occupancy.h
+//
+// Lets us go from the host-side stub of a kernel, as passed to eg cudaOccupancyMaxPotentialBlockSize,
+// to the kernel, and lets coclWarmupKernels find all the kernels there are
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace cocl {
+
+class RegisteredKernel {
+public:
+    int32_t *kernelIdSlot = 0;
+    const char *kernelName = 0;
+    const char *devicellsourcecode = 0;
+};
+
+// throws if func isnt the host-side stub of a kernel compiled with cocl. caller is for the message
+RegisteredKernel getRegisteredKernel(const void *func, const char *caller);
+std::vector<RegisteredKernel> getAllRegisteredKernels();
+
+} // namespace cocl
@@ -2,139 +2,60 @@
 
 #include "EasyCL/EasyCL.h"
 
-#include "llvm/Support/Casting.h" // for llvm rtti
-
 #include <string>
+#include <cstdint>
 
 namespace cocl {
-    // These Arg classes store kernel parameter values, which we can use
-    // at kernel creation time, and then pass into the kernel at that point
+    // LaunchArgs stores the kernel parameter values set by setKernelArg*, so we can pass them into
+    // the kernel at launch time
     // we dont create the kernel until the actual launch command (which is after
     // the kernelSetArg commands), so we have all the information available at that
     // time about what kernel arguments we have
     // concretely, it means we can dedupe the underlying cl_mem buffers, for example
-    class Arg {
-    public:
-        enum ArgKind {
-            AK_Base,
-            AK_Int8Arg,
-            AK_Int32Arg,
-            AK_UInt32Arg,
-            AK_Int64Arg,
-            AK_FloatArg,
-            AK_NullPtrArg,
-            AK_ClmemArg,
-            AK_StructArg
+    //
+    // the values are packed into one fixed-size byte buffer, in kernel parameter order, with the
+    // type and size of each alongside, ready to hand to clSetKernelArg. there's one per launching
+    // thread, reused from launch to launch, so adding an arg is a bounds check and a memcpy: no
+    // heap allocation, and no virtual calls
+    class LaunchArgs {
+    public:
+        enum ArgType : uint8_t {
+            AT_Int8,
+            AT_Int32,
+            AT_UInt32,
+            AT_Int64,
+            AT_Float
         };
-        Arg(ArgKind kind=AK_Base) : Kind(kind) {}
-        virtual ~Arg() {}
-        virtual void inject(easycl::CLKernel *kernel) = 0;
-        virtual std::string str() = 0;
+        // more than any opencl kernel will take: CL_DEVICE_MAX_PARAMETER_SIZE is usually 1KB-4KB
+        static const int maxArgs = 512;
+        static const int maxBytes = maxArgs * 8;
 
-    private:
-        const ArgKind Kind;
+        void clear() {
+            numArgs = 0;
+            numBytes = 0;
+        }
+        void addInt8(char v) { add(AT_Int8, &v, sizeof(v)); }
+        void addInt32(int32_t v) { add(AT_Int32, &v, sizeof(v)); }
+        void addUInt32(uint32_t v) { add(AT_UInt32, &v, sizeof(v)); }
+        void addInt64(int64_t v) { add(AT_Int64, &v, sizeof(v)); }
+        void addFloat(float v) { add(AT_Float, &v, sizeof(v)); }
 
-    public:
-        ArgKind getKind() const { return Kind; }
+        int size() const { return numArgs; }
+        ArgType getType(int i) const { return types[i]; }
+        size_t getSize(int i) const { return sizes[i]; }
+        const void *getValue(int i) const { return data + offsets[i]; }
+        // any of the integer types, widened to int64
+        int64_t getInteger(int i) const;
+        std::string str(int i) const;
 
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Base;
-        }
-    };
-    class Int8Arg : public Arg {
-    public:
-        Int8Arg(char v) : Arg(AK_Int8Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_char(v);
-        }
-        virtual std::string str() { return "Int8Arg"; }
-        char v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int8Arg;
-        }
-    };
-    class Int32Arg : public Arg {
-    public:
-        Int32Arg(int v) : Arg(AK_Int32Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_int32(v);
-        }
-        virtual std::string str();
-        int v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int32Arg;
-        }
-    };
-    class UInt32Arg : public Arg {
-    public:
-        UInt32Arg(uint32_t v) : Arg(AK_UInt32Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_uint32(v);
-        }
-        virtual std::string str() { return "UInt32Arg"; }
-        uint32_t v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_UInt32Arg;
-        }
-    };
-    class Int64Arg : public Arg {
-    public:
-        Int64Arg(int64_t v) : Arg(AK_Int64Arg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_int64(v);
-        }
-        virtual std::string str();
-        int64_t v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_Int64Arg;
-        }
-    };
-    class FloatArg : public Arg {
-    public:
-        FloatArg(float v) : Arg(AK_FloatArg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_float(v);
-        }
-        virtual std::string str() { return "FloatArg"; }
-        float v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_FloatArg;
-        }
-    };
-    class NullPtrArg : public Arg {
-    public:
-        NullPtrArg() : Arg(AK_NullPtrArg) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->in_nullptr();
-        }
-        virtual std::string str() { return "NullPtrArg"; }
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_NullPtrArg;
-        }
-    };
-    class ClmemArg : public Arg {
-    public:
-        ClmemArg(cl_mem v) : Arg(AK_ClmemArg), v(v) {}
-        void inject(easycl::CLKernel *kernel) {
-            kernel->inout(&v);
-        }
-        virtual std::string str() { return "ClmemArg"; }
-        cl_mem v;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_ClmemArg;
-        }
-    };
-    class StructArg : public Arg {
-    public:
-        StructArg(char *pCpuStruct, int structAllocateSize) :
-            Arg(AK_StructArg),
-            pCpuStruct(pCpuStruct), structAllocateSize(structAllocateSize)
-        {}
-        virtual std::string str() { return "StructArg"; }
-        char *pCpuStruct;
-        int structAllocateSize;
-        static bool classof(const Arg *arg) {
-            return arg->getKind() == AK_StructArg;
-        }
+    protected:
+        void add(ArgType type, const void *value, int bytes);
+
+        int numArgs = 0;
+        int numBytes = 0;
+        ArgType types[maxArgs];
+        uint8_t sizes[maxArgs];
+        uint16_t offsets[maxArgs];
+        alignas(8) unsigned char data[maxBytes];
     };
 } // namespace cocl
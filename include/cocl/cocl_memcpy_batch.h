@@ -0,0 +1,76 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Batched device to device copies, for coclMemcpyBatchAsync
+//
+// We resolve all the pointers under a single lock, group the copies by (src clmem, dst clmem), and
+// merge copies whose src and dst ranges both carry straight on from the previous one.  Big copies
+// then go to clEnqueueCopyBuffer, as usual.  The small ones in each group go to a single launch of
+// a gather/scatter kernel, which reads (srcOffset, dstOffset, bytes) descriptors from a small
+// buffer, one workgroup per copy.  With the slab allocator, everything is in one clmem, so a whole
+// batch of small copies is one kernel launch.
+//
+// One per context, created on first use, like FillEngine.
+
+#pragma once
+
+#include "EasyCL/EasyCL.h"
+
+#include <mutex>
+#include <vector>
+
+namespace cocl {
+
+class Context;
+
+// one copy, after resolving pointers to clmem offsets
+class ResolvedCopy {
+public:
+    cl_mem srcClmem;
+    cl_mem dstClmem;
+    size_t srcOffset;
+    size_t dstOffset;
+    size_t bytes;
+};
+
+class MemcpyBatchEngine {
+public:
+    MemcpyBatchEngine(Context *context);
+    ~MemcpyBatchEngine();
+
+    // non-blocking. copies may be in any order. like memcpy, overlapping copies are undefined
+    void enqueue(cl_command_queue queue, std::vector<ResolvedCopy> &copies);
+
+    // sorts by clmem pair, then src offset, and merges contiguous copies. exposed for testing
+    static void coalesce(std::vector<ResolvedCopy> &copies);
+
+    // merged copies of at least this many bytes go to clEnqueueCopyBuffer
+    static const size_t minCopyBufferBytes = 64 * 1024;
+
+    Context *context;
+    cl_program program;
+    cl_kernel copyBatchKernel;
+    size_t workgroupSize;
+    size_t maxWorkgroups;
+
+protected:
+    void runCopyBatchKernel(cl_command_queue queue, cl_mem srcClmem, cl_mem dstClmem,
+        const std::vector<cl_ulong> &descriptors);
+    std::mutex mu; // setting args and enqueueing has to happen together
+};
+
+// for the current context
+MemcpyBatchEngine *getMemcpyBatchEngine();
+
+} // namespace cocl
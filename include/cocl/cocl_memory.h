@@ -3,28 +3,89 @@
 #include "clew.h"
 
 #include <cstdint>
+#include <vector>
 
 namespace cocl {
+    class Context;
+
     class Memory {
     protected:
-        Memory(cl_mem clmem, size_t bytes);
+        Memory(cl_mem clmem, size_t bytes, bool isSlab = false);
+        Memory(Memory *slab, size_t slabOffset, size_t bytes);
 
      public:
         static Memory *newDeviceAlloc(size_t bytes);
+        // a slab is a big clmem that the slab allocator carves suballocations out of. the slab
+        // itself is only findable by clmem; its suballocations are only findable by address
+        static Memory *newSlab(size_t bytes);
+        static Memory *newSuballocation(Memory *slab, size_t slabOffset, size_t bytes);
         ~Memory();
-        size_t getOffset(const char *passedInAsCharStar);
+        size_t getOffset(const char *passedInAsCharStar); // offset into clmem, not into this memory
+        // add/remove this memory from the context's lookup indexes, without touching the clmem
+        // used by the caching allocator to park freed memory.  caller should hold the ContextMutex
+        void addToIndex(Context *context);
+        void removeFromIndex(Context *context);
         cl_mem clmem; // this is assumed to always be valid
         size_t bytes; // should always be valid (ideally > 0...)
         size_t fakePos; // the range (fakePos) to (fakePos + bytes) should not overlap with any other memory
         // otherwise, problems :-P
+        bool isSlab = false;
+        Memory *slab = 0; // for suballocations, the slab that owns clmem
+        size_t slabOffset = 0; // for suballocations, where fakePos starts within clmem
+        size_t requestedBytes = 0; // what cudaMalloc was asked for. can be less than bytes
+        // while parked in the caching allocator, see Context::recordReleaseMarkers. owned
+        std::vector<cl_event> releaseMarkers;
+    };
+
+    // pinned host memory, from cuMemHostAlloc, cudaHostAlloc and cudaHostRegister
+    // backed by a CL_MEM_ALLOC_HOST_PTR buffer (CL_MEM_USE_HOST_PTR for cudaHostRegister), which we
+    // map once, and keep mapped until it is freed.  hostPointer is the pointer we hand out, and
+    // mappedPointer the one clEnqueueMapBuffer gave us, which is what we unmap. they're the same,
+    // except for cudaHostRegister, if the driver maps the caller's memory somewhere else
+    class HostMemory {
+    protected:
+        HostMemory(cl_mem clmem, char *hostPointer, char *mappedPointer, size_t bytes, bool isRegistered);
+
+    public:
+        static HostMemory *newHostAlloc(size_t bytes);
+        static HostMemory *newHostRegister(void *hostPointer, size_t bytes);
+        ~HostMemory();
+        cl_mem clmem;
+        char *hostPointer;
+        char *mappedPointer;
+        size_t bytes;
+        bool isRegistered; // memory belongs to the caller, we just pinned it
     };
 
     Memory *findMemory(const char *passedInPointer);
+    Memory *findMemoryLocked(Context *context, const char *passedInPointer); // caller should hold the ContextMutex
     Memory *findMemoryByClmem(cl_mem clmem);
+    HostMemory *findHostMemory(const void *hostPointer); // 0 means pageable
+    // 0 unless all of hostPointer to hostPointer + bytes is in the one pinned block
+    HostMemory *findHostMemory(const void *hostPointer, size_t bytes);
+
+    // non-blocking host to device write. safe to call with pageable src, which gets copied first
+    void enqueueWriteAsync(cl_command_queue queue, Memory *dstMemory, size_t dstOffset, const void *src, size_t bytes);
+    // device to host read. only non-blocking if all of dst is pinned
+    void enqueueReadAsync(cl_command_queue queue, Memory *srcMemory, size_t srcOffset, void *dst, size_t bytes);
+
+    // what cudaMalloc and cudaFree use. goes via the context's slab allocator or caching allocator,
+    // if enabled
+    Memory *allocateDeviceMemory(size_t bytes);
+    void freeDeviceMemory(Memory *memory);
 }
 
 #define CU_MEMHOSTALLOC_PORTABLE 123
 
+// we dont do anything different for these, but code passes them in
+#define cudaHostAllocDefault 0
+#define cudaHostAllocPortable 1
+#define cudaHostAllocMapped 2
+#define cudaHostAllocWriteCombined 4
+#define cudaHostRegisterDefault 0
+#define cudaHostRegisterPortable 1
+#define cudaHostRegisterMapped 2
+
 enum MemoryTypeEnum {
     CU_MEMORYTYPE_DEVICE = 60000,
     CU_MEMORYTYPE_HOST
@@ -39,6 +100,63 @@ enum cudaMemcpyKind {  // name used by thrust, in trivial_copy.inl, line 55 ish
 
 typedef long long CUdeviceptr;
 
+// one entry for coclMemcpyBatchAsync
+struct CoclMemcpyBatchEntry {
+    void *dst;
+    const void *src;
+    size_t bytes;
+};
+
+// pitched and 3d copies. we only handle linear memory, not cudaArrays, so for us extent.width, and
+// pos.x, are always in bytes
+struct cudaArray;
+typedef struct cudaArray *cudaArray_t;
+
+struct cudaPitchedPtr {
+    void *ptr;
+    size_t pitch; // bytes per row
+    size_t xsize; // logical width, in bytes
+    size_t ysize; // rows per slice
+};
+
+struct cudaExtent {
+    size_t width;
+    size_t height;
+    size_t depth;
+};
+
+struct cudaPos {
+    size_t x;
+    size_t y;
+    size_t z;
+};
+
+struct cudaMemcpy3DParms {
+    cudaArray_t srcArray;
+    struct cudaPos srcPos;
+    struct cudaPitchedPtr srcPtr;
+    cudaArray_t dstArray;
+    struct cudaPos dstPos;
+    struct cudaPitchedPtr dstPtr;
+    struct cudaExtent extent;
+    enum cudaMemcpyKind kind;
+};
+
+inline cudaPitchedPtr make_cudaPitchedPtr(void *ptr, size_t pitch, size_t xsize, size_t ysize) {
+    cudaPitchedPtr pitchedPtr = {ptr, pitch, xsize, ysize};
+    return pitchedPtr;
+}
+
+inline cudaExtent make_cudaExtent(size_t width, size_t height, size_t depth) {
+    cudaExtent extent = {width, height, depth};
+    return extent;
+}
+
+inline cudaPos make_cudaPos(size_t x, size_t y, size_t z) {
+    cudaPos pos = {x, y, z};
+    return pos;
+}
+
 extern "C" {
     size_t cudaMalloc(void **pMemory, size_t N);
     size_t cudaFree(void *memory);
@@ -49,13 +167,36 @@ extern "C" {
     size_t cuMemHostAlloc(void **pHostPointer, unsigned int bytes, int type=CU_MEMHOSTALLOC_PORTABLE);
     size_t cuMemFreeHost(void *hostPointer);
 
+    size_t cudaHostAlloc(void **pHostPointer, size_t bytes, unsigned int flags);
+    size_t cudaMallocHost(void **pHostPointer, size_t bytes);
+    size_t cudaFreeHost(void *hostPointer);
+    size_t cudaHostRegister(void *hostPointer, size_t bytes, unsigned int flags);
+    size_t cudaHostUnregister(void *hostPointer);
+
     size_t cudaMemsetAsync(void *devPtr, int value, size_t count, char *queue);
     size_t cudaMemcpy(void *dst, const void *, size_t, cudaMemcpyKind kind);
     size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t kind, char *queue=0);
 
+    // each of these is a single clEnqueue{Read,Write,Copy}BufferRect, or a single fill kernel
+    size_t cudaMallocPitch(void **pDevPtr, size_t *pPitch, size_t width, size_t height);
+    size_t cudaMalloc3D(cudaPitchedPtr *pPitchedDevPtr, cudaExtent extent);
+    size_t cudaMemcpy2D(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width,
+        size_t height, cudaMemcpyKind kind);
+    size_t cudaMemcpy2DAsync(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width,
+        size_t height, cudaMemcpyKind kind, char *queue=0);
+    size_t cudaMemcpy3D(const cudaMemcpy3DParms *p);
+    size_t cudaMemcpy3DAsync(const cudaMemcpy3DParms *p, char *queue=0);
+    size_t cudaMemset2D(void *devPtr, size_t pitch, int value, size_t width, size_t height);
+    size_t cudaMemset2DAsync(void *devPtr, size_t pitch, int value, size_t width, size_t height,
+        char *queue=0);
+
+    // count device to device copies, as a handful of enqueued commands. see cocl_memcpy_batch.h
+    size_t coclMemcpyBatchAsync(const CoclMemcpyBatchEntry *copies, size_t count, char *queue=0);
+
     size_t cuMemGetInfo(size_t *free, size_t *total);
-    size_t cuMemsetD8(CUdeviceptr location, unsigned char value, uint32_t count);
-    size_t cuMemsetD32(CUdeviceptr location, unsigned int value, uint32_t count);
+    size_t cuMemsetD8(CUdeviceptr location, unsigned char value, size_t count);
+    size_t cuMemsetD16(CUdeviceptr location, unsigned short value, size_t count);
+    size_t cuMemsetD32(CUdeviceptr location, unsigned int value, size_t count);
 
     size_t cuMemcpyHtoD(CUdeviceptr gpu_dst, const void *host_src, size_t size);
     size_t cuMemcpyDtoH(void *host_dst, CUdeviceptr gpu_src, size_t size);
@@ -74,6 +215,7 @@ size_t cudaMalloc(float **pMemory, size_t N);
 #define cuMemcpyHtoD_v2 cuMemcpyHtoD
 #define cuMemcpyDtoH_v2 cuMemcpyDtoH
 #define cuMemsetD8_v2 cuMemsetD8
+#define cuMemsetD16_v2 cuMemsetD16
 #define cuMemsetD32_v2 cuMemsetD32
 
 #define cuDeviceTotalMem_v2 cuDeviceTotalMem
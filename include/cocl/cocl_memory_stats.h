@@ -0,0 +1,61 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Per-context device memory accounting
+//
+// We distinguish between:
+// - device bytes: bytes in the device clmems we've created, ie what the driver has given us. This
+//   includes live allocations, slabs, and memory parked in the caching allocator
+// - allocated bytes: bytes handed out by cudaMalloc, at the size the caller asked for
+// - reserved bytes: device bytes that arent allocated, ie the caching allocator's cache, unused slab
+//   space, and rounding up to bins and alignments
+//
+// cuMemGetInfo reports free as the device's global memory minus the device bytes.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace cocl {
+    class MemoryStats {
+    public:
+        size_t deviceBytes = 0;
+        size_t peakDeviceBytes = 0;
+        size_t allocatedBytes = 0;
+        size_t peakAllocatedBytes = 0;
+        size_t reservedBytes = 0; // filled in by getMemoryStats
+        size_t numAllocations = 0; // live
+        size_t peakNumAllocations = 0;
+        size_t totalAllocations = 0;
+        size_t totalFrees = 0;
+
+        // live allocations by requested size. bin i holds sizes in [2^(i-1), 2^i)
+        static const int numHistogramBins = 64;
+        size_t histogram[numHistogramBins] = {};
+
+        // filled in by getMemoryStats.  largestFreeBlockBytes is the biggest allocation we could hand
+        // out from reserved memory, without going to the driver. fragmentation is the fraction of
+        // reserved bytes that are not in that block: 0 means all of the reserve is usable as one block
+        size_t largestFreeBlockBytes = 0;
+        double fragmentation = 0;
+
+        static int getHistogramBin(size_t bytes);
+        // single line of key=value pairs, for logging or scraping
+        std::string toString() const;
+    };
+
+    // snapshot for the current context
+    MemoryStats getMemoryStats();
+}
@@ -0,0 +1,47 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// cudaOccupancyMaxPotentialBlockSize and cudaOccupancyMaxActiveBlocksPerMultiprocessor
+//
+// These are answered from what the OpenCL driver says about the built kernel:
+// CL_KERNEL_WORK_GROUP_SIZE, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE and
+// CL_KERNEL_LOCAL_MEM_SIZE. If the kernel hasnt been launched yet, we generate and build it, with
+// all pointer args in one clmem, which is what a launch with the slab allocator will use anyway.
+//
+// patch_hostside registers each kernel's host-side stub with coclRegisterKernel, from a global
+// constructor, so we can get from the function pointer the client passes us to the kernel.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+extern "C" {
+    // called by the global constructor patch_hostside adds to each module
+    void coclRegisterKernel(const char *hostFunction, int32_t *kernelIdSlot, const char *kernelName, const char *devicellsourcecode);
+
+    size_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, const void *func, int blockSize, size_t dynamicSMemSize);
+    size_t cudaOccupancyMaxPotentialBlockSize(int *minGridSize, int *blockSize, const void *func, size_t dynamicSMemSize, int blockSizeLimit);
+}
+
+// the runtime api lets you pass the kernel itself, so these take any function pointer
+template<class T>
+size_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, T func, int blockSize, size_t dynamicSMemSize) {
+    return cudaOccupancyMaxActiveBlocksPerMultiprocessor(numBlocks, (const void *)func, blockSize, dynamicSMemSize);
+}
+
+template<class T>
+size_t cudaOccupancyMaxPotentialBlockSize(int *minGridSize, int *blockSize, T func, size_t dynamicSMemSize = 0, int blockSizeLimit = 0) {
+    return cudaOccupancyMaxPotentialBlockSize(minGridSize, blockSize, (const void *)func, dynamicSMemSize, blockSizeLimit);
+}
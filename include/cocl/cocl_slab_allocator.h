@@ -0,0 +1,76 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Slab suballocator for cudaMalloc/cudaFree
+//
+// Instead of one clmem per cudaMalloc, we create a few big slab clmems, and carve allocations out of
+// them.  Each slab owns a contiguous range of the virtual address space, so an allocation's virtual
+// address is simply the slab's fakePos plus its offset within the slab.  This means:
+// - kernels using double-indirected pointers ('float **' et al) work, as long as everything they
+//   touch is in the first slab, since getGlobalPointer can map any virtual address in the slab
+//   straight to an offset in clmem0
+// - kernel launches see fewer distinct clmems, so fewer kernel args, and fewer unique kernel variants
+//
+// Freed blocks can be handed out again straight away, without waiting for kernels still using them,
+// in the same way as for the caching allocator: each free block keeps the markers recorded on each
+// stream when it was freed, and whoever it goes to next gets barriers on them, see
+// Context::waitForReleaseMarkers.
+//
+// Enabled per context by setting COCL_SLAB_ALLOCATOR=1.  Slab size is set by COCL_SLAB_BYTES,
+// defaulting to CL_DEVICE_MAX_MEM_ALLOC_SIZE.  Allocations bigger than a slab get a slab to themselves.
+
+#pragma once
+
+#include "clew.h"
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+namespace cocl {
+    class Memory;
+    class Context;
+
+    class Slab {
+    public:
+        Memory *memory; // owns the clmem
+        std::map<size_t, size_t> freeBytesByOffset; // free blocks, kept coalesced
+        // release markers still pending for each free block, keyed the same. owned
+        std::map<size_t, std::vector<cl_event> > releaseMarkersByOffset;
+        size_t bytesInUse = 0;
+    };
+
+    class SlabAllocator {
+    public:
+        SlabAllocator(Context *context, size_t slabBytes);
+        ~SlabAllocator();
+        Memory *allocate(size_t bytes);
+        void release(Memory *memory);
+        Memory *getFirstSlab(); // 0 if nothing allocated yet
+        size_t getLargestFreeBytes(); // caller should hold the ContextMutex
+
+        static const size_t alignment = 128; // same alignment as the non-slab fakePos
+
+        Context *context;
+        size_t slabBytes;
+        std::vector<Slab *> slabs;
+
+    protected:
+        // returns the offset, or -1 if doesnt fit. adds the markers the caller should wait for to
+        // markers. caller should hold the ContextMutex
+        long long allocateFromSlab(Slab *slab, size_t bytes, std::vector<cl_event> &markers);
+        static void releaseSlabMarkers(Slab *slab);
+        Slab *findSlab(Memory *slabMemory);
+    };
+}
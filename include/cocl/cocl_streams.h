@@ -7,6 +7,12 @@ namespace easycl {
     class CLQueue;
 }
 
+namespace cocl {
+    class Context;
+    class ArgRingBuffer;
+    class CoclGraph;
+}
+
 extern "C" {
     size_t cuStreamCreate(char **pqueue, unsigned int flags);
     size_t cudaStreamSynchronize(char *pqueue);
@@ -50,5 +56,8 @@ namespace cocl {
         CoclStream(easycl::EasyCL *cl);
         ~CoclStream();
         easycl::CLQueue *clqueue;
+        Context *context = 0; // for streams from cuStreamCreate, the context that knows about us
+        ArgRingBuffer *argRingBuffer = 0; // owned. for by-value struct kernel args, created on first use
+        CoclGraph *capturingGraph = 0; // between cudaStreamBeginCapture and cudaStreamEndCapture
     };
 }
@@ -0,0 +1,42 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// coclWarmupKernels: generate and build kernels before their first launch
+//
+// Normally each kernel is generated and built by the first kernelGo that needs it, which stalls that
+// launch. coclWarmupKernels, or COCL_WARMUP_KERNELS=1, queues every kernel with a launch site (see
+// cocl_kernel_registry.h) onto a pool of background threads, which build them in parallel, into the
+// context's kernel cache. A launch of a kernel that is still being built waits for just that kernel,
+// see getOrBuildKernelCacheEntry. Launches of anything else carry on as usual.
+//
+// Which pointer args share a buffer is only known at launch, so we build the variant a launch is most
+// likely to want: all pointer args in one buffer with COCL_SLAB_ALLOCATOR, otherwise each in its own.
+// Each thread generates the OpenCL from the IR in its own LLVMContext, see convertEmbeddedLlStringToCl,
+// so both the generating and the driver builds run in parallel, with no lock shared between threads.
+
+#pragma once
+
+namespace cocl {
+    class Context;
+
+    void warmupKernels(Context *context);
+    // for new contexts: warms up if COCL_WARMUP_KERNELS=1
+    void warmupKernelsIfRequested(Context *context);
+}
+
+extern "C" {
+    // queues every kernel for building in the current context, and returns straight away
+    void coclWarmupKernels();
+}
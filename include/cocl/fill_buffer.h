@@ -16,8 +16,82 @@
 
 #include "EasyCL/EasyCL.h"
 
+#include <mutex>
+
 namespace cocl {
 
+class Context;
+class PreparedFill;
+
+// Fills device memory with a repeating 8, 16, 32 or 64-bit pattern.  Used by cudaMemsetAsync and
+// cuMemsetD8/D16/D32.
+//
+// Small fills go to clEnqueueFillBuffer.  Bigger ones go to our own kernels, which write uint4s, or
+// ulongs, across the aligned body of the fill, grid-striding over a grid sized from the number of
+// compute units, with the first few threads writing any unaligned head and tail bytes.
+//
+// One per context, with the program built once, on first use. We set the args on the raw cl_kernels
+// ourselves, so there's no per-call kernel cache lookup.
+class FillEngine {
+public:
+    FillEngine(Context *context);
+    ~FillEngine();
+
+    // non-blocking. offsetBytes and countBytes should be multiples of patternBytes
+    void fill(cl_command_queue queue, cl_mem clmem, const void *pattern, int patternBytes,
+        size_t offsetBytes, size_t countBytes);
+    // non-blocking. fills width bytes in each of height rows, pitch bytes apart
+    void fill2D(cl_command_queue queue, cl_mem clmem, unsigned char value, size_t offsetBytes,
+        size_t pitch, size_t width, size_t height);
+    // resolves a byte fill into fill, which can then be enqueued any number of times. can be called
+    // again on the same fill, to change it
+    void prepareFill(PreparedFill *fill, cl_mem clmem, unsigned char value, size_t offsetBytes,
+        size_t countBytes);
+
+    // fills of at least this many bytes use our kernels
+    static const size_t minKernelBytes = 64 * 1024;
+    // fills of at least this many bytes use the uint4 kernel, otherwise ulong
+    static const size_t minUint4Bytes = 1024 * 1024;
+
+    Context *context;
+    cl_program program;
+    cl_kernel fillUlongKernel;
+    cl_kernel fillUint4Kernel;
+    cl_kernel fillRectKernel;
+    size_t workgroupSize;
+    size_t maxWorkgroups;
+
+protected:
+    size_t getFillGlobalSize(int elementBytes, size_t countBytes);
+    void runFillKernel(cl_command_queue queue, cl_kernel kernel, int elementBytes, cl_mem clmem,
+        const unsigned int *pattern16, size_t offsetBytes, size_t countBytes);
+    std::mutex mu; // setting args and enqueueing has to happen together
+};
+
+// a byte fill resolved by FillEngine::prepareFill, for cuda graph memset nodes.  Big fills get their
+// own cl_kernel, with the args already set, so enqueueing needs no lock and no clSetKernelArg
+class PreparedFill {
+public:
+    PreparedFill();
+    ~PreparedFill();
+    // non-blocking
+    void enqueue(cl_command_queue queue) const;
+
+    cl_kernel kernel; // owned. 0 for fills that go to clEnqueueFillBuffer
+    size_t globalSize;
+    size_t workgroupSize;
+    cl_mem clmem;
+    size_t offsetBytes;
+    size_t countBytes;
+    unsigned char value;
+private:
+    PreparedFill(const PreparedFill &);
+    PreparedFill &operator=(const PreparedFill &);
+};
+
+// for the current context
+FillEngine *getFillEngine();
+
 // non-blocking "async"
 int myEnqueueFillBuffer(
     cl_command_queue queue,
@@ -25,4 +99,12 @@ int myEnqueueFillBuffer(
     unsigned int value,
     int offsetBytes, int countInts);
 
+// non-blocking, like memset: any offset, any count. picks clEnqueueFillBuffer or our own kernel
+// depending on size
+int myEnqueueFillBufferBytes(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t countBytes);
+
 } // namespace cocl
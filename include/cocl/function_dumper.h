@@ -90,6 +90,10 @@ public:
     std::string createOffsetDeclaration(std::string argName);
     std::string createOffsetShim(llvm::Type *argType, std::string argName, int clmemIndex);
     std::string dumpKernelFunctionDeclarationWithoutReturn(llvm::Function *F);
+    // how many entries of kernelClmemIndexByArgIndex dumpKernelFunctionDeclarationWithoutReturn
+    // will use for kernel F: one per pointer arg, and per pointer in a by-value struct arg. lets
+    // callers lay out the clmems, without generating the kernel first
+    static int countKernelClmemArgs(llvm::Function *F);
     std::string dumpInternalFunctionDeclarationWithoutReturn(llvm::Function *F);
     std::string dumpFunctionDeclarationWithoutReturn(llvm::Function *F);
     void generateBlockIndex();
@@ -108,6 +112,17 @@ public:
         _addIRToCl = true;
         return this;
     }
+    // the kernel, or something it calls, uses extern __shared__. adds the dynamicShared local
+    // parameter to the kernel, and passes it through GlobalVars
+    FunctionDumper *addDynamicShared() {
+        _addDynamicShared = true;
+        return this;
+    }
+    // nothing the kernel calls uses the scratch local memory, so leave the scratch parameter off
+    FunctionDumper *dropScratch() {
+        _dropScratch = true;
+        return this;
+    }
 
     // std::set<std::string> shimFunctionsNeeded; // for __shfldown_3 etc, that we provide as opencl directly
     cocl::Shims shims;
@@ -125,6 +140,7 @@ public:
     llvm::Type *returnType = 0;
     bool usesVmem = false;
     bool usesScratch = false;
+    int numClmemArgs = 0; // for kernels: how many entries of kernelClmemIndexByArgIndex the signature used
 
 protected:
     // llvm::Function::iterator block_it;
@@ -140,6 +156,8 @@ protected:
     int kernelNumUniqueClmems;
     std::vector<int> &kernelClmemIndexByArgIndex;
     bool _addIRToCl = false;
+    bool _addDynamicShared = false;
+    bool _dropScratch = false;
     std::map<llvm::BasicBlock *, int> functionBlockIndex;
 
     GlobalNames *globalNames;
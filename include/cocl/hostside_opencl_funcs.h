@@ -19,6 +19,9 @@
 
 #include "cocl/cocl_launch_args.h"
 #include "cocl/hostside_opencl_funcs_ext.h"
+#include "cocl/cocl_context.h"
+
+#include <functional>
 
 namespace easycl {
     class CLKernel;
@@ -33,30 +36,68 @@ namespace cocl {
         std::string originalKernelName;
         std::string shortKernelName;
         std::string uniqueKernelName;
+        KernelInfo kernelInfo;
+        std::string diskCacheKey; // empty unless COCL_KERNEL_CACHE_DIR is set, see KernelDiskCache
+        std::vector<unsigned char> programBinary; // from the disk cache, if it was there
     };
-    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, std::string devicellsourcecode);
+    // generates OpenCL source-code, based on passed-in bytecode. kernelGo caches the result, by
+    // kernel id. devicellsourcecode has to be one of the strings patch_hostside embeds, since the
+    // parsed module is kept, keyed on its address, see convertEmbeddedLlStringToCl
+    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, const char *devicellsourcecode);
+    // how long clmemIndexByClmemArgIndex needs to be for the kernel, without generating it
+    int getNumClmemArgs(std::string origKernelName, const char *devicellsourcecode);
+    // local memory for the scratch param of a kernel that uses the __shfl shims, for blocks blockX
+    // threads wide. the shims read anywhere in the thread's warp of 32, so it's rounded up to whole warps
+    size_t getScratchBytes(size_t blockX);
     easycl::CLKernel *compileOpenCLKernel(std::string originalKernelName, std::string uniqueKernelName, std::string shortKernelName, std::string clSourcecode);
     easycl::CLKernel *compileOpenCLKernel(std::string shortKernelName, std::string clSourcecode);
+    // the entry for key in context's kernelCacheById. if there isnt one, and no other thread is
+    // building one, calls generate, and builds and stores the result. otherwise waits for the other
+    // thread. caller shouldnt hold the kernelCacheMutex
+    KernelCacheEntry &getOrBuildKernelCacheEntry(Context *context, const KernelCacheKey &key, std::function<GenerateOpenCLResult()> generate);
+    // the kernel id for a launch site's slot, handing out a new one on first use
+    int32_t getKernelId(int32_t *kernelIdSlot);
+
 
+    // a kernel arg that came from a device pointer, for stream capture
+    class LaunchPointerArg {
+    public:
+        const char *ptr;
+        int clmemArgIndex; // index into clmemByClmemArgIndex
+        int argIndex; // index into args, of the offset
+        int clmemIndex; // index into clmems. filled in by kernelGo
+    };
 
     class LaunchConfiguration {
     public:
         size_t grid[3];
         size_t block[3];
+        size_t sharedMem = 0; // bytes of extern __shared__ memory, from cudaConfigureCall
         easycl::CLQueue *queue = 0;  // NOT owned by us
         cocl::CoclStream *coclStream = 0; // NOT owned
 
-        std::vector<std::unique_ptr<Arg> > args;
+        LaunchArgs args;
 
+        // what the setKernelArg calls gave us: the first allocation, for vmem, see
+        // configureKernelWithId, and the cl_mem of each clmem arg, in order
+        cl_mem firstClmem = 0;
+        std::vector<cl_mem> clmemByClmemArgIndex;
+        // how kernelGo lays those out as kernel params, see assignClmemIndexes
         std::map<cl_mem, int> clmemIndexByClmem;
         std::vector<cl_mem> clmems;
         std::vector<int> clmemIndexByClmemArgIndex;
+        std::vector<uint64_t> vmemlocs; // vmem base of each of clmems. filled in by kernelGo
+        std::vector<LaunchPointerArg> pointerArgs;
 
         std::vector<cl_mem> kernelArgsToBeReleased;
-        std::string kernelName = "";
+        int32_t kernelId = 0;
+        // kernelName and devicellsourcecode point at constant strings in the patched module, so
+        // we dont copy them on each launch
+        const char *kernelName = "";
+        const char *devicellsourcecode = "";
         std::string uniqueKernelName = "";
         std::string shortKernelName = "";
-        std::string devicellsourcecode = "";
+        KernelCacheKey cacheKey; // reused across launches, so looking up the kernel doesnt allocate
     };
 }
 
@@ -36,6 +36,16 @@
 namespace cocl {
     int32_t getNumCachedKernels(); // this should be per-context or something, though right now, it is not yet
     int32_t getNumKernelCalls();
+    // kernelGo lookups in the kernel cache, for the current context
+    int64_t getNumKernelCacheHits();
+    int64_t getNumKernelCacheMisses();
+    // lookups in the on-disk kernel cache, for the current context. 0 unless COCL_KERNEL_CACHE_DIR is set
+    int64_t getNumKernelDiskCacheHits();
+    int64_t getNumKernelDiskCacheMisses();
+    // kernels whose opencl came from cocl --aot, and kernels converted from the device ir at runtime,
+    // for the current context
+    int64_t getNumPrebuiltKernelsUsed();
+    int64_t getNumKernelsGenerated();
 }
 
 extern "C" {
@@ -47,6 +57,9 @@ extern "C" {
     size_t cuInit(unsigned int flags);
 
     void configureKernel(const char *kernelName, const char *devicellsourcecode);
+    // patch_hostside gives each kernel a zero-initialized int32 slot in the patched module. we fill
+    // it with a process-wide kernel id on first launch, and key the kernel cache on that
+    void configureKernelWithId(int32_t *kernelIdSlot, const char *kernelName, const char *devicellsourcecode);
     void addClmemArg(cl_mem clmem);
     void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize);
     void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize);
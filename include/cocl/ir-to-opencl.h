@@ -21,6 +21,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 namespace cocl {
 
@@ -29,11 +30,33 @@ public:
     std::string clSourcecode = "";
     bool usesVmem = false;
     bool usesScratch = false;
+    bool usesDynamicShared = false;
+    int numClmemArgs = 0;
 };
 
 ModuleClRes convertModuleToCl(
     int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, llvm::Module *M, std::string specificFunction, std::string generatedName, bool offsets_32bit);
 ModuleClRes convertLlStringToCl(
     int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string llString, std::string specificFunction, std::string generatedName, bool offsets_32bit);
+// like convertLlStringToCl, but only parses llString the first time it sees it, keyed on its
+// address, so llString has to stay put for the life of the process, like the device IR that
+// patch_hostside embeds. each call works on a copy of just the functions and globals the kernel
+// uses. each thread has its own LLVMContext, and parses llString into it itself, so this can be
+// called from several threads at once
+ModuleClRes convertEmbeddedLlStringToCl(
+    int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, const char *llString, std::string specificFunction, std::string generatedName, bool offsets_32bit);
+
+// copies M, with definitions only for functionName, and the functions and globals it uses,
+// directly or indirectly. everything else is left as a declaration
+std::unique_ptr<llvm::Module> cloneFunctionCallGraph(const llvm::Module *M, std::string functionName);
+
+// how many clmem args kernelName's generated signature has, ie how long clmemIndexByClmemArgIndex
+// needs to be, without generating it. the Embedded one has the same restrictions as
+// convertEmbeddedLlStringToCl
+int getKernelNumClmemArgs(llvm::Module *M, std::string kernelName);
+int getEmbeddedKernelNumClmemArgs(const char *llString, std::string kernelName);
+
+// names of the functions M marks as kernels, in nvvm.annotations
+std::vector<std::string> getKernelNames(const llvm::Module *M);
 
 } // namespace cocl
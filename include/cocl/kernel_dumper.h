@@ -54,12 +54,22 @@ public:
         _addIRToCl = true;
         return this;
     }
+    // leave the scratch parameter off kernels that dont use it. then the kernel has a scratch
+    // parameter exactly when usesScratch is set. otherwise, theres always a scratch parameter,
+    // which is what callers of ir-to-opencl expect
+    KernelDumper *dropUnusedScratch() {
+        _dropUnusedScratch = true;
+        return this;
+    }
 
     bool usesVmem = false;
     bool usesScratch = false;
+    bool usesDynamicShared = false; // extern __shared__, in the kernel or anything it calls
+    int numClmemArgs = 0; // how many entries of clmemIndexByClmemArgIndex the kernel needs
 
 protected:
     bool _addIRToCl = false;
+    bool _dropUnusedScratch = false;
     cocl::GlobalNames globalNames;
     std::unique_ptr<cocl::TypeDumper> typeDumper;
     cocl::Shims shims;
@@ -75,6 +75,9 @@ public:
     void dumpMemcpy(LocalValueInfo *localValueInfo, int align);
     void writeShimCall(LocalValueInfo *localValueInfo, std::string shimName, std::string extraArgs, llvm::CallInst *instr);
     void dumpCall(LocalValueInfo *localValueInfo, const std::map<llvm::Function *, llvm::Type *> &returnTypeByFunction);
+    // whether calling functionName means using the scratch local memory, ie its shim, or one of the
+    // shim's dependencies, takes the scratch
+    static bool callUsesScratch(std::string functionName);
 
     void runGeneration(LocalValueInfo *localValueInfo, const std::map<llvm::Function *, llvm::Type *> &returnTypeByFunction);
 
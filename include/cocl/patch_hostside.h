@@ -229,6 +229,17 @@ public:
     // its value, stores that, in info, along with the arguments there already
     static void getLaunchArgValue(GenericCallInst *inst, LaunchCallInfo *info, ParamInfo *paramInfo);
 
+    // adds a call to coclRegisterKernel, for the kernel with host-side stub hostFunction, to a function
+    // run at load time. this is what lets the runtime go from a kernel function pointer, as passed to
+    // eg cudaOccupancyMaxPotentialBlockSize, to the kernel
+    // the function, run as a global constructor, that the registration calls go into. created on first use
+    static llvm::Function *getRegisterKernelsFunction(llvm::Module *M);
+    static void addRegisterKernelInst(llvm::Module *M, llvm::Value *hostFunction, llvm::GlobalVariable *kernelIdSlot,
+        std::string kernelName);
+    // embeds the opencl in aotFilename, from ir-to-opencl --aot-outputfile, with a call to
+    // coclRegisterPrebuiltKernel for each kernel variant, so the runtime doesnt need to generate those
+    static void addPrebuiltKernelInsts(llvm::Module *M, std::string aotFilename);
+
     static void patchCudaLaunch(
         llvm::Module *M, const llvm::Module *MDevice,
         llvm::Function *F, GenericCallInst *inst, std::vector<llvm::Instruction *> &to_replace_with_zero);
@@ -17,4 +17,7 @@ public:
     static int readInt32Constant(llvm::Value *value);
     static float readFloatConstant(llvm::Value *value);
     static std::string dumpFloatConstant(bool forceSingle, llvm::ConstantFP *constantFP);
+    // extern __shared__ arrays, whose size is given at launch time. these come through as
+    // addrspace(3) globals with no definition, or with zero elements
+    static bool isDynamicShared(llvm::Value *value);
 };
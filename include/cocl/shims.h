@@ -30,10 +30,13 @@ public:
     void copyFrom(const Shims &source);
     void writeCl(std::ostream &os);
     bool isUsed(std::string name);
+    // whether the shim, or anything it depends on, takes the scratch local memory as its first param
+    bool usesScratch(std::string name) const;
 
 protected:
     std::map<std::string, std::string> _shimClByName;
     std::map<std::string, std::set<std::string> > _dependenciesByName;
+    std::set<std::string> _scratchShims;
     std::set<std::string> shimsToBeUsed;
 };
 
@@ -210,6 +210,11 @@ void InsertValueClWriter::writeDeclaration(std::string indent, TypeDumper *typeD
 void SharedClWriter::writeDeclaration(std::string indent, TypeDumper *typeDumper, std::ostream &os) {
     // cout << "sharedclwriter::writedeclaration" << endl;
     Value *value = localValueInfo->value;
+    if(ReadIR::isDynamicShared(value)) {
+        // its a pointer into the dynamicShared kernel parameter. FunctionDumper::dumpSharedDefinitions
+        // writes it
+        return;
+    }
     // cout << "value:" << endl;
     // value->dump();
     // cout << endl;
@@ -74,7 +74,7 @@ void DebugDumper::dump() {
                         cout << "buffer " << argIdx << ": offsetArg out of bounds => skipping arg" << endl;
                         continue;
                     }
-                    offsetBytes = llvm::cast<Int64Arg>(launchConfiguration->args[offsetArg].get())->v;
+                    offsetBytes = launchConfiguration->args.getInteger(offsetArg);
                 } else {
                     offsetBytes = argConfig["offsetbytes"].as<int>();
                 }
@@ -122,8 +122,7 @@ void DebugDumper::dump() {
 }
 
 void DebugDumper::maybeDump() {
-    // we are going to assume we're already inside a mutex, and therefore
-    // guaranteed to be running single-threaded
+    // each thread has its own DebugDumper, and launch configuration, so no locking needed here
     if(!checkedDumpEnabled) {
         if(getenv("COCL_DUMP_CONFIG") != 0) {
             string dumpConfigFile = getenv("COCL_DUMP_CONFIG");
@@ -134,6 +133,9 @@ void DebugDumper::maybeDump() {
         checkedDumpEnabled = true;
     }
     if(dumpEnabled) {
+        // launches dont otherwise block, so wait for this one here
+        cl_int err = clFinish(launchConfiguration->queue->queue);
+        easycl::EasyCL::checkError(err);
         dump();
     }
 }
@@ -0,0 +1,84 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_aot_file.h"
+
+#include <fstream>
+#include <sstream>
+#include <iterator>
+#include <stdexcept>
+
+using namespace std;
+
+// bump this if the format changes
+#define AOT_FILE_MAGIC "cocl-aot-v1"
+
+namespace cocl {
+
+void writeAotFileMagic(ostream &os) {
+    os << AOT_FILE_MAGIC << "\n";
+}
+
+void writeAotKernel(ostream &os, const AotKernel &kernel) {
+    // "-" for no clmem args, so the header always has the same number of fields
+    string clmemIndexes = kernel.clmemIndexes == "" ? "-" : kernel.clmemIndexes;
+    os << "kernel " << kernel.kernelName << " " << clmemIndexes << " " << kernel.uniqueClmemCount << " "
+        << kernel.offsets32bit << " " << kernel.usesVmem << " " << kernel.usesScratch << " " << kernel.usesDynamicShared << " "
+        << kernel.numClmemArgs << " " << kernel.clSourcecode.size() << "\n";
+    os << kernel.clSourcecode << "\n";
+}
+
+vector<AotKernel> readAotFile(string filename) {
+    ifstream f(filename, ios_base::in | ios_base::binary);
+    if(!f) {
+        throw runtime_error("couldnt open " + filename);
+    }
+    string contents((std::istreambuf_iterator<char>(f)), (std::istreambuf_iterator<char>()));
+    size_t pos = contents.find('\n');
+    if(pos == string::npos || contents.substr(0, pos) != AOT_FILE_MAGIC) {
+        throw runtime_error(filename + " isnt an ahead-of-time opencl file, or is from a different version of Coriander");
+    }
+    pos++;
+
+    vector<AotKernel> kernels;
+    while(pos < contents.size()) {
+        size_t lineEnd = contents.find('\n', pos);
+        if(lineEnd == string::npos) {
+            throw runtime_error("truncated kernel header in " + filename);
+        }
+        istringstream header(contents.substr(pos, lineEnd - pos));
+        AotKernel kernel;
+        string tag;
+        int offsets32bit, usesVmem, usesScratch, usesDynamicShared;
+        size_t numBytes;
+        if(!(header >> tag >> kernel.kernelName >> kernel.clmemIndexes >> kernel.uniqueClmemCount >> offsets32bit >> usesVmem
+                >> usesScratch >> usesDynamicShared >> kernel.numClmemArgs >> numBytes) || tag != "kernel"
+                || contents.size() - (lineEnd + 1) < numBytes) {
+            throw runtime_error("couldnt parse kernel header in " + filename + ": " + header.str());
+        }
+        if(kernel.clmemIndexes == "-") {
+            kernel.clmemIndexes = "";
+        }
+        kernel.offsets32bit = offsets32bit != 0;
+        kernel.usesVmem = usesVmem != 0;
+        kernel.usesScratch = usesScratch != 0;
+        kernel.usesDynamicShared = usesDynamicShared != 0;
+        kernel.clSourcecode = contents.substr(lineEnd + 1, numBytes);
+        pos = lineEnd + 1 + numBytes + 1;
+        kernels.push_back(kernel);
+    }
+    return kernels;
+}
+
+} // namespace cocl
@@ -0,0 +1,86 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_arg_ring_buffer.h"
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace easycl;
+
+#ifdef COCL_PRINT
+#undef COCL_PRINT
+#endif
+
+#ifdef COCL_SPAM_KERNELLAUNCH
+#define COCL_PRINT(x) std::cout << "[LAUNCH] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+namespace cocl {
+    ArgRingBuffer::ArgRingBuffer(EasyCL *cl, cl_command_queue queue, size_t bytes, int numSegments) :
+            bytes(bytes), queue(queue), shadow(bytes), segmentFences(numSegments, (cl_event)0) {
+        segmentBytes = (bytes / numSegments / alignment) * alignment;
+        if(segmentBytes == 0) {
+            cout << "ArgRingBuffer: " << bytes << " bytes is too small for " << numSegments << " segments" << endl;
+            throw runtime_error("ArgRingBuffer: too small for the number of segments");
+        }
+        // read-write, since kernels are allowed to modify their by-value args
+        cl_int err;
+        clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+        EasyCL::checkError(err);
+    }
+
+    ArgRingBuffer::~ArgRingBuffer() {
+        for(auto it=segmentFences.begin(); it != segmentFences.end(); it++) {
+            if(*it != 0) {
+                clReleaseEvent(*it);
+            }
+        }
+        clReleaseMemObject(clmem);
+    }
+
+    long long ArgRingBuffer::write(const void *data, size_t dataBytes) {
+        size_t alignedBytes = ((dataBytes + alignment - 1) / alignment) * alignment;
+        if(alignedBytes > segmentBytes) {
+            return -1;
+        }
+        std::lock_guard<std::mutex> lock(mu);
+        cl_int err;
+        if(head + alignedBytes > segmentBytes) {
+            // move on to the next segment. the marker tells us, a lap from now, when everything
+            // enqueued up to here, reading this segment, is done
+            err = clEnqueueMarkerWithWaitList(queue, 0, 0, &segmentFences[segment]);
+            EasyCL::checkError(err);
+            segment = (segment + 1) % segmentFences.size();
+            head = 0;
+            if(segmentFences[segment] != 0) {
+                err = clWaitForEvents(1, &segmentFences[segment]);
+                EasyCL::checkError(err);
+                clReleaseEvent(segmentFences[segment]);
+                segmentFences[segment] = 0;
+            }
+        }
+        size_t offset = segment * segmentBytes + head;
+        head += alignedBytes;
+        memcpy(&shadow[offset], data, dataBytes);
+        err = clEnqueueWriteBuffer(queue, clmem, CL_FALSE, offset, dataBytes, &shadow[offset], 0, NULL, NULL);
+        EasyCL::checkError(err);
+        COCL_PRINT("ArgRingBuffer::write bytes=" << dataBytes << " offset=" << offset);
+        return (long long)offset;
+    }
+}
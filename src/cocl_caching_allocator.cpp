@@ -0,0 +1,163 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_caching_allocator.h"
+
+#include "cocl/cocl_memory.h"
+#include "cocl/cocl_context.h"
+
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+using namespace cocl;
+
+#ifdef COCL_PRINT
+#undef COCL_PRINT
+#endif
+
+#ifdef COCL_SPAM_MEMORY
+#define COCL_PRINT(x) std::cout << "[MEM] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+namespace cocl {
+    CachingAllocator::CachingAllocator(Context *context, size_t maxCachedBytes) :
+            context(context), maxCachedBytes(maxCachedBytes) {
+        stats.maxCachedBytes = maxCachedBytes;
+    }
+
+    CachingAllocator::~CachingAllocator() {
+        trim();
+    }
+
+    size_t CachingAllocator::getBinBytes(size_t bytes) {
+        size_t binBytes = (size_t)1 << minBinLog2;
+        while(binBytes < bytes) {
+            binBytes <<= 1;
+        }
+        if(binBytes > ((size_t)1 << maxBinLog2)) {
+            return 0;
+        }
+        return binBytes;
+    }
+
+    Memory *CachingAllocator::allocate(size_t bytes) {
+        size_t binBytes = getBinBytes(bytes);
+        Memory *hit = 0;
+        {
+            ContextMutex contextMutex(context);
+            if(binBytes != 0) {
+                auto it = cachedMemoriesByBytes.find(binBytes);
+                if(it != cachedMemoriesByBytes.end()) {
+                    hit = it->second;
+                    cachedMemoriesByBytes.erase(it);
+                    hit->addToIndex(context);
+                    stats.hits++;
+                    stats.bytesCached -= hit->bytes;
+                    stats.bytesInUse += hit->bytes;
+                    COCL_PRINT("CachingAllocator::allocate hit bytes=" << bytes << " bin=" << binBytes);
+                }
+            }
+            if(hit == 0) {
+                stats.misses++;
+            }
+        }
+        if(hit != 0) {
+            // kernels queued before the free might still be using it
+            context->waitForReleaseMarkers(hit->releaseMarkers);
+            return hit;
+        }
+        size_t allocBytes = binBytes != 0 ? binBytes : bytes;
+        COCL_PRINT("CachingAllocator::allocate miss bytes=" << bytes << " allocating=" << allocBytes);
+        Memory *memory = 0;
+        try {
+            memory = Memory::newDeviceAlloc(allocBytes);
+        } catch(runtime_error &e) {
+            // maybe the driver is out of memory. give back anything we're holding onto, and try once more
+            if(getStats().bytesCached == 0) {
+                throw;
+            }
+            trim();
+            memory = Memory::newDeviceAlloc(allocBytes);
+        }
+        ContextMutex contextMutex(context);
+        stats.bytesInUse += memory->bytes;
+        return memory;
+    }
+
+    void CachingAllocator::release(Memory *memory) {
+        if(getBinBytes(memory->bytes) == memory->bytes) {
+            // we might cache it. mark where every stream is up to, rather than waiting for them, so
+            // free stays cheap. see allocate
+            context->recordReleaseMarkers(memory->releaseMarkers);
+        }
+        {
+            ContextMutex contextMutex(context);
+            stats.bytesInUse -= memory->bytes;
+            if(getBinBytes(memory->bytes) == memory->bytes && stats.bytesCached + memory->bytes <= maxCachedBytes) {
+                memory->removeFromIndex(context);
+                cachedMemoriesByBytes.insert(std::make_pair(memory->bytes, memory));
+                stats.bytesCached += memory->bytes;
+                COCL_PRINT("CachingAllocator::release caching bytes=" << memory->bytes);
+                return;
+            }
+            stats.bytesReleased += memory->bytes;
+        }
+        COCL_PRINT("CachingAllocator::release freeing bytes=" << memory->bytes);
+        delete memory;
+    }
+
+    void CachingAllocator::trim() {
+        vector<Memory *> toDelete;
+        {
+            ContextMutex contextMutex(context);
+            for(auto it=cachedMemoriesByBytes.begin(); it != cachedMemoriesByBytes.end(); it++) {
+                // the driver keeps the clmem until commands using it are done, so no need to wait
+                // for the release markers
+                toDelete.push_back(it->second);
+                stats.bytesReleased += it->first;
+            }
+            cachedMemoriesByBytes.clear();
+            stats.bytesCached = 0;
+        }
+        COCL_PRINT("CachingAllocator::trim freeing " << toDelete.size() << " cached memories");
+        for(auto it=toDelete.begin(); it != toDelete.end(); it++) {
+            delete *it;
+        }
+    }
+
+    CachingAllocatorStats CachingAllocator::getStats() {
+        ContextMutex contextMutex(context);
+        return stats;
+    }
+
+    size_t CachingAllocator::getLargestCachedBytes() {
+        if(cachedMemoriesByBytes.size() == 0) {
+            return 0;
+        }
+        return cachedMemoriesByBytes.rbegin()->first;
+    }
+
+    CachingAllocatorStats getCachingAllocatorStats() {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        if(!context->cachingAllocator) {
+            return CachingAllocatorStats();
+        }
+        return context->cachingAllocator->getStats();
+    }
+}
@@ -17,6 +17,9 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <mutex>
 
 namespace cocl {
     // static std::vector< std::string > clSources;
@@ -51,3 +54,60 @@ MyClass::MyClass(const char *name) {
 // std::vector<std::string> &getClSources() {
 //     return clSources;
 // }
+
+namespace cocl {
+    static std::mutex prebuiltKernelsMutex;
+
+    static std::map<std::string, PrebuiltKernel> &getPrebuiltKernels() {
+        // function-local, since registration runs from other modules' global constructors
+        static std::map<std::string, PrebuiltKernel> prebuiltKernels;
+        return prebuiltKernels;
+    }
+
+    static std::string makePrebuiltKernelKey(const char *devicellsourcecode, const std::string &kernelName,
+            int uniqueClmemCount, const std::string &clmemIndexes, bool offsets_32bit) {
+        // the device ir is keyed on its address, as with the parsed modules in ir-to-opencl
+        std::ostringstream key;
+        key << (const void *)devicellsourcecode << " " << kernelName << " " << uniqueClmemCount << " " << clmemIndexes << " " << offsets_32bit;
+        return key.str();
+    }
+
+    std::string makeClmemIndexesString(const std::vector<int> &clmemIndexByClmemArgIndex) {
+        std::ostringstream clmemIndexes;
+        for(size_t i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
+            if(i > 0) {
+                clmemIndexes << ",";
+            }
+            clmemIndexes << clmemIndexByClmemArgIndex[i];
+        }
+        return clmemIndexes.str();
+    }
+
+    bool findPrebuiltKernel(const char *devicellsourcecode, const std::string &kernelName, int uniqueClmemCount,
+            const std::vector<int> &clmemIndexByClmemArgIndex, bool offsets_32bit, PrebuiltKernel *prebuiltKernel) {
+        std::string key = makePrebuiltKernelKey(
+            devicellsourcecode, kernelName, uniqueClmemCount, makeClmemIndexesString(clmemIndexByClmemArgIndex), offsets_32bit);
+        std::lock_guard<std::mutex> lock(prebuiltKernelsMutex);
+        std::map<std::string, PrebuiltKernel> &prebuiltKernels = getPrebuiltKernels();
+        auto it = prebuiltKernels.find(key);
+        if(it == prebuiltKernels.end()) {
+            return false;
+        }
+        *prebuiltKernel = it->second;
+        return true;
+    }
+}
+
+void coclRegisterPrebuiltKernel(
+        const char *devicellsourcecode, const char *kernelName, const char *clmemIndexes, int32_t uniqueClmemCount, int32_t offsets_32bit,
+        int32_t usesVmem, int32_t usesScratch, int32_t usesDynamicShared, int32_t numClmemArgs, const char *clSourcecode) {
+    PrebuiltKernel prebuiltKernel;
+    prebuiltKernel.clSourcecode = clSourcecode;
+    prebuiltKernel.usesVmem = usesVmem != 0;
+    prebuiltKernel.usesScratch = usesScratch != 0;
+    prebuiltKernel.usesDynamicShared = usesDynamicShared != 0;
+    prebuiltKernel.numClmemArgs = numClmemArgs;
+    std::string key = makePrebuiltKernelKey(devicellsourcecode, kernelName, uniqueClmemCount, clmemIndexes, offsets_32bit != 0);
+    std::lock_guard<std::mutex> lock(prebuiltKernelsMutex);
+    getPrebuiltKernels()[key] = prebuiltKernel;
+}
@@ -16,6 +16,14 @@
 
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_streams.h"
+#include "cocl/cocl_caching_allocator.h"
+#include "cocl/cocl_slab_allocator.h"
+#include "cocl/fill_buffer.h"
+#include "cocl/cocl_memcpy_batch.h"
+#include "cocl/cocl_kernel_disk_cache.h"
+#include "cocl/cocl_warmup.h"
+#include "cocl/DebugDumper.h"
+#include "cocl/cocl_device.h"
 
 #include <iostream>
 #include <memory>
@@ -33,19 +41,170 @@ using namespace easycl;
 #define COCL_PRINT(x)
 
 #define OFFSETS_32BIT_ENV_VAR "COCL_OFFSETS_32BIT"
+#define CACHING_ALLOCATOR_ENV_VAR "COCL_CACHING_ALLOCATOR"
+#define CACHING_ALLOCATOR_MAX_CACHED_BYTES_ENV_VAR "COCL_CACHING_ALLOCATOR_MAX_CACHED_BYTES"
+#define CACHING_ALLOCATOR_DEFAULT_MAX_CACHED_BYTES (256 * 1024 * 1024)
+#define SLAB_ALLOCATOR_ENV_VAR "COCL_SLAB_ALLOCATOR"
+#define SLAB_BYTES_ENV_VAR "COCL_SLAB_BYTES"
+#define KERNEL_CACHE_DIR_ENV_VAR "COCL_KERNEL_CACHE_DIR"
+#define KERNEL_CACHE_MAX_BYTES_ENV_VAR "COCL_KERNEL_CACHE_MAX_BYTES"
+#define KERNEL_CACHE_DEFAULT_MAX_BYTES (256 * 1024 * 1024)
+#define SPECIALIZE_ALIASING_ENV_VAR "COCL_SPECIALIZE_ALIASING"
 
 namespace cocl {
     std::mutex clcontextcreation_mutex;
+    // every live context, in any thread, for getDeviceBytesForAllContexts
+    std::mutex allContextsMutex;
+    std::set<Context *> allContexts;
 
-    Context::Context(int gpuOrdinal) : gpuOrdinal(gpuOrdinal) {
+    Context::Context(int gpuOrdinal) :
+            nextClDumpIndex(0), numPrebuiltKernelsUsed(0), numKernelsGenerated(0), gpuOrdinal(gpuOrdinal) {
         COCL_PRINT(cout << "Context() " << this << endl);
         std::lock_guard< std::mutex > guard(clcontextcreation_mutex);
         cocl::CoclDevice *coclDevice = cocl::getCoclDeviceByGpuOrdinal(gpuOrdinal);
         cl.reset(EasyCL::createForPlatformDeviceIds(coclDevice->platformId, coclDevice->deviceId));
         default_stream.reset(new CoclStream(cl.get()));
+        if(getenv(CACHING_ALLOCATOR_ENV_VAR) != 0 && string(getenv(CACHING_ALLOCATOR_ENV_VAR)) == "1") {
+            size_t maxCachedBytes = CACHING_ALLOCATOR_DEFAULT_MAX_CACHED_BYTES;
+            if(getenv(CACHING_ALLOCATOR_MAX_CACHED_BYTES_ENV_VAR) != 0) {
+                maxCachedBytes = (size_t)atoll(getenv(CACHING_ALLOCATOR_MAX_CACHED_BYTES_ENV_VAR));
+            }
+            COCL_PRINT(cout << "caching allocator enabled, maxCachedBytes=" << maxCachedBytes << endl);
+            cachingAllocator.reset(new CachingAllocator(this, maxCachedBytes));
+        }
+        if(getenv(SLAB_ALLOCATOR_ENV_VAR) != 0 && string(getenv(SLAB_ALLOCATOR_ENV_VAR)) == "1") {
+            size_t slabBytes = getDeviceInfoInt64(coclDevice->deviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+            if(getenv(SLAB_BYTES_ENV_VAR) != 0) {
+                slabBytes = (size_t)atoll(getenv(SLAB_BYTES_ENV_VAR));
+            }
+            COCL_PRINT(cout << "slab allocator enabled, slabBytes=" << slabBytes << endl);
+            slabAllocator.reset(new SlabAllocator(this, slabBytes));
+        }
+        if(getenv(KERNEL_CACHE_DIR_ENV_VAR) != 0 && string(getenv(KERNEL_CACHE_DIR_ENV_VAR)) != "") {
+            size_t maxBytes = KERNEL_CACHE_DEFAULT_MAX_BYTES;
+            if(getenv(KERNEL_CACHE_MAX_BYTES_ENV_VAR) != 0) {
+                maxBytes = (size_t)atoll(getenv(KERNEL_CACHE_MAX_BYTES_ENV_VAR));
+            }
+            COCL_PRINT(cout << "kernel disk cache enabled, dir=" << getenv(KERNEL_CACHE_DIR_ENV_VAR) << " maxBytes=" << maxBytes << endl);
+            kernelDiskCache.reset(new KernelDiskCache(
+                getenv(KERNEL_CACHE_DIR_ENV_VAR), maxBytes, KernelDiskCache::getDeviceIdentity(coclDevice->deviceId)));
+        }
+        if(getenv(SPECIALIZE_ALIASING_ENV_VAR) != 0 && string(getenv(SPECIALIZE_ALIASING_ENV_VAR)) == "1") {
+            specializeAliasing = SpecializeAliasingAlways;
+        } else if(getenv(SPECIALIZE_ALIASING_ENV_VAR) != 0 && string(getenv(SPECIALIZE_ALIASING_ENV_VAR)) == "0") {
+            specializeAliasing = SpecializeAliasingNever;
+        }
+        std::lock_guard<std::mutex> allContextsLock(allContextsMutex);
+        allContexts.insert(this);
     }
     Context::~Context() {
         COCL_PRINT(cout << "~Context() " << this << endl);
+        {
+            std::lock_guard<std::mutex> allContextsLock(allContextsMutex);
+            allContexts.erase(this);
+        }
+        // needs the mutex, and the cl, so get rid of it before those go away
+        cachingAllocator.reset();
+        slabAllocator.reset();
+        fillEngine.reset();
+        memcpyBatchEngine.reset();
+    }
+
+    void Context::synchronize() {
+        cl_int err = clFinish(default_stream.get()->clqueue->queue);
+        EasyCL::checkError(err);
+        synchronizeCreatedStreams();
+    }
+
+    void Context::synchronizeCreatedStreams() {
+        std::vector<CoclStream *> toFinish;
+        {
+            ContextMutex contextMutex(this);
+            toFinish.insert(toFinish.end(), streams.begin(), streams.end());
+        }
+        for(auto it=toFinish.begin(); it != toFinish.end(); it++) {
+            cl_int err = clFinish((*it)->clqueue->queue);
+            EasyCL::checkError(err);
+        }
+    }
+
+    void Context::recordReleaseMarkers(std::vector<cl_event> &markers) {
+        std::vector<CoclStream *> toMark;
+        toMark.push_back(default_stream.get());
+        {
+            ContextMutex contextMutex(this);
+            toMark.insert(toMark.end(), streams.begin(), streams.end());
+        }
+        for(auto it=toMark.begin(); it != toMark.end(); it++) {
+            cl_command_queue queue = (*it)->clqueue->queue;
+            cl_event marker;
+            cl_int err = clEnqueueMarkerWithWaitList(queue, 0, 0, &marker);
+            EasyCL::checkError(err);
+            // so the marker completes even if nothing else flushes this queue
+            err = clFlush(queue);
+            EasyCL::checkError(err);
+            markers.push_back(marker);
+        }
+    }
+
+    void Context::waitForReleaseMarkers(std::vector<cl_event> &markers) {
+        releaseCompletedMarkers(markers);
+        if(markers.size() == 0) {
+            return;
+        }
+        std::vector<cl_command_queue> markerQueues(markers.size());
+        for(size_t i = 0; i < markers.size(); i++) {
+            cl_int err = clGetEventInfo(markers[i], CL_EVENT_COMMAND_QUEUE, sizeof(cl_command_queue), &markerQueues[i], 0);
+            EasyCL::checkError(err);
+        }
+        std::vector<CoclStream *> toWait;
+        toWait.push_back(default_stream.get());
+        {
+            ContextMutex contextMutex(this);
+            toWait.insert(toWait.end(), streams.begin(), streams.end());
+        }
+        for(auto it=toWait.begin(); it != toWait.end(); it++) {
+            cl_command_queue queue = (*it)->clqueue->queue;
+            std::vector<cl_event> waitList;
+            for(size_t i = 0; i < markers.size(); i++) {
+                if(markerQueues[i] != queue) {
+                    waitList.push_back(markers[i]);
+                }
+            }
+            if(waitList.size() > 0) {
+                cl_int err = clEnqueueBarrierWithWaitList(queue, waitList.size(), &waitList[0], 0);
+                EasyCL::checkError(err);
+            }
+        }
+        for(auto it=markers.begin(); it != markers.end(); it++) {
+            cl_int err = clReleaseEvent(*it);
+            EasyCL::checkError(err);
+        }
+        markers.clear();
+    }
+
+    void Context::releaseCompletedMarkers(std::vector<cl_event> &markers) {
+        size_t numKept = 0;
+        for(size_t i = 0; i < markers.size(); i++) {
+            cl_int status;
+            cl_int err = clGetEventInfo(markers[i], CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &status, 0);
+            EasyCL::checkError(err);
+            // negative means the queue hit an error, so it wont run anything after it either
+            if(status <= CL_COMPLETE) {
+                err = clReleaseEvent(markers[i]);
+                EasyCL::checkError(err);
+            } else {
+                markers[numKept++] = markers[i];
+            }
+        }
+        markers.resize(numKept);
+    }
+
+    void Context::releaseStreamKernels(CoclStream *stream) {
+        std::lock_guard<std::mutex> lock(kernelCacheMutex);
+        for(auto it=kernelCacheById.begin(); it != kernelCacheById.end(); it++) {
+            it->second.kernelByStream.erase(stream);
+        }
     }
 
     ContextMutex::ContextMutex(Context *context) : context(context) {
@@ -69,10 +228,25 @@ namespace cocl {
         if(currentContext == 0) {
             COCL_PRINT(cout << "creating default context" << endl);
             currentContext = new Context(currentGpuOrdinal);
+            warmupKernelsIfRequested(currentContext);
         }
         return currentContext;
     }
 
+    size_t getDeviceBytesForAllContexts(int gpuOrdinal) {
+        size_t deviceBytes = 0;
+        std::lock_guard<std::mutex> allContextsLock(allContextsMutex);
+        for(auto it=allContexts.begin(); it != allContexts.end(); it++) {
+            Context *context = *it;
+            if(context->gpuOrdinal != gpuOrdinal) {
+                continue;
+            }
+            ContextMutex contextMutex(context);
+            deviceBytes += context->memoryStats.deviceBytes;
+        }
+        return deviceBytes;
+    }
+
     thread_local ThreadVars *threadVars = nullptr;
     ThreadVars *getThreadVars() {
         if(threadVars == nullptr) {
@@ -91,8 +265,7 @@ size_t cuCtxGetDevice(CUdevice *pdevice) {
 size_t cuCtxSynchronize(void) {
     COCL_PRINT(cout << "cuCtxSynchronize" << endl);
     ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
-    cl->finish();
+    v->getContext()->synchronize();
     return 0;
 }
 
@@ -118,6 +291,7 @@ size_t cuCtxCreate (char **_ppContext, unsigned int flags, long long device) {
     Context *newContext = new Context(device);
     ThreadVars *threadVars = getThreadVars();
     threadVars->currentContext = newContext;
+    warmupKernelsIfRequested(newContext);
     COCL_PRINT(cout << "cuCtxCreate_v2 new context=" << (void *)newContext << endl);
     *ppContext = newContext;
     return 0;
@@ -1,6 +1,7 @@
 #include "cocl/cocl_device.h"
 
 #include "cocl/cocl_context.h"
+#include "cocl/cocl_caching_allocator.h"
 
 #include "EasyCL/EasyCL.h"
 
@@ -187,12 +188,20 @@ size_t cudaSetDevice (int gpuOrdinal) {
 }
 
 size_t cudaDeviceReset() {
-    cout << "ignoring cudaDeviceReset for now" << endl;
+    // we dont tear down the context, but we do give any memory held by the caching allocator
+    // back to the driver
+    ThreadVars *v = getThreadVars();
+    if(v->currentContext != 0 && v->currentContext->cachingAllocator) {
+        COCL_PRINT(cout << "cudaDeviceReset trimming caching allocator" << endl);
+        v->currentContext->cachingAllocator->trim();
+    }
     return 0;
     //throw runtime_error("Not yet implemented, please raise an issue at https://github.com/hughperkins/Coriander/issues");
 }
 
 size_t cudaDeviceSynchronize() {
-    cout << "ignoring cudaDeviceSynchronize for now" << endl;
+    // kernel launches dont block, so this really has to wait
+    ThreadVars *v = getThreadVars();
+    v->getContext()->synchronize();
     return 0;
 }
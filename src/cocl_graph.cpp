@@ -0,0 +1,392 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_graph.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_streams.h"
+#include "cocl/cocl_memory.h"
+#include "cocl/hostside_opencl_funcs.h"
+#include "cocl/fill_buffer.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+#undef COCL_PRINT
+#ifdef COCL_SPAM_KERNELLAUNCH
+#define COCL_PRINT(x) std::cout << "[LAUNCH] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+namespace cocl {
+
+static CoclStream *getStream(char *stream) {
+    if(stream == 0) {
+        return getThreadVars()->getContext()->default_stream.get();
+    }
+    return (CoclStream *)stream;
+}
+
+CoclGraph *getCapturingGraph(char *stream) {
+    return getStream(stream)->capturingGraph;
+}
+
+static GraphKernelParam makeParam(size_t size, const void *value) {
+    GraphKernelParam param;
+    param.size = size;
+    param.isLocal = value == 0;
+    param.value = 0;
+    if(value != 0) {
+        if(size > sizeof(param.value)) {
+            cout << "graph capture: kernel param of " << size << " bytes is too big" << endl;
+            throw runtime_error("graph capture: kernel param too big");
+        }
+        memcpy(&param.value, value, size);
+    }
+    return param;
+}
+
+static Memory *findMemoryOrThrow(const char *ptr, const char *what) {
+    Memory *memory = findMemory(ptr);
+    if(memory == 0) {
+        cout << "graph capture: couldnt find memory for " << what << " " << (const void *)ptr << endl;
+        throw runtime_error(string("graph capture: couldnt find memory for ") + what);
+    }
+    return memory;
+}
+
+void captureKernel(CoclGraph *graph, CLKernel *kernel, LaunchConfiguration &launchConfiguration,
+        const size_t *global, size_t scratchBytes, size_t dynamicSharedBytes, bool offsets32bit) {
+    GraphNode node;
+    node.type = GraphNode::NT_Kernel;
+    node.kernel = kernel;
+    node.offsets32bit = offsets32bit;
+    for(int i = 0; i < 3; i++) {
+        node.global[i] = global[i];
+        node.block[i] = launchConfiguration.block[i];
+    }
+    // same order as kernelGo: each clmem and its vmem offset, then the args, then the scratch, and
+    // dynamic shared memory
+    int numClmems = launchConfiguration.clmems.size();
+    for(int i = 0; i < numClmems; i++) {
+        node.params.push_back(makeParam(sizeof(cl_mem), &launchConfiguration.clmems[i]));
+        if(offsets32bit) {
+            uint32_t vmemloc = (uint32_t)launchConfiguration.vmemlocs[i];
+            node.params.push_back(makeParam(sizeof(vmemloc), &vmemloc));
+        } else {
+            int64_t vmemloc = (int64_t)launchConfiguration.vmemlocs[i];
+            node.params.push_back(makeParam(sizeof(vmemloc), &vmemloc));
+        }
+    }
+    const LaunchArgs &args = launchConfiguration.args;
+    for(int i = 0; i < args.size(); i++) {
+        node.params.push_back(makeParam(args.getSize(i), args.getValue(i)));
+    }
+    if(scratchBytes != 0) {
+        node.params.push_back(makeParam(scratchBytes, 0));
+    }
+    if(dynamicSharedBytes != 0) {
+        node.params.push_back(makeParam(dynamicSharedBytes, 0));
+    }
+    for(auto it=launchConfiguration.pointerArgs.begin(); it != launchConfiguration.pointerArgs.end(); it++) {
+        GraphPointerArg pointerArg;
+        pointerArg.ptr = it->ptr;
+        pointerArg.clmemParam = it->clmemIndex * 2;
+        pointerArg.offsetParam = numClmems * 2 + it->argIndex;
+        node.pointerArgs.push_back(pointerArg);
+    }
+    graph->structBuffers.insert(graph->structBuffers.end(),
+        launchConfiguration.kernelArgsToBeReleased.begin(), launchConfiguration.kernelArgsToBeReleased.end());
+    launchConfiguration.kernelArgsToBeReleased.clear();
+    graph->nodes.push_back(node);
+    COCL_PRINT("captured kernel " << launchConfiguration.kernelName << " as node " << (graph->nodes.size() - 1));
+}
+
+void captureMemcpyHtoD(CoclGraph *graph, char *dst, const void *src, size_t bytes) {
+    Memory *dstMemory = findMemoryOrThrow(dst, "dst");
+    GraphNode node;
+    node.type = GraphNode::NT_MemcpyHtoD;
+    node.dst = dst;
+    node.src = (const char *)src;
+    node.dstClmem = dstMemory->clmem;
+    node.dstOffset = dstMemory->getOffset(dst);
+    node.bytes = bytes;
+    graph->nodes.push_back(node);
+}
+
+void captureMemcpyDtoH(CoclGraph *graph, void *dst, const char *src, size_t bytes) {
+    Memory *srcMemory = findMemoryOrThrow(src, "src");
+    GraphNode node;
+    node.type = GraphNode::NT_MemcpyDtoH;
+    node.dst = (char *)dst;
+    node.src = src;
+    node.srcClmem = srcMemory->clmem;
+    node.srcOffset = srcMemory->getOffset(src);
+    node.bytes = bytes;
+    graph->nodes.push_back(node);
+}
+
+void captureMemcpyDtoD(CoclGraph *graph, char *dst, const char *src, size_t bytes) {
+    Memory *dstMemory = findMemoryOrThrow(dst, "dst");
+    Memory *srcMemory = findMemoryOrThrow(src, "src");
+    GraphNode node;
+    node.type = GraphNode::NT_MemcpyDtoD;
+    node.dst = dst;
+    node.src = src;
+    node.dstClmem = dstMemory->clmem;
+    node.dstOffset = dstMemory->getOffset(dst);
+    node.srcClmem = srcMemory->clmem;
+    node.srcOffset = srcMemory->getOffset(src);
+    node.bytes = bytes;
+    graph->nodes.push_back(node);
+}
+
+void captureMemset(CoclGraph *graph, char *dst, unsigned char value, size_t bytes) {
+    Memory *dstMemory = findMemoryOrThrow(dst, "dst");
+    GraphNode node;
+    node.type = GraphNode::NT_Memset;
+    node.dst = dst;
+    node.dstClmem = dstMemory->clmem;
+    node.dstOffset = dstMemory->getOffset(dst);
+    node.value = value;
+    node.bytes = bytes;
+    graph->nodes.push_back(node);
+}
+
+CoclGraph::~CoclGraph() {
+    for(auto it=structBuffers.begin(); it != structBuffers.end(); it++) {
+        clReleaseMemObject(*it);
+    }
+}
+
+static void setParams(StreamKernel *kernel, const GraphNode &node) {
+    std::lock_guard<std::mutex> lock(kernel->mu);
+    for(int i = 0; i < node.params.size(); i++) {
+        const GraphKernelParam &param = node.params[i];
+        kernel->setArg(i, param.size, param.isLocal ? 0 : &param.value);
+    }
+}
+
+CoclGraphExec::CoclGraphExec(CoclGraph *graph) :
+        nodes(graph->nodes),
+        structBuffers(graph->structBuffers) {
+    for(auto it=structBuffers.begin(); it != structBuffers.end(); it++) {
+        cl_int err = clRetainMemObject(*it);
+        EasyCL::checkError(err);
+    }
+    for(auto it=nodes.begin(); it != nodes.end(); it++) {
+        kernels.push_back(std::unique_ptr<StreamKernel>());
+        fills.push_back(std::unique_ptr<PreparedFill>());
+        if(it->type == GraphNode::NT_Memset) {
+            // resolved now, so launch doesnt go through the FillEngine's locks
+            PreparedFill *fill = new PreparedFill();
+            fills.back().reset(fill);
+            getFillEngine()->prepareFill(fill, it->dstClmem, it->value, it->dstOffset, it->bytes);
+        }
+        if(it->type != GraphNode::NT_Kernel) {
+            continue;
+        }
+        // our own cl_kernel per node, so the args stay set from one launch to the next
+        StreamKernel *kernel = new StreamKernel(it->kernel);
+        kernels.back().reset(kernel);
+        setParams(kernel, *it);
+    }
+}
+
+CoclGraphExec::~CoclGraphExec() {
+    kernels.clear();
+    fills.clear();
+    for(auto it=structBuffers.begin(); it != structBuffers.end(); it++) {
+        clReleaseMemObject(*it);
+    }
+}
+
+void CoclGraphExec::launch(cl_command_queue queue) {
+    cl_int err = CL_SUCCESS;
+    for(int i = 0; i < nodes.size(); i++) {
+        const GraphNode &node = nodes[i];
+        switch(node.type) {
+            case GraphNode::NT_Kernel:
+                err = clEnqueueNDRangeKernel(queue, kernels[i]->kernel, 3, 0, node.global, node.block, 0, 0, 0);
+                break;
+            case GraphNode::NT_MemcpyHtoD:
+                err = clEnqueueWriteBuffer(queue, node.dstClmem, CL_FALSE, node.dstOffset, node.bytes, node.src, 0, 0, 0);
+                break;
+            case GraphNode::NT_MemcpyDtoH:
+                err = clEnqueueReadBuffer(queue, node.srcClmem, CL_FALSE, node.srcOffset, node.bytes, node.dst, 0, 0, 0);
+                break;
+            case GraphNode::NT_MemcpyDtoD:
+                err = clEnqueueCopyBuffer(queue, node.srcClmem, node.dstClmem, node.srcOffset, node.dstOffset, node.bytes, 0, 0, 0);
+                break;
+            case GraphNode::NT_Memset:
+                fills[i]->enqueue(queue);
+                break;
+        }
+        if(err != CL_SUCCESS) {
+            cout << "cudaGraphLaunch: node " << i << " failed to enqueue" << endl;
+            EasyCL::checkError(err);
+        }
+    }
+    err = clFlush(queue);
+    EasyCL::checkError(err);
+}
+
+void CoclGraphExec::updatePointer(const char *oldPtr, const char *newPtr) {
+    if(oldPtr == 0) {
+        throw runtime_error("coclGraphExecUpdatePointer: old pointer should not be null");
+    }
+    Memory *newMemory = findMemory(newPtr);
+    cl_mem newClmem = newMemory == 0 ? 0 : newMemory->clmem;
+    size_t newOffset = newMemory == 0 ? 0 : newMemory->getOffset(newPtr);
+    // the vmem base of the whole clmem, which isnt newMemory's own fakePos if it's in a slab. same
+    // lookup as kernelGo
+    Memory *newClmemMemory = newClmem == 0 ? 0 : findMemoryByClmem(newClmem);
+    uint64_t newVmemloc = newClmemMemory == 0 ? 0 : newClmemMemory->fakePos;
+    for(int n = 0; n < nodes.size(); n++) {
+        GraphNode &node = nodes[n];
+        if(node.type != GraphNode::NT_Kernel) {
+            if(node.type != GraphNode::NT_MemcpyHtoD && node.src == oldPtr) {
+                if(newMemory == 0) {
+                    throw runtime_error("coclGraphExecUpdatePointer: couldnt find memory for new pointer");
+                }
+                node.src = newPtr;
+                node.srcClmem = newClmem;
+                node.srcOffset = newOffset;
+            }
+            if(node.type != GraphNode::NT_MemcpyDtoH && node.dst == oldPtr) {
+                if(newMemory == 0) {
+                    throw runtime_error("coclGraphExecUpdatePointer: couldnt find memory for new pointer");
+                }
+                node.dst = (char *)newPtr;
+                node.dstClmem = newClmem;
+                node.dstOffset = newOffset;
+                if(node.type == GraphNode::NT_Memset) {
+                    getFillEngine()->prepareFill(fills[n].get(), node.dstClmem, node.value, node.dstOffset, node.bytes);
+                }
+            }
+            continue;
+        }
+        bool found = false;
+        for(auto it=node.pointerArgs.begin(); it != node.pointerArgs.end(); it++) {
+            if(it->ptr == oldPtr) {
+                found = true;
+            }
+        }
+        if(!found) {
+            continue;
+        }
+        // the generated kernel has one clmem param for all the args that shared a clmem at capture
+        // time, so any of those we arent patching have to stay in the same clmem as the new pointer
+        for(auto it=node.pointerArgs.begin(); it != node.pointerArgs.end(); it++) {
+            if(it->ptr == oldPtr) {
+                continue;
+            }
+            for(auto other=node.pointerArgs.begin(); other != node.pointerArgs.end(); other++) {
+                if(other->ptr == oldPtr && other->clmemParam == it->clmemParam &&
+                        (cl_mem)(uintptr_t)node.params[it->clmemParam].value != newClmem) {
+                    cout << "coclGraphExecUpdatePointer: " << (const void *)oldPtr << " shares a buffer with "
+                        << (const void *)it->ptr << " in node " << n << ", and " << (const void *)newPtr
+                        << " is in a different buffer" << endl;
+                    throw runtime_error("coclGraphExecUpdatePointer: new pointer must be in the same buffer as the args it shared a buffer with");
+                }
+            }
+        }
+        for(auto it=node.pointerArgs.begin(); it != node.pointerArgs.end(); it++) {
+            if(it->ptr != oldPtr) {
+                continue;
+            }
+            it->ptr = newPtr;
+            node.params[it->clmemParam] = makeParam(sizeof(cl_mem), &newClmem);
+            if(node.offsets32bit) {
+                uint32_t vmemloc = (uint32_t)newVmemloc;
+                uint32_t offset = (uint32_t)newOffset;
+                node.params[it->clmemParam + 1] = makeParam(sizeof(vmemloc), &vmemloc);
+                node.params[it->offsetParam] = makeParam(sizeof(offset), &offset);
+            } else {
+                int64_t vmemloc = (int64_t)newVmemloc;
+                int64_t offset = (int64_t)newOffset;
+                node.params[it->clmemParam + 1] = makeParam(sizeof(vmemloc), &vmemloc);
+                node.params[it->offsetParam] = makeParam(sizeof(offset), &offset);
+            }
+        }
+        // only the params that changed get set
+        setParams(kernels[n].get(), node);
+    }
+}
+
+} // namespace cocl
+
+size_t cudaStreamBeginCapture(char *stream, int mode) {
+    CoclStream *coclStream = getStream(stream);
+    COCL_PRINT("cudaStreamBeginCapture stream=" << (void *)coclStream);
+    if(coclStream->capturingGraph != 0) {
+        throw runtime_error("cudaStreamBeginCapture: stream is already capturing");
+    }
+    coclStream->capturingGraph = new CoclGraph();
+    return 0;
+}
+
+size_t cudaStreamEndCapture(char *stream, cudaGraph_t *pGraph) {
+    CoclStream *coclStream = getStream(stream);
+    if(coclStream->capturingGraph == 0) {
+        throw runtime_error("cudaStreamEndCapture: stream is not capturing");
+    }
+    COCL_PRINT("cudaStreamEndCapture stream=" << (void *)coclStream << " nodes=" << coclStream->capturingGraph->nodes.size());
+    *pGraph = coclStream->capturingGraph;
+    coclStream->capturingGraph = 0;
+    return 0;
+}
+
+size_t cudaStreamIsCapturing(char *stream, int *pCaptureStatus) {
+    *pCaptureStatus = getCapturingGraph(stream) != 0 ? cudaStreamCaptureStatusActive : cudaStreamCaptureStatusNone;
+    return 0;
+}
+
+size_t cudaGraphInstantiate(cudaGraphExec_t *pGraphExec, cudaGraph_t graph, void *pErrorNode, char *pLogBuffer, size_t bufferSize) {
+    *pGraphExec = new CoclGraphExec(graph);
+    return 0;
+}
+
+size_t cudaGraphLaunch(cudaGraphExec_t graphExec, char *stream) {
+    graphExec->launch(getStream(stream)->clqueue->queue);
+    return 0;
+}
+
+size_t cudaGraphExecDestroy(cudaGraphExec_t graphExec) {
+    delete graphExec;
+    return 0;
+}
+
+size_t cudaGraphDestroy(cudaGraph_t graph) {
+    delete graph;
+    return 0;
+}
+
+size_t cudaGraphGetNumNodes(cudaGraph_t graph, size_t *pNumNodes) {
+    *pNumNodes = graph->nodes.size();
+    return 0;
+}
+
+size_t coclGraphExecUpdatePointer(cudaGraphExec_t graphExec, const void *oldPtr, const void *newPtr) {
+    graphExec->updatePointer((const char *)oldPtr, (const char *)newPtr);
+    return 0;
+}
@@ -0,0 +1,285 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_kernel_disk_cache.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <utime.h>
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+#undef COCL_PRINT
+#ifdef COCL_SPAM_KERNELLAUNCH
+#define COCL_PRINT(x) std::cout << "[LAUNCH] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+// bump this if the entry format changes
+#define KERNEL_DISK_CACHE_MAGIC "cocl-kernel-cache-v1"
+#define KERNEL_DISK_CACHE_SUFFIX ".coclkernel"
+
+namespace cocl {
+
+static uint64_t fnv1a(const std::string &data, uint64_t hash) {
+    for(size_t i = 0; i < data.size(); i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static string toHex(uint64_t value) {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+    return buf;
+}
+
+static string getLibraryIdentity() {
+    // we dont have a version number to go on, so anything generated by a different build of the
+    // library counts as different
+    Dl_info info;
+    if(dladdr((void *)&fnv1a, &info) == 0 || info.dli_fname == 0) {
+        return "";
+    }
+    struct stat st;
+    if(stat(info.dli_fname, &st) != 0) {
+        return info.dli_fname;
+    }
+    ostringstream ss;
+    ss << info.dli_fname << " " << st.st_size << " " << st.st_mtime;
+    return ss.str();
+}
+
+KernelDiskCache::KernelDiskCache(std::string cacheDir, size_t maxBytes, std::string deviceIdentity) :
+        cacheDir(cacheDir), maxBytes(maxBytes), deviceIdentity(deviceIdentity + "\n" + getLibraryIdentity()),
+        numHits(0), numMisses(0), numStores(0) {
+    mkdir(cacheDir.c_str(), 0755); // ok if it's already there
+}
+
+std::string KernelDiskCache::makeKey(const std::string &devicellsourcecode, const std::string &kernelName,
+        int uniqueClmemCount, const std::vector<int> &clmemIndexByClmemArgIndex, bool offsets_32bit) const {
+    ostringstream ss;
+    ss << KERNEL_DISK_CACHE_MAGIC << "\n" << deviceIdentity << "\n" << kernelName << "\n"
+        << uniqueClmemCount << "\n" << offsets_32bit << "\n";
+    for(size_t i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
+        ss << clmemIndexByClmemArgIndex[i] << " ";
+    }
+    ss << "\n" << devicellsourcecode;
+    string keyData = ss.str();
+    // two 64-bit hashes, with different offset bases, so collisions arent something to worry about
+    return toHex(fnv1a(keyData, 14695981039346656037ULL)) + toHex(fnv1a(keyData, 0x6c62272e07bb0142ULL));
+}
+
+std::string KernelDiskCache::getEntryPath(const std::string &key) const {
+    return cacheDir + "/" + key + KERNEL_DISK_CACHE_SUFFIX;
+}
+
+static void writeBlob(ostream &f, const char *data, uint64_t size) {
+    f.write((const char *)&size, sizeof(size));
+    f.write(data, size);
+}
+
+static bool readBlob(const string &contents, size_t *pos, string *data) {
+    // checks the sizes against what's actually there, so truncated or corrupt entries just fail
+    uint64_t size = 0;
+    if(contents.size() - *pos < sizeof(size)) {
+        return false;
+    }
+    memcpy(&size, contents.data() + *pos, sizeof(size));
+    *pos += sizeof(size);
+    if(contents.size() - *pos < size) {
+        return false;
+    }
+    data->assign(contents, *pos, size);
+    *pos += size;
+    return true;
+}
+
+bool KernelDiskCache::load(const std::string &key, KernelDiskCacheEntry *entry) {
+    string path = getEntryPath(key);
+    ifstream f(path, ios_base::in | ios_base::binary);
+    if(!f) {
+        numMisses++;
+        return false;
+    }
+    ostringstream contentsSs;
+    contentsSs << f.rdbuf();
+    string contents = contentsSs.str();
+    size_t pos = 0;
+    string magic;
+    string kernelInfo;
+    string programBinary;
+    if(!readBlob(contents, &pos, &magic) || magic != KERNEL_DISK_CACHE_MAGIC ||
+            !readBlob(contents, &pos, &kernelInfo) || !readBlob(contents, &pos, &entry->clSourcecode) ||
+            !readBlob(contents, &pos, &programBinary)) {
+        cout << "Warning: ignoring unreadable kernel cache entry " << path << endl;
+        numMisses++;
+        return false;
+    }
+    istringstream kernelInfoSs(kernelInfo);
+    kernelInfoSs >> entry->kernelInfo.usesVmem >> entry->kernelInfo.usesScratch
+        >> entry->kernelInfo.usesDynamicShared >> entry->kernelInfo.numClmemArgs;
+    entry->programBinary.assign(programBinary.begin(), programBinary.end());
+    utime(path.c_str(), 0); // most recently used now, see evict
+    numHits++;
+    COCL_PRINT("kernel disk cache hit " << path);
+    return true;
+}
+
+void KernelDiskCache::store(const std::string &key, const KernelDiskCacheEntry &entry) {
+    string path = getEntryPath(key);
+    // the pid and counter keep processes, and contexts on identical devices, from writing the same
+    // temporary file
+    static std::atomic<int64_t> nextTempId(0);
+    string tempPath = path + ".tmp" + easycl::toString(getpid()) + "_" + easycl::toString(nextTempId++);
+    {
+        ofstream f(tempPath, ios_base::out | ios_base::binary | ios_base::trunc);
+        ostringstream kernelInfo;
+        kernelInfo << entry.kernelInfo.usesVmem << " " << entry.kernelInfo.usesScratch << " "
+            << entry.kernelInfo.usesDynamicShared << " " << entry.kernelInfo.numClmemArgs;
+        writeBlob(f, KERNEL_DISK_CACHE_MAGIC, strlen(KERNEL_DISK_CACHE_MAGIC));
+        writeBlob(f, kernelInfo.str().c_str(), kernelInfo.str().size());
+        writeBlob(f, entry.clSourcecode.c_str(), entry.clSourcecode.size());
+        writeBlob(f, (const char *)entry.programBinary.data(), entry.programBinary.size());
+        f.close();
+        if(!f) {
+            cout << "Warning: failed to write kernel cache entry " << tempPath << endl;
+            unlink(tempPath.c_str());
+            return;
+        }
+    }
+    if(rename(tempPath.c_str(), path.c_str()) != 0) {
+        cout << "Warning: failed to rename kernel cache entry " << tempPath << " to " << path << endl;
+        unlink(tempPath.c_str());
+        return;
+    }
+    numStores++;
+    COCL_PRINT("kernel disk cache stored " << path);
+    evict();
+}
+
+void KernelDiskCache::evict() {
+    class CachedFile {
+    public:
+        string path;
+        size_t bytes;
+        time_t lastUsed;
+    };
+    vector<CachedFile> files;
+    size_t totalBytes = 0;
+    DIR *dir = opendir(cacheDir.c_str());
+    if(dir == 0) {
+        return;
+    }
+    const size_t suffixLen = strlen(KERNEL_DISK_CACHE_SUFFIX);
+    while(struct dirent *dirEntry = readdir(dir)) {
+        string name = dirEntry->d_name;
+        if(name.size() <= suffixLen || name.compare(name.size() - suffixLen, suffixLen, KERNEL_DISK_CACHE_SUFFIX) != 0) {
+            continue;
+        }
+        CachedFile file;
+        file.path = cacheDir + "/" + name;
+        struct stat st;
+        if(stat(file.path.c_str(), &st) != 0) {
+            continue;
+        }
+        file.bytes = st.st_size;
+        file.lastUsed = st.st_mtime;
+        files.push_back(file);
+        totalBytes += file.bytes;
+    }
+    closedir(dir);
+    if(totalBytes <= maxBytes) {
+        return;
+    }
+    sort(files.begin(), files.end(), [](const CachedFile &a, const CachedFile &b) {
+        return a.lastUsed < b.lastUsed;
+    });
+    for(auto it = files.begin(); it != files.end() && totalBytes > maxBytes; it++) {
+        // another process might have got there first, which is fine
+        unlink(it->path.c_str());
+        totalBytes -= it->bytes;
+        COCL_PRINT("kernel disk cache evicted " << it->path);
+    }
+}
+
+std::string KernelDiskCache::getDeviceIdentity(cl_device_id deviceId) {
+    return getDeviceInfoString(deviceId, CL_DEVICE_NAME) + "\n" +
+        getDeviceInfoString(deviceId, CL_DEVICE_VENDOR) + "\n" +
+        getDeviceInfoString(deviceId, CL_DEVICE_VERSION) + "\n" +
+        getDeviceInfoString(deviceId, CL_DRIVER_VERSION);
+}
+
+std::vector<unsigned char> KernelDiskCache::getProgramBinary(cl_program program) {
+    // EasyCL contexts only have the one device
+    size_t binarySize = 0;
+    cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binarySize, 0);
+    EasyCL::checkError(err);
+    std::vector<unsigned char> binary(binarySize);
+    unsigned char *binaries[1] = { binary.data() };
+    err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaries), binaries, 0);
+    EasyCL::checkError(err);
+    return binary;
+}
+
+easycl::CLKernel *KernelDiskCache::buildKernelFromBinary(easycl::EasyCL *cl, const std::vector<unsigned char> &binary,
+        std::string kernelName, std::string clSourcecode) {
+    if(binary.size() == 0) {
+        return 0;
+    }
+    const unsigned char *binaries[1] = { binary.data() };
+    size_t binarySize = binary.size();
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err = CL_SUCCESS;
+    cl_program program = clCreateProgramWithBinary(*cl->context, 1, &cl->device, &binarySize, binaries, &binaryStatus, &err);
+    if(err != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+        COCL_PRINT("clCreateProgramWithBinary failed err=" << err << " binaryStatus=" << binaryStatus);
+        if(err == CL_SUCCESS) {
+            clReleaseProgram(program);
+        }
+        return 0;
+    }
+    err = clBuildProgram(program, 1, &cl->device, "", 0, 0);
+    if(err != CL_SUCCESS) {
+        COCL_PRINT("clBuildProgram from binary failed err=" << err);
+        clReleaseProgram(program);
+        return 0;
+    }
+    cl_kernel kernel = clCreateKernel(program, kernelName.c_str(), &err);
+    if(err != CL_SUCCESS) {
+        COCL_PRINT("clCreateKernel from binary failed err=" << err);
+        clReleaseProgram(program);
+        return 0;
+    }
+    // the CLKernel releases the program and kernel, when it's deleted
+    return new CLKernel(cl, "__internal__", kernelName, clSourcecode, program, kernel);
+}
+
+} // namespace cocl
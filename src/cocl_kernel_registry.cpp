@@ -0,0 +1,68 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cocl/cocl_kernel_registry.h"
+
+#include "cocl/cocl_occupancy.h"
+
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+using namespace cocl;
+
+namespace cocl {
+
+static std::mutex registeredKernelsMutex;
+
+static std::map<const void *, RegisteredKernel> &getRegisteredKernels() {
+    // function-local, since registration runs from other modules' global constructors
+    static std::map<const void *, RegisteredKernel> registeredKernels;
+    return registeredKernels;
+}
+
+RegisteredKernel getRegisteredKernel(const void *func, const char *caller) {
+    std::lock_guard<std::mutex> lock(registeredKernelsMutex);
+    std::map<const void *, RegisteredKernel> &registeredKernels = getRegisteredKernels();
+    auto it = registeredKernels.find(func);
+    if(it == registeredKernels.end()) {
+        cout << caller << ": function " << func << " is not a kernel Coriander knows about" << endl;
+        cout << "Was the file that defines it compiled with cocl?" << endl;
+        throw runtime_error(string(caller) + ": unknown kernel function");
+    }
+    return it->second;
+}
+
+std::vector<RegisteredKernel> getAllRegisteredKernels() {
+    std::lock_guard<std::mutex> lock(registeredKernelsMutex);
+    std::vector<RegisteredKernel> kernels;
+    std::map<const void *, RegisteredKernel> &registeredKernels = getRegisteredKernels();
+    for(auto it = registeredKernels.begin(); it != registeredKernels.end(); it++) {
+        kernels.push_back(it->second);
+    }
+    return kernels;
+}
+
+} // namespace cocl
+
+void coclRegisterKernel(const char *hostFunction, int32_t *kernelIdSlot, const char *kernelName, const char *devicellsourcecode) {
+    std::lock_guard<std::mutex> lock(registeredKernelsMutex);
+    RegisteredKernel &registered = getRegisteredKernels()[(const void *)hostFunction];
+    registered.kernelIdSlot = kernelIdSlot;
+    registered.kernelName = kernelName;
+    registered.devicellsourcecode = devicellsourcecode;
+}
@@ -0,0 +1,211 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_memcpy_batch.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_device.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace easycl;
+
+namespace cocl {
+
+static std::string get_copy_batch_sourcecode();
+
+// copies are tiny, so small workgroups, and a grid that just needs to cover the compute units
+static const size_t COPY_WORKGROUP_SIZE = 64;
+static const int WORKGROUPS_PER_COMPUTE_UNIT = 8;
+
+MemcpyBatchEngine::MemcpyBatchEngine(Context *context) :
+        context(context) {
+    EasyCL *cl = context->getCl();
+    cl_device_id deviceId = cl->device;
+
+    workgroupSize = COPY_WORKGROUP_SIZE;
+    size_t maxWorkgroupSize = getDeviceInfoInt64(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    if(workgroupSize > maxWorkgroupSize) {
+        workgroupSize = maxWorkgroupSize;
+    }
+    maxWorkgroups = getDeviceInfoInt(deviceId, CL_DEVICE_MAX_COMPUTE_UNITS) * WORKGROUPS_PER_COMPUTE_UNIT;
+
+    std::string source = get_copy_batch_sourcecode();
+    const char *sourceChars = source.c_str();
+    size_t sourceLength = source.size();
+    cl_int err;
+    program = clCreateProgramWithSource(*cl->context, 1, &sourceChars, &sourceLength, &err);
+    EasyCL::checkError(err);
+    err = clBuildProgram(program, 1, &deviceId, "", 0, 0);
+    if(err != CL_SUCCESS) {
+        char buildLog[10240];
+        buildLog[0] = 0;
+        clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, 0);
+        cout << "MemcpyBatchEngine failed to build copy kernel:" << endl;
+        cout << buildLog << endl;
+        EasyCL::checkError(err);
+    }
+    copyBatchKernel = clCreateKernel(program, "copy_batch", &err);
+    EasyCL::checkError(err);
+}
+
+MemcpyBatchEngine::~MemcpyBatchEngine() {
+    clReleaseKernel(copyBatchKernel);
+    clReleaseProgram(program);
+}
+
+static bool samePair(const ResolvedCopy &a, const ResolvedCopy &b) {
+    return a.srcClmem == b.srcClmem && a.dstClmem == b.dstClmem;
+}
+
+void MemcpyBatchEngine::coalesce(std::vector<ResolvedCopy> &copies) {
+    std::sort(copies.begin(), copies.end(), [](const ResolvedCopy &a, const ResolvedCopy &b) {
+        if(a.srcClmem != b.srcClmem) {
+            return a.srcClmem < b.srcClmem;
+        }
+        if(a.dstClmem != b.dstClmem) {
+            return a.dstClmem < b.dstClmem;
+        }
+        return a.srcOffset < b.srcOffset;
+    });
+    size_t numMerged = 0;
+    for(size_t i = 0; i < copies.size(); i++) {
+        const ResolvedCopy &copy = copies[i];
+        if(copy.bytes == 0) {
+            continue;
+        }
+        if(numMerged > 0) {
+            ResolvedCopy &prev = copies[numMerged - 1];
+            if(samePair(prev, copy) && prev.srcOffset + prev.bytes == copy.srcOffset
+                    && prev.dstOffset + prev.bytes == copy.dstOffset) {
+                prev.bytes += copy.bytes;
+                continue;
+            }
+        }
+        copies[numMerged++] = copy;
+    }
+    copies.resize(numMerged);
+}
+
+void MemcpyBatchEngine::enqueue(cl_command_queue queue, std::vector<ResolvedCopy> &copies) {
+    coalesce(copies);
+    cl_int err;
+    std::vector<cl_ulong> descriptors;
+    size_t groupStart = 0;
+    while(groupStart < copies.size()) {
+        size_t groupEnd = groupStart + 1;
+        while(groupEnd < copies.size() && samePair(copies[groupStart], copies[groupEnd])) {
+            groupEnd++;
+        }
+        descriptors.clear();
+        for(size_t i = groupStart; i < groupEnd; i++) {
+            const ResolvedCopy &copy = copies[i];
+            if(copy.bytes >= minCopyBufferBytes) {
+                err = clEnqueueCopyBuffer(queue, copy.srcClmem, copy.dstClmem, copy.srcOffset, copy.dstOffset,
+                    copy.bytes, 0, 0, 0);
+                EasyCL::checkError(err);
+            } else {
+                descriptors.push_back(copy.srcOffset);
+                descriptors.push_back(copy.dstOffset);
+                descriptors.push_back(copy.bytes);
+            }
+        }
+        if(descriptors.size() == 3) {
+            // a kernel launch plus a descriptor upload isnt going to beat one copy command
+            err = clEnqueueCopyBuffer(queue, copies[groupStart].srcClmem, copies[groupStart].dstClmem,
+                descriptors[0], descriptors[1], descriptors[2], 0, 0, 0);
+            EasyCL::checkError(err);
+        } else if(descriptors.size() > 0) {
+            runCopyBatchKernel(queue, copies[groupStart].srcClmem, copies[groupStart].dstClmem, descriptors);
+        }
+        groupStart = groupEnd;
+    }
+    err = clFlush(queue);
+    EasyCL::checkError(err);
+}
+
+void MemcpyBatchEngine::runCopyBatchKernel(cl_command_queue queue, cl_mem srcClmem, cl_mem dstClmem,
+        const std::vector<cl_ulong> &descriptors) {
+    cl_uint numCopies = (cl_uint)(descriptors.size() / 3);
+    size_t numWorkgroups = numCopies < maxWorkgroups ? numCopies : maxWorkgroups;
+    size_t globalSize = numWorkgroups * workgroupSize;
+
+    // the driver copies the descriptors at create time, and keeps the buffer alive until the
+    // kernel is done with it, so we can release it straight after enqueueing
+    cl_int err;
+    cl_mem descriptorsClmem = clCreateBuffer(*context->getCl()->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+        descriptors.size() * sizeof(cl_ulong), (void *)&descriptors[0], &err);
+    EasyCL::checkError(err);
+
+    {
+        std::lock_guard<std::mutex> lock(mu);
+        err = clSetKernelArg(copyBatchKernel, 0, sizeof(cl_mem), &srcClmem);
+        EasyCL::checkError(err);
+        err = clSetKernelArg(copyBatchKernel, 1, sizeof(cl_mem), &dstClmem);
+        EasyCL::checkError(err);
+        err = clSetKernelArg(copyBatchKernel, 2, sizeof(cl_mem), &descriptorsClmem);
+        EasyCL::checkError(err);
+        err = clSetKernelArg(copyBatchKernel, 3, sizeof(cl_uint), &numCopies);
+        EasyCL::checkError(err);
+        err = clEnqueueNDRangeKernel(queue, copyBatchKernel, 1, 0, &globalSize, &workgroupSize, 0, 0, 0);
+        EasyCL::checkError(err);
+    }
+    err = clReleaseMemObject(descriptorsClmem);
+    EasyCL::checkError(err);
+}
+
+MemcpyBatchEngine *getMemcpyBatchEngine() {
+    ThreadVars *v = getThreadVars();
+    Context *context = v->getContext();
+    ContextMutex contextMutex(context);
+    if(!context->memcpyBatchEngine) {
+        context->memcpyBatchEngine.reset(new MemcpyBatchEngine(context));
+    }
+    return context->memcpyBatchEngine.get();
+}
+
+std::string get_copy_batch_sourcecode() {
+    return R"(
+// each workgroup takes one copy at a time. descriptors are (srcOffset, dstOffset, bytes) triples.
+// src and dst may well be the same buffer, so no restrict
+kernel void copy_batch(global const unsigned char *src, global unsigned char *dst,
+        global const ulong *descriptors, const uint numCopies) {
+    for(uint c = get_group_id(0); c < numCopies; c += get_num_groups(0)) {
+        ulong srcOffset = descriptors[c * 3];
+        ulong dstOffset = descriptors[c * 3 + 1];
+        ulong bytes = descriptors[c * 3 + 2];
+        if(((srcOffset | dstOffset | bytes) & 15) == 0) {
+            global const uint4 *src4 = (global const uint4 *)(src + srcOffset);
+            global uint4 *dst4 = (global uint4 *)(dst + dstOffset);
+            ulong count = bytes >> 4;
+            for(ulong i = get_local_id(0); i < count; i += get_local_size(0)) {
+                dst4[i] = src4[i];
+            }
+        } else {
+            for(ulong i = get_local_id(0); i < bytes; i += get_local_size(0)) {
+                dst[dstOffset + i] = src[srcOffset + i];
+            }
+        }
+    }
+}
+)";
+}
+
+} // namespace cocl
@@ -18,14 +18,21 @@
 #include "cocl/cocl_streams.h"
 #include "cocl/cocl_context.h"
 #include "cocl/cocl_device.h"
+#include "cocl/cocl_caching_allocator.h"
+#include "cocl/cocl_slab_allocator.h"
 
 #include "cocl/fill_buffer.h"
+#include "cocl/cocl_memcpy_batch.h"
+#include "cocl/cocl_graph.h"
 
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <map>
 #include <set>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
 
 #include "EasyCL/EasyCL.h"
 
@@ -44,17 +51,51 @@ using namespace easycl;
 #endif
 
 namespace cocl {
-    // we should index these, but a set is ok-ish for now. maybe
-
-    Memory::Memory(cl_mem clmem, size_t bytes) :
-            clmem(clmem), bytes(bytes) {
+    Memory::Memory(cl_mem clmem, size_t bytes, bool isSlab) :
+            clmem(clmem), bytes(bytes), isSlab(isSlab) {
         ThreadVars *v = getThreadVars();
         fakePos = v->getContext()->nextAllocPos;
         // we should align it actually.  on 128-bytes?
         fakePos = ((fakePos + 127) / 128) * 128;
         v->getContext()->nextAllocPos = fakePos + bytes;
-        v->getContext()->memoryByAllocPos[fakePos] = this;
-        v->getContext()->memories.insert(this);
+        addToIndex(v->getContext());
+        MemoryStats &stats = v->getContext()->memoryStats;
+        stats.deviceBytes += bytes;
+        if(stats.deviceBytes > stats.peakDeviceBytes) {
+            stats.peakDeviceBytes = stats.deviceBytes;
+        }
+    }
+
+    Memory::Memory(Memory *slab, size_t slabOffset, size_t bytes) :
+            clmem(slab->clmem), bytes(bytes), slab(slab), slabOffset(slabOffset) {
+        ThreadVars *v = getThreadVars();
+        fakePos = slab->fakePos + slabOffset;
+        // each suballocation holds a reference on the slab clmem, which our destructor releases
+        cl_int err = clRetainMemObject(clmem);
+        EasyCL::checkError(err);
+        addToIndex(v->getContext());
+    }
+
+    void Memory::addToIndex(Context *context) {
+        if(!isSlab) {
+            context->memoryByAllocPos[fakePos] = this;
+            context->memories.insert(this);
+        }
+        if(slab == 0) {
+            context->memoryByClmem[clmem] = this;
+        }
+    }
+
+    void Memory::removeFromIndex(Context *context) {
+        auto posIt = context->memoryByAllocPos.find(fakePos);
+        if(posIt != context->memoryByAllocPos.end() && posIt->second == this) {
+            context->memoryByAllocPos.erase(posIt);
+        }
+        auto clmemIt = context->memoryByClmem.find(clmem);
+        if(clmemIt != context->memoryByClmem.end() && clmemIt->second == this) {
+            context->memoryByClmem.erase(clmemIt);
+        }
+        context->memories.erase(this);
     }
 
     Memory *Memory::newDeviceAlloc(size_t bytes) {
@@ -70,57 +111,379 @@ namespace cocl {
         return memory;
     }
 
+    Memory *Memory::newSlab(size_t bytes) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        EasyCL *cl = v->getContext()->getCl();
+        cl_int err;
+        cl_mem clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, bytes,
+                                               NULL, &err);
+        EasyCL::checkError(err);
+        COCL_PRINT("newSlab bytes=" << bytes);
+        return new Memory(clmem, bytes, true);
+    }
+
+    Memory *Memory::newSuballocation(Memory *slab, size_t slabOffset, size_t bytes) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        return new Memory(slab, slabOffset, bytes);
+    }
+
     Memory::~Memory() {
         ThreadVars *v = getThreadVars();
-        v->getContext()->memoryByAllocPos.erase(fakePos);
-        v->getContext()->memories.erase(this);
+        Context *context = v->getContext();
+        {
+            ContextMutex contextMutex(context);
+            removeFromIndex(context);
+            if(slab == 0) {
+                context->memoryStats.deviceBytes -= bytes;
+            }
+        }
+        for(auto it=releaseMarkers.begin(); it != releaseMarkers.end(); it++) {
+            cl_int err = clReleaseEvent(*it);
+            context->getCl()->checkError(err);
+        }
         cl_int err = clReleaseMemObject(clmem);
-        v->getContext()->getCl()->checkError(err);
-        // TODO: should remove from map and set too
+        context->getCl()->checkError(err);
     }
 
     Memory *findMemory(const char *passedInAsCharStar) {
         ThreadVars *v = getThreadVars();
         Context *context = v->getContext();
         ContextMutex contextMutex(context);
-        size_t pos = (size_t)passedInAsCharStar;
-        for(auto it=v->getContext()->memories.begin(), e=v->getContext()->memories.end(); it != e; it++) {
-            Memory *memory = *it;
-            if(pos >= memory->fakePos && pos < memory->fakePos + memory->bytes) {
-                return memory;
-            }
+        return findMemoryLocked(context, passedInAsCharStar);
+    }
+
+    Memory *findMemoryLocked(Context *context, const char *passedInAsCharStar) {
+        // memoryByAllocPos is ordered by fakePos, and allocations dont overlap, so the only
+        // candidate is the last allocation starting at or before pos
+        long long pos = (long long)passedInAsCharStar;
+        auto it = context->memoryByAllocPos.upper_bound(pos);
+        if(it == context->memoryByAllocPos.begin()) {
+            return 0;
+        }
+        it--;
+        Memory *memory = it->second;
+        if((size_t)pos < memory->fakePos + memory->bytes) {
+            return memory;
         }
         return 0;
     }
 
-    Memory *findMemoryByClmem(cl_mem clmem) {
+    Memory *allocateDeviceMemory(size_t bytes) {
         ThreadVars *v = getThreadVars();
         Context *context = v->getContext();
+        Memory *memory = 0;
+        if(context->slabAllocator) {
+            memory = context->slabAllocator->allocate(bytes);
+        } else if(context->cachingAllocator) {
+            memory = context->cachingAllocator->allocate(bytes);
+        } else {
+            memory = Memory::newDeviceAlloc(bytes);
+        }
+        memory->requestedBytes = bytes;
         ContextMutex contextMutex(context);
+        MemoryStats &stats = context->memoryStats;
+        stats.allocatedBytes += bytes;
+        if(stats.allocatedBytes > stats.peakAllocatedBytes) {
+            stats.peakAllocatedBytes = stats.allocatedBytes;
+        }
+        stats.numAllocations++;
+        if(stats.numAllocations > stats.peakNumAllocations) {
+            stats.peakNumAllocations = stats.numAllocations;
+        }
+        stats.totalAllocations++;
+        stats.histogram[MemoryStats::getHistogramBin(bytes)]++;
+        return memory;
+    }
 
-        for(auto it=v->getContext()->memories.begin(), e=v->getContext()->memories.end(); it != e; it++) {
-            Memory *memory = *it;
-            if(clmem == memory->clmem) {
-                return memory;
+    void freeDeviceMemory(Memory *memory) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        {
+            ContextMutex contextMutex(context);
+            MemoryStats &stats = context->memoryStats;
+            stats.allocatedBytes -= memory->requestedBytes;
+            stats.numAllocations--;
+            stats.totalFrees++;
+            stats.histogram[MemoryStats::getHistogramBin(memory->requestedBytes)]--;
+        }
+        if(memory->slab != 0) {
+            context->slabAllocator->release(memory);
+            return;
+        }
+        if(context->cachingAllocator) {
+            context->cachingAllocator->release(memory);
+            return;
+        }
+        delete memory;
+    }
+
+    int MemoryStats::getHistogramBin(size_t bytes) {
+        int bin = 0;
+        while(bytes != 0 && bin < numHistogramBins - 1) {
+            bytes >>= 1;
+            bin++;
+        }
+        return bin;
+    }
+
+    std::string MemoryStats::toString() const {
+        std::ostringstream oss;
+        oss << "deviceBytes=" << deviceBytes << " peakDeviceBytes=" << peakDeviceBytes
+            << " allocatedBytes=" << allocatedBytes << " peakAllocatedBytes=" << peakAllocatedBytes
+            << " reservedBytes=" << reservedBytes << " numAllocations=" << numAllocations
+            << " peakNumAllocations=" << peakNumAllocations << " totalAllocations=" << totalAllocations
+            << " totalFrees=" << totalFrees << " largestFreeBlockBytes=" << largestFreeBlockBytes
+            << " fragmentation=" << fragmentation;
+        // only the non-empty bins, keyed on the bin's upper bound
+        for(int bin = 0; bin < numHistogramBins; bin++) {
+            if(histogram[bin] != 0) {
+                oss << " histogram_lt" << ((unsigned long long)1 << bin) << "=" << histogram[bin];
             }
         }
-        return 0;
+        return oss.str();
+    }
+
+    MemoryStats getMemoryStats() {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        MemoryStats stats = context->memoryStats;
+        stats.reservedBytes = stats.deviceBytes - stats.allocatedBytes;
+        if(context->slabAllocator) {
+            stats.largestFreeBlockBytes = context->slabAllocator->getLargestFreeBytes();
+        }
+        if(context->cachingAllocator) {
+            size_t largestCached = context->cachingAllocator->getLargestCachedBytes();
+            if(largestCached > stats.largestFreeBlockBytes) {
+                stats.largestFreeBlockBytes = largestCached;
+            }
+        }
+        if(stats.reservedBytes > 0) {
+            stats.fragmentation = 1.0 - (double)stats.largestFreeBlockBytes / (double)stats.reservedBytes;
+        }
+        return stats;
+    }
+
+    Memory *findMemoryByClmem(cl_mem clmem) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        auto it = context->memoryByClmem.find(clmem);
+        if(it == context->memoryByClmem.end()) {
+            return 0;
+        }
+        return it->second;
     }
 
     size_t Memory::getOffset(const char *passedInAsCharStar) {
-        return (size_t)passedInAsCharStar - fakePos;
+        return (size_t)passedInAsCharStar - fakePos + slabOffset;
+    }
+
+    HostMemory::HostMemory(cl_mem clmem, char *hostPointer, char *mappedPointer, size_t bytes, bool isRegistered) :
+            clmem(clmem), hostPointer(hostPointer), mappedPointer(mappedPointer), bytes(bytes), isRegistered(isRegistered) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        context->hostMemoryByHostPos[(long long)hostPointer] = this;
+    }
+
+    static cl_mem createMappedHostBuffer(cl_mem_flags flags, void *hostPointer, size_t bytes, char **pMappedPointer) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        EasyCL *cl = context->getCl();
+        cl_int err;
+        cl_mem clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE | flags, bytes, hostPointer, &err);
+        EasyCL::checkError(err);
+        *pMappedPointer = (char *)clEnqueueMapBuffer(context->default_stream.get()->clqueue->queue, clmem, CL_TRUE,
+            CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, 0, 0, &err);
+        EasyCL::checkError(err);
+        return clmem;
+    }
+
+    HostMemory *HostMemory::newHostAlloc(size_t bytes) {
+        char *mappedPointer = 0;
+        cl_mem clmem = createMappedHostBuffer(CL_MEM_ALLOC_HOST_PTR, 0, bytes, &mappedPointer);
+        COCL_PRINT("HostMemory::newHostAlloc bytes=" << bytes << " hostPointer=" << (void *)mappedPointer);
+        return new HostMemory(clmem, mappedPointer, mappedPointer, bytes, false);
+    }
+
+    HostMemory *HostMemory::newHostRegister(void *hostPointer, size_t bytes) {
+        char *mappedPointer = 0;
+        cl_mem clmem = createMappedHostBuffer(CL_MEM_USE_HOST_PTR, hostPointer, bytes, &mappedPointer);
+        COCL_PRINT("HostMemory::newHostRegister bytes=" << bytes << " hostPointer=" << hostPointer << " mapped=" << (void *)mappedPointer);
+        // we keep handing out the callers pointer. drivers are allowed to map USE_HOST_PTR buffers
+        // elsewhere, but the caller's copy is the one that matters to them
+        return new HostMemory(clmem, (char *)hostPointer, mappedPointer, bytes, true);
+    }
+
+    HostMemory::~HostMemory() {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        {
+            ContextMutex contextMutex(context);
+            context->hostMemoryByHostPos.erase((long long)hostPointer);
+        }
+        // async copies on any stream might still be reading or writing it. cudaFreeHost and
+        // cudaHostUnregister synchronize the device in CUDA too
+        context->synchronize();
+        cl_command_queue queue = context->default_stream.get()->clqueue->queue;
+        cl_int err = clEnqueueUnmapMemObject(queue, clmem, mappedPointer, 0, 0, 0);
+        EasyCL::checkError(err);
+        // USE_HOST_PTR memory goes back to the caller, so make sure the driver is done with it
+        err = clFinish(queue);
+        EasyCL::checkError(err);
+        err = clReleaseMemObject(clmem);
+        EasyCL::checkError(err);
+    }
+
+    HostMemory *findHostMemory(const void *hostPointer) {
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        long long pos = (long long)hostPointer;
+        auto it = context->hostMemoryByHostPos.upper_bound(pos);
+        if(it == context->hostMemoryByHostPos.begin()) {
+            return 0;
+        }
+        it--;
+        HostMemory *hostMemory = it->second;
+        if(pos < it->first + (long long)hostMemory->bytes) {
+            return hostMemory;
+        }
+        return 0;
+    }
+
+    HostMemory *findHostMemory(const void *hostPointer, size_t bytes) {
+        HostMemory *hostMemory = findHostMemory(hostPointer);
+        if(hostMemory == 0) {
+            return 0;
+        }
+        size_t offset = (const char *)hostPointer - hostMemory->hostPointer;
+        if(bytes > hostMemory->bytes - offset) {
+            return 0;
+        }
+        return hostMemory;
+    }
+
+    static CLQueue *getQueueForStream(char *_queue) {
+        CoclStream *coclStream = (CoclStream *)_queue;
+        if(coclStream == 0) {
+            ThreadVars *v = getThreadVars();
+            coclStream = v->getContext()->default_stream.get();
+        }
+        return coclStream->clqueue;
+    }
+
+    static void releaseStagingBuffer(cl_event event, cl_int status, void *userdata) {
+        free(userdata);
+        clReleaseEvent(event);
+    }
+
+    // enqueues a host to device write, without blocking the host thread
+    // the caller is allowed to reuse pageable memory as soon as we return, so for pageable memory
+    // we take a copy first, and free that copy once the write event completes. pinned memory
+    // stays put until the caller frees it, so that we can write from directly. a copy that runs off
+    // the end of a pinned block is treated as pageable
+    void enqueueWriteAsync(cl_command_queue queue, Memory *dstMemory, size_t dstOffset, const void *src, size_t bytes) {
+        cl_int err;
+        if(findHostMemory(src, bytes) != 0) {
+            err = clEnqueueWriteBuffer(queue, dstMemory->clmem, CL_FALSE, dstOffset,
+                                              bytes, src, 0, NULL, NULL);
+            EasyCL::checkError(err);
+        } else {
+            void *staging = malloc(bytes);
+            if(staging == 0) {
+                cout << "enqueueWriteAsync: failed to allocate " << bytes << " bytes of staging memory" << endl;
+                throw runtime_error("enqueueWriteAsync: failed to allocate staging memory");
+            }
+            memcpy(staging, src, bytes);
+            cl_event event;
+            err = clEnqueueWriteBuffer(queue, dstMemory->clmem, CL_FALSE, dstOffset,
+                                              bytes, staging, 0, NULL, &event);
+            EasyCL::checkError(err);
+            err = clSetEventCallback(event, CL_COMPLETE, releaseStagingBuffer, staging);
+            EasyCL::checkError(err);
+        }
+        // make sure the copy actually starts, so it can overlap with whatever the host does next
+        err = clFlush(queue);
+        EasyCL::checkError(err);
+    }
+
+    // enqueues a device to host read. as in CUDA, only a read into pinned memory returns before the
+    // copy has finished: callers are allowed to read pageable dst as soon as we return
+    void enqueueReadAsync(cl_command_queue queue, Memory *srcMemory, size_t srcOffset, void *dst, size_t bytes) {
+        bool blocking = findHostMemory(dst, bytes) == 0;
+        cl_int err = clEnqueueReadBuffer(queue, srcMemory->clmem, blocking ? CL_TRUE : CL_FALSE, srcOffset,
+                                         bytes, dst, 0, NULL, NULL);
+        EasyCL::checkError(err);
+        if(!blocking) {
+            err = clFlush(queue);
+            EasyCL::checkError(err);
+        }
     }
 }
 
 size_t cuMemHostAlloc(void **pHostPointer, unsigned int bytes, int type) {
     COCL_PRINT("cuMemHostAlloc redirected bytes=" << bytes);
-    *pHostPointer = malloc(bytes);
-    return 0;
+    return cudaHostAlloc(pHostPointer, bytes, cudaHostAllocDefault);
 }
 
 size_t cuMemFreeHost(void *hostPointer) {
     COCL_PRINT("cuMemFreeHost redirected");
-    free(hostPointer);
+    return cudaFreeHost(hostPointer);
+}
+
+size_t cudaHostAlloc(void **pHostPointer, size_t bytes, unsigned int flags) {
+    COCL_PRINT("cudaHostAlloc bytes=" << bytes << " flags=" << flags);
+    if(bytes == 0) {
+        *pHostPointer = 0;
+        return 0;
+    }
+    HostMemory *hostMemory = HostMemory::newHostAlloc(bytes);
+    *pHostPointer = hostMemory->hostPointer;
+    return 0;
+}
+
+size_t cudaMallocHost(void **pHostPointer, size_t bytes) {
+    return cudaHostAlloc(pHostPointer, bytes, cudaHostAllocDefault);
+}
+
+size_t cudaFreeHost(void *hostPointer) {
+    COCL_PRINT("cudaFreeHost hostPointer=" << hostPointer);
+    if(hostPointer == 0) {
+        return 0;
+    }
+    HostMemory *hostMemory = findHostMemory(hostPointer);
+    if(hostMemory == 0 || hostMemory->isRegistered || hostMemory->hostPointer != hostPointer) {
+        cout << "cudaFreeHost: " << hostPointer << " was not allocated by cudaHostAlloc/cuMemHostAlloc" << endl;
+        throw runtime_error("cudaFreeHost: pointer was not allocated by cudaHostAlloc/cuMemHostAlloc");
+    }
+    delete hostMemory;
+    return 0;
+}
+
+size_t cudaHostRegister(void *hostPointer, size_t bytes, unsigned int flags) {
+    COCL_PRINT("cudaHostRegister hostPointer=" << hostPointer << " bytes=" << bytes << " flags=" << flags);
+    if(findHostMemory(hostPointer) != 0) {
+        cout << "cudaHostRegister: " << hostPointer << " is already pinned" << endl;
+        throw runtime_error("cudaHostRegister: memory already pinned");
+    }
+    HostMemory::newHostRegister(hostPointer, bytes);
+    return 0;
+}
+
+size_t cudaHostUnregister(void *hostPointer) {
+    COCL_PRINT("cudaHostUnregister hostPointer=" << hostPointer);
+    HostMemory *hostMemory = findHostMemory(hostPointer);
+    if(hostMemory == 0 || !hostMemory->isRegistered || hostMemory->hostPointer != hostPointer) {
+        cout << "cudaHostUnregister: " << hostPointer << " was not registered by cudaHostRegister" << endl;
+        throw runtime_error("cudaHostUnregister: pointer was not registered");
+    }
+    delete hostMemory;
     return 0;
 }
 
@@ -129,21 +492,32 @@ size_t cuMemGetInfo(size_t *free, size_t *total) {
     ThreadVars *v = getThreadVars();
     cocl::CoclDevice *coclDevice = cocl::getCoclDeviceByGpuOrdinal(v->currentGpuOrdinal);
     cl_device_id clDeviceId = coclDevice->deviceId;
-    *free = getDeviceInfoInt64(clDeviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
     *total = getDeviceInfoInt64(clDeviceId, CL_DEVICE_GLOBAL_MEM_SIZE);
+    // everything we hold counts as used, including the caching allocator's cache and unused slab
+    // space, since the driver cant give that to anyone else. each thread gets its own default
+    // context, so that means every context on the device, not just ours
+    size_t deviceBytes = getDeviceBytesForAllContexts(v->currentGpuOrdinal);
+    *free = deviceBytes < *total ? *total - deviceBytes : 0;
     return 0;
 }
 
 size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMemcpyKind, char *_queue) {
     ThreadVars *v = getThreadVars();
-    CoclStream *coclStream = (CoclStream *)_queue;
     COCL_PRINT("cudaMemcpyAsync kind=" << cudaMemcpyKind << " ctx=" << (void *)v->currentContext
        << " src=" << src << " dst=" << dst << " count=" << count);
-
-    if(coclStream == 0) {
-        coclStream = v->currentContext->default_stream.get();
+    if(CoclGraph *graph = getCapturingGraph(_queue)) {
+        if(cudaMemcpyKind == cudaMemcpyDeviceToHost) {
+            captureMemcpyDtoH(graph, dst, (const char *)src, count);
+        } else if(cudaMemcpyKind == cudaMemcpyHostToDevice) {
+            captureMemcpyHtoD(graph, (char *)dst, src, count);
+        } else if(cudaMemcpyKind == cudaMemcpyDeviceToDevice) {
+            captureMemcpyDtoD(graph, (char *)dst, (const char *)src, count);
+        } else {
+            throw runtime_error("unhandled cudaMemcpyKind");
+        }
+        return 0;
     }
-    CLQueue *queue = coclStream->clqueue;
+    CLQueue *queue = getQueueForStream(_queue);
     cl_int err;
     if(cudaMemcpyKind == cudaMemcpyDeviceToHost) {
         Memory *srcMemory = findMemory((const char *)src);
@@ -152,9 +526,7 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
             throw runtime_error("couldnt find memory for src");
         }
         size_t src_offset = srcMemory->getOffset((const char *)src);
-        err = clEnqueueReadBuffer(queue->queue, srcMemory->clmem, CL_FALSE, src_offset,
-                                         count, dst, 0, NULL, NULL);
-        EasyCL::checkError(err);
+        enqueueReadAsync(queue->queue, srcMemory, src_offset, dst, count);
     } else if(cudaMemcpyKind == cudaMemcpyHostToDevice) {
         Memory *dstMemory = findMemory((char *)dst);
         if(dstMemory == 0) {
@@ -162,23 +534,20 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
             throw runtime_error("couldnt find memory for dst");
         }
         size_t dst_offset = dstMemory->getOffset((char *)dst);
-        err = clEnqueueWriteBuffer(queue->queue, dstMemory->clmem, CL_FALSE, dst_offset,
-                                          count, src, 0, NULL, NULL);
-        EasyCL::checkError(err);
+        enqueueWriteAsync(queue->queue, dstMemory, dst_offset, src, count);
     } else if(cudaMemcpyKind == cudaMemcpyDeviceToDevice) {
         Memory *dstMemory = findMemory((char *)dst);
-        size_t dst_offset = dstMemory->getOffset((char *)dst);
-
-        Memory *srcMemory = findMemory((const char *)src);
-        size_t src_offset = srcMemory->getOffset((const char *)src);
         if(dstMemory == 0) {
             cout << "coudlnt find memory for dst " << (void *)dst << endl;
             throw runtime_error("couldnt find memory for dst");
         }
+        Memory *srcMemory = findMemory((const char *)src);
         if(srcMemory == 0) {
             cout << "coudlnt find memory for src " << (const void *)src << endl;
             throw runtime_error("couldnt find memory for src");
         }
+        size_t dst_offset = dstMemory->getOffset((char *)dst);
+        size_t src_offset = srcMemory->getOffset((const char *)src);
 
         err = clEnqueueCopyBuffer(
             queue->queue,
@@ -191,6 +560,8 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
             0,
             0);
         EasyCL::checkError(err);
+        err = clFlush(queue->queue);
+        EasyCL::checkError(err);
     } else {
         throw runtime_error("unhandled cudaMemcpyKind");
     }
@@ -200,62 +571,49 @@ size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t cudaMem
 
 size_t cudaMemsetAsync(void *location, int value, size_t count, char *_queue) {
     COCL_PRINT("cudaMemsetAsync value=" << value << " count=" << count << " queue=" << (long)_queue);
-
-    // this is not terribly async for now :-P
-
+    if(CoclGraph *graph = getCapturingGraph(_queue)) {
+        captureMemset(graph, (char *)location, (unsigned char)(value & 255), count);
+        return 0;
+    }
+    CLQueue *queue = getQueueForStream(_queue);
     Memory *memory = findMemory((char *)location);
-    ThreadVars *v = getThreadVars();
-    size_t offsetBytes = memory->getOffset((char *)location);
-    // std::cout << "memory " << (long)memory << std::endl;
-    // std::cout << " memory bytes " << memory->bytes << std::endl;
-    // std::cout << " offsetBytes " << offsetBytes << std::endl;
-
-    cl_int err;
-
-    err = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
-    EasyCL::checkError(err);
-    // std::cout << "clfinished the queue" << std::endl;
-
-    if(count % 4 == 0) {
-        unsigned int fourbytes = 0;
-        for(int j=0; j < 4; j++) {
-            fourbytes <<= 8;
-            fourbytes |= (value & 255);
-        }
-        int intCount = count >> 2;
-        myEnqueueFillBuffer(
-            v->currentContext->default_stream.get()->clqueue->queue,
-            memory->clmem,
-            fourbytes,
-            offsetBytes, intCount);
-    } else {
-        cout << "memset should be multiple of 4 count" << std::endl;
-        throw std::runtime_error("cudaMemsetAsync should have count multiple of 4");
+    if(memory == 0) {
+        cout << "cudaMemsetAsync: couldnt find memory for " << location << endl;
+        throw runtime_error("cudaMemsetAsync: couldnt find memory");
     }
-    err = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
-    EasyCL::checkError(err);
-    // COCL_PRINT("finished cudaMemsetAsync");
+    size_t offsetBytes = memory->getOffset((char *)location);
+    myEnqueueFillBufferBytes(queue->queue, memory->clmem, (unsigned char)(value & 255), offsetBytes, count);
     return 0;
 }
 
-size_t cuMemsetD8(CUdeviceptr location, unsigned char value, uint32_t count) {
+size_t cuMemsetD8(CUdeviceptr location, unsigned char value, size_t count) {
     COCL_PRINT("cuMemsetD8 redirected value " << value << " count=" << count);
     // use default queue??
     ThreadVars *v = getThreadVars();
     Memory *memory = findMemory((char *)location);
     size_t offset = memory->getOffset((char *)location);
-    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem, &value, sizeof(unsigned char), offset, count * sizeof(unsigned char), 0, 0, 0);
-    EasyCL::checkError(err);
+    getFillEngine()->fill(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem,
+        &value, sizeof(unsigned char), offset, count * sizeof(unsigned char));
+    return 0;
+}
+
+size_t cuMemsetD16(CUdeviceptr location, unsigned short value, size_t count) {
+    COCL_PRINT("cuMemsetD16 redirected value " << value << " count=" << count);
+    ThreadVars *v = getThreadVars();
+    Memory *memory = findMemory((char *)location);
+    size_t offset = memory->getOffset((char *)location);
+    getFillEngine()->fill(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem,
+        &value, sizeof(unsigned short), offset, count * sizeof(unsigned short));
     return 0;
 }
 
-size_t cuMemsetD32(CUdeviceptr location, unsigned int value, uint32_t count) {
+size_t cuMemsetD32(CUdeviceptr location, unsigned int value, size_t count) {
     Memory *memory = findMemory((char *)location);
     ThreadVars *v = getThreadVars();
     size_t offset = memory->getOffset((char *)location);
     COCL_PRINT("cuMemsetD32 redirected value " << value << " count=" << count << " location=" << location << " memory=" << (void *)memory);
-    cl_int err = clEnqueueFillBuffer(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem, &value, sizeof(int), offset, count * sizeof(int), 0, 0, 0);
-    EasyCL::checkError(err);
+    getFillEngine()->fill(v->currentContext->default_stream.get()->clqueue->queue, memory->clmem,
+        &value, sizeof(unsigned int), offset, count * sizeof(unsigned int));
     return 0;
 }
 
@@ -272,16 +630,20 @@ size_t cudaMemcpy(void *dst, const void *src, size_t bytes, cudaMemcpyKind kind)
     COCL_PRINT("cudamempcy using opencl cudaMemcpyKind " << kind << " count=" << bytes);
     cl_int err;
     ThreadVars *v = getThreadVars();
+    Context *context = v->getContext();
+    // cudaMemcpy is on the legacy default stream, so it waits for work on the other streams first.
+    // kernels are async, so that work might still be running
+    context->synchronizeCreatedStreams();
     if(kind == cudaMemcpyDeviceToHost) {
         Memory *srcMemory = findMemory((const char *)src);
         size_t offset = srcMemory->getOffset((const char *)src);
-        err = clEnqueueReadBuffer(v->currentContext->default_stream.get()->clqueue->queue, srcMemory->clmem, CL_TRUE, offset,
+        err = clEnqueueReadBuffer(context->default_stream.get()->clqueue->queue, srcMemory->clmem, CL_TRUE, offset,
                                          bytes, dst, 0, NULL, NULL);
         EasyCL::checkError(err);
     } else if(kind == cudaMemcpyHostToDevice) {
         Memory *dstMemory = findMemory((char *)dst);
         size_t offset = dstMemory->getOffset((char *)dst);
-        err = clEnqueueWriteBuffer(v->currentContext->default_stream.get()->clqueue->queue, dstMemory->clmem, CL_TRUE, offset,
+        err = clEnqueueWriteBuffer(context->default_stream.get()->clqueue->queue, dstMemory->clmem, CL_TRUE, offset,
                                           bytes, src, 0, NULL, NULL);
         EasyCL::checkError(err);
     } else if(kind == cudaMemcpyDeviceToDevice) {
@@ -290,7 +652,7 @@ size_t cudaMemcpy(void *dst, const void *src, size_t bytes, cudaMemcpyKind kind)
         Memory *dstMemory = findMemory((char *)dst);
         size_t dst_offset = dstMemory->getOffset((char *)dst);
         err = clEnqueueCopyBuffer(
-            v->currentContext->default_stream.get()->clqueue->queue,
+            context->default_stream.get()->clqueue->queue,
             srcMemory->clmem,
             dstMemory->clmem,
             src_offset,
@@ -307,54 +669,247 @@ size_t cudaMemcpy(void *dst, const void *src, size_t bytes, cudaMemcpyKind kind)
     return 0;
 }
 
-size_t cuMemcpyHtoDAsync(CUdeviceptr dst, const void *src, size_t bytes, char *_queue) {
-    CoclStream *coclStream = (CoclStream *)_queue;
-    CLQueue *queue = coclStream->clqueue;
-    COCL_PRINT("cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
-    Memory *dstMemory = findMemory((char *)dst);
-    size_t offset = dstMemory->getOffset((char *)dst);
+// row pitch we give cudaMallocPitch rows. same as the fakePos alignment, so every row starts
+// 128-byte aligned
+static const size_t PITCH_ALIGNMENT = 128;
+
+// from the first byte of a rect to just past its last
+static size_t getRectSpanBytes(size_t pitch, size_t slicePitch, size_t width, size_t height, size_t depth) {
+    return (depth - 1) * slicePitch + (height - 1) * pitch + width;
+}
+
+static Memory *findMemoryForRect(const char *ptr, size_t pitch, size_t slicePitch,
+        size_t width, size_t height, size_t depth, const char *name) {
+    Memory *memory = findMemory(ptr);
+    if(memory == 0) {
+        cout << "couldnt find memory for " << name << " " << (const void *)ptr << endl;
+        throw runtime_error(std::string("couldnt find memory for ") + name);
+    }
+    size_t lastByte = (ptr - (const char *)memory->fakePos) + getRectSpanBytes(pitch, slicePitch, width, height, depth);
+    if(lastByte > memory->bytes) {
+        cout << name << " rect runs off the end of its allocation: " << lastByte << " > " << memory->bytes << endl;
+        throw runtime_error(std::string(name) + " rect runs off the end of its allocation");
+    }
+    return memory;
+}
+
+// copies width bytes x height rows x depth slices, as a single clEnqueue{Read,Write,Copy}BufferRect.
+// device sides are addressed as an origin of (offset, 0, 0) into the clmem, with the pitches giving
+// the rest of the layout. if async, device to device copies, and reads and writes with pinned host
+// memory, dont block. reads into pageable memory block, as in CUDA, and so do writes from it, since
+// we'd otherwise need to stage the whole rect
+static void enqueueCopyRect(cl_command_queue queue, bool async,
+        void *dst, size_t dstPitch, size_t dstSlicePitch,
+        const void *src, size_t srcPitch, size_t srcSlicePitch,
+        size_t width, size_t height, size_t depth, cudaMemcpyKind kind) {
+    if(width == 0 || height == 0 || depth == 0) {
+        return;
+    }
+    if(dstPitch < width || srcPitch < width) {
+        cout << "pitch " << dstPitch << " or " << srcPitch << " less than width " << width << endl;
+        throw runtime_error("pitch less than width");
+    }
+    size_t hostOrigin[3] = {0, 0, 0};
+    size_t region[3] = {width, height, depth};
     cl_int err;
+    if(kind == cudaMemcpyDeviceToHost) {
+        Memory *srcMemory = findMemoryForRect((const char *)src, srcPitch, srcSlicePitch, width, height, depth, "src");
+        size_t bufferOrigin[3] = {srcMemory->getOffset((const char *)src), 0, 0};
+        // pageable dst has to be ready when we return, see enqueueReadAsync
+        bool blocking = !async || findHostMemory(dst, getRectSpanBytes(dstPitch, dstSlicePitch, width, height, depth)) == 0;
+        err = clEnqueueReadBufferRect(queue, srcMemory->clmem, blocking ? CL_TRUE : CL_FALSE,
+            bufferOrigin, hostOrigin, region, srcPitch, srcSlicePitch, dstPitch, dstSlicePitch,
+            dst, 0, NULL, NULL);
+        EasyCL::checkError(err);
+    } else if(kind == cudaMemcpyHostToDevice) {
+        Memory *dstMemory = findMemoryForRect((const char *)dst, dstPitch, dstSlicePitch, width, height, depth, "dst");
+        size_t bufferOrigin[3] = {dstMemory->getOffset((char *)dst), 0, 0};
+        bool blocking = !async || findHostMemory(src, getRectSpanBytes(srcPitch, srcSlicePitch, width, height, depth)) == 0;
+        err = clEnqueueWriteBufferRect(queue, dstMemory->clmem, blocking ? CL_TRUE : CL_FALSE,
+            bufferOrigin, hostOrigin, region, dstPitch, dstSlicePitch, srcPitch, srcSlicePitch,
+            src, 0, NULL, NULL);
+        EasyCL::checkError(err);
+    } else if(kind == cudaMemcpyDeviceToDevice) {
+        Memory *srcMemory = findMemoryForRect((const char *)src, srcPitch, srcSlicePitch, width, height, depth, "src");
+        Memory *dstMemory = findMemoryForRect((const char *)dst, dstPitch, dstSlicePitch, width, height, depth, "dst");
+        size_t srcOrigin[3] = {srcMemory->getOffset((const char *)src), 0, 0};
+        size_t dstOrigin[3] = {dstMemory->getOffset((char *)dst), 0, 0};
+        err = clEnqueueCopyBufferRect(queue, srcMemory->clmem, dstMemory->clmem,
+            srcOrigin, dstOrigin, region, srcPitch, srcSlicePitch, dstPitch, dstSlicePitch,
+            0, NULL, NULL);
+        EasyCL::checkError(err);
+    } else {
+        cout << "enqueueCopyRect unhandled cudaMemcpyKind " << kind << endl;
+        throw runtime_error("unhandled cudaMemcpyKind");
+    }
+    if(async) {
+        err = clFlush(queue);
+        EasyCL::checkError(err);
+    }
+}
+
+static void memcpy3D(const cudaMemcpy3DParms *p, char *_queue, bool async) {
+    if(p->srcArray != 0 || p->dstArray != 0) {
+        cout << "cudaMemcpy3D: cudaArrays not implemented, only pitched linear memory" << endl;
+        throw runtime_error("cudaMemcpy3D: cudaArrays not implemented");
+    }
+    size_t srcSlicePitch = p->srcPtr.pitch * p->srcPtr.ysize;
+    size_t dstSlicePitch = p->dstPtr.pitch * p->dstPtr.ysize;
+    const char *src = (const char *)p->srcPtr.ptr + p->srcPos.z * srcSlicePitch
+        + p->srcPos.y * p->srcPtr.pitch + p->srcPos.x;
+    char *dst = (char *)p->dstPtr.ptr + p->dstPos.z * dstSlicePitch
+        + p->dstPos.y * p->dstPtr.pitch + p->dstPos.x;
+    COCL_PRINT("cudaMemcpy3D kind=" << p->kind << " src=" << (const void *)src << " dst=" << (void *)dst
+        << " extent=" << p->extent.width << "," << p->extent.height << "," << p->extent.depth);
+    CLQueue *queue = getQueueForStream(_queue);
+    enqueueCopyRect(queue->queue, async, dst, p->dstPtr.pitch, dstSlicePitch, src, p->srcPtr.pitch, srcSlicePitch,
+        p->extent.width, p->extent.height, p->extent.depth, p->kind);
+}
 
-    err = clEnqueueWriteBuffer(queue->queue, dstMemory->clmem, CL_TRUE, offset,
-                                      bytes, src, 0, NULL, NULL);
-    EasyCL::checkError(err);
+size_t cudaMallocPitch(void **pDevPtr, size_t *pPitch, size_t width, size_t height) {
+    size_t pitch = ((width + PITCH_ALIGNMENT - 1) / PITCH_ALIGNMENT) * PITCH_ALIGNMENT;
+    COCL_PRINT("cudaMallocPitch width=" << width << " height=" << height << " pitch=" << pitch);
+    *pPitch = pitch;
+    return cudaMalloc(pDevPtr, pitch * height);
+}
 
-    err = clFinish(queue->queue);
-    EasyCL::checkError(err);
-    COCL_PRINT(" ... done cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
+size_t cudaMalloc3D(cudaPitchedPtr *pPitchedDevPtr, cudaExtent extent) {
+    size_t pitch;
+    void *ptr;
+    cudaMallocPitch(&ptr, &pitch, extent.width, extent.height * extent.depth);
+    *pPitchedDevPtr = make_cudaPitchedPtr(ptr, pitch, extent.width, extent.height);
     return 0;
 }
 
-size_t  cuMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, char *_queue) {
-    CoclStream *coclStream = (CoclStream *)_queue;
-    CLQueue *queue = coclStream->clqueue;
-    COCL_PRINT("cuMemcpyDtoHAsync queue=" << (void *)queue << " dst=" << dst << " src=" << src << " bytes=" << bytes);
-    Memory *srcMemory = findMemory((char *)src);
-    size_t offset = srcMemory->getOffset((char *)src);
+size_t cudaMemcpy2D(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width,
+        size_t height, cudaMemcpyKind kind) {
+    COCL_PRINT("cudaMemcpy2D kind=" << kind << " width=" << width << " height=" << height);
+    // legacy default stream, see cudaMemcpy
+    getThreadVars()->getContext()->synchronizeCreatedStreams();
+    CLQueue *queue = getQueueForStream(0);
+    enqueueCopyRect(queue->queue, false, dst, dpitch, 0, src, spitch, 0, width, height, 1, kind);
+    return 0;
+}
 
-    // adding this because otherwise seems I need to call synchronize, on intel hd beignet, before
-    // copying data back (even though the copy should wait, by virtue of being on the same queue, I think)
-    // this error shows up only in testblas, for now
+// for the async calls that graphs cant record yet, see captureMemcpyDtoD etc
+static void checkNotCapturing(char *_queue, string what) {
+    if(getCapturingGraph(_queue) != 0) {
+        cout << what << " not supported during stream capture" << endl;
+        throw runtime_error(what + " not supported during stream capture");
+    }
+}
 
-    cl_int err = clEnqueueBarrierWithWaitList(
-        queue->queue, 0, 0, 0
-    );
-    EasyCL::checkError(err);
+size_t cudaMemcpy2DAsync(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width,
+        size_t height, cudaMemcpyKind kind, char *_queue) {
+    COCL_PRINT("cudaMemcpy2DAsync kind=" << kind << " width=" << width << " height=" << height);
+    checkNotCapturing(_queue, "cudaMemcpy2DAsync");
+    CLQueue *queue = getQueueForStream(_queue);
+    enqueueCopyRect(queue->queue, true, dst, dpitch, 0, src, spitch, 0, width, height, 1, kind);
+    return 0;
+}
 
-    COCL_PRINT("   cuMemcpyDtoHAsync ...enqueued barrier with wait list")
+size_t cudaMemcpy3D(const cudaMemcpy3DParms *p) {
+    // legacy default stream, see cudaMemcpy
+    getThreadVars()->getContext()->synchronizeCreatedStreams();
+    memcpy3D(p, 0, false);
+    return 0;
+}
 
-    err = clFinish(queue->queue);
-    EasyCL::checkError(err);
+size_t cudaMemcpy3DAsync(const cudaMemcpy3DParms *p, char *_queue) {
+    checkNotCapturing(_queue, "cudaMemcpy3DAsync");
+    memcpy3D(p, _queue, true);
+    return 0;
+}
 
-    err = clEnqueueReadBuffer(queue->queue, srcMemory->clmem, CL_TRUE, offset,
-                                     bytes, dst, 0, NULL, NULL);
-    EasyCL::checkError(err);
+size_t cudaMemset2DAsync(void *devPtr, size_t pitch, int value, size_t width, size_t height, char *_queue) {
+    COCL_PRINT("cudaMemset2DAsync value=" << value << " pitch=" << pitch << " width=" << width << " height=" << height);
+    checkNotCapturing(_queue, "cudaMemset2DAsync");
+    if(width == 0 || height == 0) {
+        return 0;
+    }
+    CLQueue *queue = getQueueForStream(_queue);
+    Memory *memory = findMemoryForRect((const char *)devPtr, pitch, 0, width, height, 1, "devPtr");
+    size_t offsetBytes = memory->getOffset((char *)devPtr);
+    getFillEngine()->fill2D(queue->queue, memory->clmem, (unsigned char)(value & 255), offsetBytes,
+        pitch, width, height);
+    return 0;
+}
 
+size_t cudaMemset2D(void *devPtr, size_t pitch, int value, size_t width, size_t height) {
+    return cudaMemset2DAsync(devPtr, pitch, value, width, height, 0);
+}
+
+size_t coclMemcpyBatchAsync(const CoclMemcpyBatchEntry *copies, size_t count, char *_queue) {
+    COCL_PRINT("coclMemcpyBatchAsync count=" << count);
+    checkNotCapturing(_queue, "coclMemcpyBatchAsync");
+    CLQueue *queue = getQueueForStream(_queue);
+    std::vector<ResolvedCopy> resolved(count);
+    {
+        // resolve everything under one lock, rather than taking it twice per copy
+        ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
+        ContextMutex contextMutex(context);
+        for(size_t i = 0; i < count; i++) {
+            const char *src = (const char *)copies[i].src;
+            char *dst = (char *)copies[i].dst;
+            Memory *srcMemory = findMemoryLocked(context, src);
+            if(srcMemory == 0) {
+                cout << "coclMemcpyBatchAsync: couldnt find memory for src " << (const void *)src << " copy " << i << endl;
+                throw runtime_error("coclMemcpyBatchAsync: couldnt find memory for src");
+            }
+            Memory *dstMemory = findMemoryLocked(context, dst);
+            if(dstMemory == 0) {
+                cout << "coclMemcpyBatchAsync: couldnt find memory for dst " << (void *)dst << " copy " << i << endl;
+                throw runtime_error("coclMemcpyBatchAsync: couldnt find memory for dst");
+            }
+            ResolvedCopy &copy = resolved[i];
+            copy.srcClmem = srcMemory->clmem;
+            copy.dstClmem = dstMemory->clmem;
+            copy.srcOffset = srcMemory->getOffset(src);
+            copy.dstOffset = dstMemory->getOffset(dst);
+            copy.bytes = copies[i].bytes;
+        }
+    }
+    getMemcpyBatchEngine()->enqueue(queue->queue, resolved);
+    return 0;
+}
+
+size_t cuMemcpyHtoDAsync(CUdeviceptr dst, const void *src, size_t bytes, char *_queue) {
+    if(CoclGraph *graph = getCapturingGraph(_queue)) {
+        captureMemcpyHtoD(graph, (char *)dst, src, bytes);
+        return 0;
+    }
+    CLQueue *queue = getQueueForStream(_queue);
+    COCL_PRINT("cuMemcpyHtoDAsync dst=" << dst << " src=" << src << " bytes=" << bytes);
+    Memory *dstMemory = findMemory((char *)dst);
+    if(dstMemory == 0) {
+        cout << "cuMemcpyHtoDAsync: couldnt find memory for dst " << (void *)dst << endl;
+        throw runtime_error("cuMemcpyHtoDAsync: couldnt find memory for dst");
+    }
+    size_t offset = dstMemory->getOffset((char *)dst);
+    enqueueWriteAsync(queue->queue, dstMemory, offset, src, bytes);
+    return 0;
+}
+
+size_t  cuMemcpyDtoHAsync(void *dst, CUdeviceptr src, size_t bytes, char *_queue) {
+    // the queue is in-order, so the read waits for anything already queued on this stream. for
+    // pinned dst, cuStreamSynchronize, or an event recorded after this, tells the caller when dst is
+    // ready. pageable dst is ready when we return, see enqueueReadAsync
+    if(CoclGraph *graph = getCapturingGraph(_queue)) {
+        captureMemcpyDtoH(graph, dst, (const char *)src, bytes);
+        return 0;
+    }
+    CLQueue *queue = getQueueForStream(_queue);
+    COCL_PRINT("cuMemcpyDtoHAsync queue=" << (void *)queue << " dst=" << dst << " src=" << src << " bytes=" << bytes);
+    Memory *srcMemory = findMemory((char *)src);
+    if(srcMemory == 0) {
+        cout << "cuMemcpyDtoHAsync: couldnt find memory for src " << (void *)src << endl;
+        throw runtime_error("cuMemcpyDtoHAsync: couldnt find memory for src");
+    }
+    size_t offset = srcMemory->getOffset((char *)src);
+
+    enqueueReadAsync(queue->queue, srcMemory, offset, dst, bytes);
     COCL_PRINT("   cuMemcpyDtoHAsync ...enqueued read buffer")
-    EasyCL::checkError(err);
-    err = clFinish(queue->queue);
-    EasyCL::checkError(err);
-    COCL_PRINT("   cuMemcpyDtoHAsync ...finished clfinish")
     return 0;
 }
 
@@ -382,7 +937,7 @@ size_t cudaMalloc(void **_pMemory, size_t N) {
         (*_pMemory)=0;
         return 0;
     }
-    Memory *memory = Memory::newDeviceAlloc(N);
+    Memory *memory = allocateDeviceMemory(N);
     COCL_PRINT("cudaMalloc using cl, size " << N << " memory=" << (void *)memory << " fakePos=" << memory->fakePos);
     *_pMemory = (void *)memory->fakePos;
     return 0;
@@ -402,7 +957,10 @@ size_t cudaFree(void *_memory) {
     }
     Memory *memory = findMemory((char *)_memory);
     COCL_PRINT("cudafree using opencl memory=" << memory);
-    delete memory;
+    if(memory == 0) {
+        return 0;
+    }
+    freeDeviceMemory(memory);
     return 0;
 }
 
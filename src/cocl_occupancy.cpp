@@ -0,0 +1,174 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_occupancy.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_kernel_registry.h"
+#include "cocl/cocl_properties.h"
+#include "cocl/cocl_launch_args.h"
+#include "cocl/hostside_opencl_funcs.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+#undef COCL_PRINT
+#ifdef COCL_SPAM_KERNELLAUNCH
+#define COCL_PRINT(x) std::cout << "[LAUNCH] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+namespace cocl {
+
+static const KernelCacheEntry *findKernelCacheEntryLocked(Context *context, int32_t kernelId) {
+    // caller should hold the kernelCacheMutex. any variant of the kernel will do: they only
+    // differ in which clmem each pointer arg lives in
+    for(auto it = context->kernelCacheById.begin(); it != context->kernelCacheById.end(); it++) {
+        if(it->first.kernelId == kernelId) {
+            return &it->second;
+        }
+    }
+    return 0;
+}
+
+static KernelOccupancyInfo getOccupancyInfo(Context *context, const RegisteredKernel &registered) {
+    int32_t kernelId = getKernelId(registered.kernelIdSlot);
+    bool haveKernel = false;
+    {
+        std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+        auto it = context->occupancyInfoByKernelId.find(kernelId);
+        if(it != context->occupancyInfoByKernelId.end()) {
+            return it->second;
+        }
+        haveKernel = findKernelCacheEntryLocked(context, kernelId) != 0;
+    }
+    if(!haveKernel) {
+        // not launched yet. generate it with every pointer arg in clmem1, which is where a launch
+        // with all of them in one buffer puts them, after the first allocation in clmem0, see
+        // configureKernelWithId. and store it under the key such a launch would use, so the work
+        // isnt wasted. we dont know how many pointer args there are until we've generated it
+        std::vector<int> clmemIndexByClmemArgIndex(LaunchArgs::maxArgs, 1);
+        GenerateOpenCLResult res = generateOpenCL(2, clmemIndexByClmemArgIndex, registered.kernelName, registered.devicellsourcecode);
+        KernelCacheKey key;
+        key.kernelId = kernelId;
+        key.uniqueClmemCount = 2;
+        key.clmemIndexByClmemArgIndex = std::vector<int>(res.kernelInfo.numClmemArgs, 1);
+        getOrBuildKernelCacheEntry(context, key, [&res]() {
+            return res;
+        });
+    }
+    std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+    const KernelCacheEntry &entry = *findKernelCacheEntryLocked(context, kernelId);
+    cl_kernel kernel = entry.kernel->kernel;
+    cl_device_id device = context->cl->device;
+
+    KernelOccupancyInfo info;
+    cl_ulong localMemSize = 0;
+    cl_ulong privateMemSize = 0;
+    cl_int err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &info.maxWorkgroupSize, 0);
+    EasyCL::checkError(err);
+    err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(size_t), &info.workgroupSizeMultiple, 0);
+    EasyCL::checkError(err);
+    err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, 0);
+    EasyCL::checkError(err);
+    err = clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_PRIVATE_MEM_SIZE, sizeof(cl_ulong), &privateMemSize, 0);
+    EasyCL::checkError(err);
+    info.localMemSize = localMemSize;
+    info.privateMemSize = privateMemSize;
+    info.usesScratch = entry.kernelInfo.usesScratch;
+    if(info.workgroupSizeMultiple == 0) {
+        info.workgroupSizeMultiple = 1;
+    }
+    COCL_PRINT("occupancy info for " << registered.kernelName << ": maxWorkgroupSize=" << info.maxWorkgroupSize
+        << " multiple=" << info.workgroupSizeMultiple << " localMemSize=" << info.localMemSize
+        << " privateMemSize=" << info.privateMemSize << " usesScratch=" << info.usesScratch);
+    context->occupancyInfoByKernelId[kernelId] = info;
+    return info;
+}
+
+static int getActiveBlocks(const KernelOccupancyInfo &info, const cudaDeviceProp &prop, int blockSize, size_t dynamicSMemSize) {
+    // OpenCL has no notion of how many private bytes a compute unit has, and drivers already take
+    // register use into account in CL_KERNEL_WORK_GROUP_SIZE, so we limit by threads and by local
+    // memory only
+    if(blockSize <= 0 || (size_t)blockSize > info.maxWorkgroupSize) {
+        return 0;
+    }
+    size_t multiple = info.workgroupSizeMultiple;
+    size_t roundedBlockSize = (blockSize + multiple - 1) / multiple * multiple;
+    size_t activeBlocks = prop.maxThreadsPerMultiProcessor / roundedBlockSize;
+    size_t localBytes = info.localMemSize + dynamicSMemSize;
+    if(info.usesScratch) {
+        localBytes += getScratchBytes(blockSize);
+    }
+    if(localBytes > 0) {
+        activeBlocks = std::min(activeBlocks, prop.sharedMemPerBlock / localBytes);
+    }
+    return (int)activeBlocks;
+}
+
+} // namespace cocl
+
+size_t cudaOccupancyMaxActiveBlocksPerMultiprocessor(int *numBlocks, const void *func, int blockSize, size_t dynamicSMemSize) {
+    RegisteredKernel registered = getRegisteredKernel(func, "cudaOccupancy*");
+    Context *context = getThreadVars()->getContext();
+    KernelOccupancyInfo info = getOccupancyInfo(context, registered);
+    cudaDeviceProp prop;
+    cudaGetDeviceProperties(&prop, context->gpuOrdinal);
+    *numBlocks = getActiveBlocks(info, prop, blockSize, dynamicSMemSize);
+    COCL_PRINT("cudaOccupancyMaxActiveBlocksPerMultiprocessor " << registered.kernelName << " blockSize=" << blockSize
+        << " dynamicSMemSize=" << dynamicSMemSize << " => " << *numBlocks);
+    return 0;
+}
+
+size_t cudaOccupancyMaxPotentialBlockSize(int *minGridSize, int *blockSize, const void *func, size_t dynamicSMemSize, int blockSizeLimit) {
+    RegisteredKernel registered = getRegisteredKernel(func, "cudaOccupancy*");
+    Context *context = getThreadVars()->getContext();
+    KernelOccupancyInfo info = getOccupancyInfo(context, registered);
+    cudaDeviceProp prop;
+    cudaGetDeviceProperties(&prop, context->gpuOrdinal);
+
+    // try each multiple of the preferred multiple, largest first, keeping the one that has the
+    // most threads active per compute unit. ties go to the larger block
+    int multiple = (int)info.workgroupSizeMultiple;
+    int maxBlockSize = (int)std::min<size_t>(info.maxWorkgroupSize, prop.maxThreadsPerMultiProcessor);
+    if(blockSizeLimit > 0) {
+        maxBlockSize = std::min(maxBlockSize, blockSizeLimit);
+    }
+    int start = maxBlockSize / multiple * multiple;
+    if(start == 0) {
+        start = maxBlockSize;
+    }
+    int bestBlockSize = 0;
+    int bestActiveBlocks = 0;
+    for(int candidate = start; candidate > 0; candidate -= multiple) {
+        int activeBlocks = getActiveBlocks(info, prop, candidate, dynamicSMemSize);
+        if(activeBlocks * candidate > bestActiveBlocks * bestBlockSize) {
+            bestBlockSize = candidate;
+            bestActiveBlocks = activeBlocks;
+        }
+    }
+    *blockSize = bestBlockSize;
+    *minGridSize = bestActiveBlocks * prop.multiProcessorCount;
+    COCL_PRINT("cudaOccupancyMaxPotentialBlockSize " << registered.kernelName << " dynamicSMemSize=" << dynamicSMemSize
+        << " blockSizeLimit=" << blockSizeLimit << " => blockSize=" << *blockSize << " minGridSize=" << *minGridSize);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_slab_allocator.h"
+
+#include "cocl/cocl_memory.h"
+#include "cocl/cocl_context.h"
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+using namespace cocl;
+
+#ifdef COCL_PRINT
+#undef COCL_PRINT
+#endif
+
+#ifdef COCL_SPAM_MEMORY
+#define COCL_PRINT(x) std::cout << "[MEM] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+namespace cocl {
+    SlabAllocator::SlabAllocator(Context *context, size_t slabBytes) :
+            context(context), slabBytes(slabBytes) {
+    }
+
+    SlabAllocator::~SlabAllocator() {
+        // any suballocations still alive hold their own reference on the slab clmem
+        for(auto it=slabs.begin(); it != slabs.end(); it++) {
+            releaseSlabMarkers(*it);
+            delete (*it)->memory;
+            delete *it;
+        }
+        slabs.clear();
+    }
+
+    Memory *SlabAllocator::getFirstSlab() {
+        ContextMutex contextMutex(context);
+        if(slabs.size() == 0) {
+            return 0;
+        }
+        return slabs[0]->memory;
+    }
+
+    size_t SlabAllocator::getLargestFreeBytes() {
+        size_t largest = 0;
+        for(auto it=slabs.begin(); it != slabs.end(); it++) {
+            for(auto blockIt=(*it)->freeBytesByOffset.begin(); blockIt != (*it)->freeBytesByOffset.end(); blockIt++) {
+                if(blockIt->second > largest) {
+                    largest = blockIt->second;
+                }
+            }
+        }
+        return largest;
+    }
+
+    Slab *SlabAllocator::findSlab(Memory *slabMemory) {
+        for(auto it=slabs.begin(); it != slabs.end(); it++) {
+            if((*it)->memory == slabMemory) {
+                return *it;
+            }
+        }
+        return 0;
+    }
+
+    void SlabAllocator::releaseSlabMarkers(Slab *slab) {
+        for(auto it=slab->releaseMarkersByOffset.begin(); it != slab->releaseMarkersByOffset.end(); it++) {
+            for(auto markerIt=it->second.begin(); markerIt != it->second.end(); markerIt++) {
+                clReleaseEvent(*markerIt);
+            }
+        }
+        slab->releaseMarkersByOffset.clear();
+    }
+
+    long long SlabAllocator::allocateFromSlab(Slab *slab, size_t bytes, std::vector<cl_event> &markers) {
+        // first fit
+        for(auto it=slab->freeBytesByOffset.begin(); it != slab->freeBytesByOffset.end(); it++) {
+            size_t offset = it->first;
+            size_t freeBytes = it->second;
+            if(freeBytes >= bytes) {
+                slab->freeBytesByOffset.erase(it);
+                std::vector<cl_event> blockMarkers;
+                auto markersIt = slab->releaseMarkersByOffset.find(offset);
+                if(markersIt != slab->releaseMarkersByOffset.end()) {
+                    blockMarkers.swap(markersIt->second);
+                    slab->releaseMarkersByOffset.erase(markersIt);
+                    Context::releaseCompletedMarkers(blockMarkers);
+                }
+                if(freeBytes > bytes) {
+                    // we dont know which part of the block the pending kernels used, so the rest
+                    // keeps the markers too
+                    slab->freeBytesByOffset[offset + bytes] = freeBytes - bytes;
+                    for(auto markerIt=blockMarkers.begin(); markerIt != blockMarkers.end(); markerIt++) {
+                        clRetainEvent(*markerIt);
+                    }
+                    if(blockMarkers.size() > 0) {
+                        slab->releaseMarkersByOffset[offset + bytes] = blockMarkers;
+                    }
+                }
+                markers.insert(markers.end(), blockMarkers.begin(), blockMarkers.end());
+                slab->bytesInUse += bytes;
+                return (long long)offset;
+            }
+        }
+        return -1;
+    }
+
+    Memory *SlabAllocator::allocate(size_t bytes) {
+        size_t alignedBytes = ((bytes + alignment - 1) / alignment) * alignment;
+        Slab *slab = 0;
+        long long offset = -1;
+        std::vector<cl_event> markers;
+        {
+            ContextMutex contextMutex(context);
+            for(auto it=slabs.begin(); it != slabs.end() && offset < 0; it++) {
+                slab = *it;
+                offset = allocateFromSlab(slab, alignedBytes, markers);
+            }
+        }
+        if(offset < 0) {
+            size_t newSlabBytes = alignedBytes > slabBytes ? alignedBytes : slabBytes;
+            COCL_PRINT("SlabAllocator creating slab " << slabs.size() << " bytes=" << newSlabBytes);
+            slab = new Slab();
+            slab->memory = Memory::newSlab(newSlabBytes);
+            slab->freeBytesByOffset[0] = newSlabBytes;
+            ContextMutex contextMutex(context);
+            slabs.push_back(slab);
+            offset = allocateFromSlab(slab, alignedBytes, markers);
+        }
+        // kernels queued before the block was freed might still be using it
+        context->waitForReleaseMarkers(markers);
+        COCL_PRINT("SlabAllocator::allocate bytes=" << bytes << " slab=" << slab->memory->clmem << " offset=" << offset);
+        return Memory::newSuballocation(slab->memory, (size_t)offset, alignedBytes);
+    }
+
+    void SlabAllocator::release(Memory *memory) {
+        Memory *emptySlabMemory = 0;
+        // mark where every stream is up to, rather than waiting for them, so free stays cheap. see
+        // allocate
+        std::vector<cl_event> markers;
+        context->recordReleaseMarkers(markers);
+        {
+            ContextMutex contextMutex(context);
+            Slab *slab = findSlab(memory->slab);
+            if(slab == 0) {
+                cout << "SlabAllocator::release: couldnt find slab for memory " << (void *)memory << endl;
+                throw runtime_error("SlabAllocator::release: couldnt find slab for memory");
+            }
+            size_t offset = memory->slabOffset;
+            size_t bytes = memory->bytes;
+            slab->bytesInUse -= bytes;
+
+            // put the block back, merging with free neighbours on either side, and their markers
+            std::map<size_t, std::vector<cl_event> > &markersByOffset = slab->releaseMarkersByOffset;
+            auto next = slab->freeBytesByOffset.lower_bound(offset);
+            if(next != slab->freeBytesByOffset.end() && next->first == offset + bytes) {
+                auto nextMarkers = markersByOffset.find(next->first);
+                if(nextMarkers != markersByOffset.end()) {
+                    markers.insert(markers.end(), nextMarkers->second.begin(), nextMarkers->second.end());
+                    markersByOffset.erase(nextMarkers);
+                }
+                bytes += next->second;
+                next = slab->freeBytesByOffset.erase(next);
+            }
+            if(next != slab->freeBytesByOffset.begin()) {
+                auto prev = next;
+                prev--;
+                if(prev->first + prev->second == offset) {
+                    auto prevMarkers = markersByOffset.find(prev->first);
+                    if(prevMarkers != markersByOffset.end()) {
+                        markers.insert(markers.end(), prevMarkers->second.begin(), prevMarkers->second.end());
+                        markersByOffset.erase(prevMarkers);
+                    }
+                    offset = prev->first;
+                    bytes += prev->second;
+                    slab->freeBytesByOffset.erase(prev);
+                }
+            }
+            slab->freeBytesByOffset[offset] = bytes;
+            Context::releaseCompletedMarkers(markers);
+            if(markers.size() > 0) {
+                markersByOffset[offset].swap(markers);
+            }
+
+            // give back overflow slabs once they're empty. we keep the first one, since thats the one
+            // vmem kernels see
+            if(slab->bytesInUse == 0 && slab != slabs[0]) {
+                for(auto it=slabs.begin(); it != slabs.end(); it++) {
+                    if(*it == slab) {
+                        slabs.erase(it);
+                        break;
+                    }
+                }
+                emptySlabMemory = slab->memory;
+                releaseSlabMarkers(slab);
+                delete slab;
+            }
+        }
+        delete memory;
+        if(emptySlabMemory != 0) {
+            COCL_PRINT("SlabAllocator releasing empty slab bytes=" << emptySlabMemory->bytes);
+            delete emptySlabMemory;
+        }
+    }
+}
@@ -17,6 +17,7 @@
 #include "cocl/cocl_events.h"
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_context.h"
+#include "cocl/cocl_arg_ring_buffer.h"
 
 #include "EasyCL/EasyCL.h"
 
@@ -50,6 +51,11 @@ namespace cocl {
         this->clqueue = cl->newQueue();
     }
     CoclStream::~CoclStream() {
+        if(argRingBuffer != 0) {
+            // pending writes may still be reading from its shadow
+            clFinish(clqueue->queue);
+            delete argRingBuffer;
+        }
         delete clqueue;
     }
 }
@@ -79,8 +85,14 @@ size_t cuStreamSynchronize(char *_queue) {
 size_t cuStreamCreate(char **_pstream, unsigned int flags) {
     CoclStream **pstream = (CoclStream**)_pstream;
     ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
+    Context *context = v->getContext();
+    EasyCL *cl = context->getCl();
     CoclStream *coclStream = new CoclStream(cl);
+    coclStream->context = context;
+    {
+        ContextMutex contextMutex(context);
+        context->streams.insert(coclStream);
+    }
     *pstream = coclStream;
     return 0;
 }
@@ -91,6 +103,13 @@ size_t cudaStreamCreate(char **_pstream) {
 
 size_t cuStreamDestroy_v2(char *_queue) {
     CoclStream *stream = (CoclStream *)_queue;
+    if(stream->context != 0) {
+        {
+            ContextMutex contextMutex(stream->context);
+            stream->context->streams.erase(stream);
+        }
+        stream->context->releaseStreamKernels(stream);
+    }
     delete stream;
     return 0;
 }
@@ -0,0 +1,190 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "cocl/cocl_warmup.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_kernel_registry.h"
+#include "cocl/hostside_opencl_funcs.h"
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+using namespace cocl;
+
+#undef COCL_PRINT
+#ifdef COCL_SPAM_KERNELLAUNCH
+#define COCL_PRINT(x) std::cout << "[LAUNCH] " << x << std::endl;
+#else
+#define COCL_PRINT(x)
+#endif
+
+#define WARMUP_KERNELS_ENV_VAR "COCL_WARMUP_KERNELS"
+#define WARMUP_THREADS_ENV_VAR "COCL_WARMUP_THREADS"
+
+namespace cocl {
+
+static void warmupKernel(Context *context, const RegisteredKernel &registered) {
+    // generateOpenCL works on the calling thread's context
+    ThreadVars *v = getThreadVars();
+    v->currentContext = context;
+    v->currentGpuOrdinal = context->gpuOrdinal;
+
+    int32_t kernelId = getKernelId(registered.kernelIdSlot);
+    {
+        // once it's been launched, the cache has the variants the program actually uses
+        std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+        for(auto it = context->kernelCacheById.begin(); it != context->kernelCacheById.end(); it++) {
+            if(it->first.kernelId == kernelId) {
+                return;
+            }
+        }
+    }
+    try {
+        // we only generate the variant we want, since generating takes a while. counting the
+        // pointer args is much cheaper
+        int numClmemArgs = getNumClmemArgs(registered.kernelName, registered.devicellsourcecode);
+        // clmem0 is the first allocation, which we assume there'll be by the time it's launched,
+        // see configureKernelWithId. with the slab allocator, the args will usually all be in
+        // clmem1, the first slab. otherwise, each in a clmem of its own, see assignClmemIndexes
+        KernelCacheKey key;
+        key.kernelId = kernelId;
+        if(numClmemArgs > 0 && context->slabAllocator && context->specializeAliasing != SpecializeAliasingNever) {
+            key.uniqueClmemCount = 2;
+            key.clmemIndexByClmemArgIndex = std::vector<int>(numClmemArgs, 1);
+        } else {
+            key.uniqueClmemCount = numClmemArgs + 1;
+            for(int i = 0; i < numClmemArgs; i++) {
+                key.clmemIndexByClmemArgIndex.push_back(i + 1);
+            }
+        }
+        getOrBuildKernelCacheEntry(context, key, [&key, &registered]() {
+            return generateOpenCL(key.uniqueClmemCount, key.clmemIndexByClmemArgIndex, registered.kernelName, registered.devicellsourcecode);
+        });
+        COCL_PRINT("warmed up " << registered.kernelName);
+    } catch(runtime_error &e) {
+        // not fatal: the first launch will try again, and report the problem properly
+        cout << "Warning: failed to warm up kernel " << registered.kernelName << ": " << e.what() << endl;
+    }
+}
+
+static int getNumWarmupThreads() {
+    if(getenv(WARMUP_THREADS_ENV_VAR) != 0) {
+        return std::max(1, atoi(getenv(WARMUP_THREADS_ENV_VAR)));
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+class WarmupTask {
+public:
+    Context *context;
+    RegisteredKernel kernel;
+};
+
+class WarmupPool {
+public:
+    ~WarmupPool() {
+        // at exit. kernels being built are using their context, so we let those finish, but dont
+        // start any more
+        {
+            std::lock_guard<std::mutex> lock(mu);
+            stopping = true;
+            tasks.clear();
+        }
+        cv.notify_all();
+        for(auto it = threads.begin(); it != threads.end(); it++) {
+            it->join();
+        }
+    }
+    void add(const std::vector<WarmupTask> &newTasks) {
+        std::lock_guard<std::mutex> lock(mu);
+        tasks.insert(tasks.end(), newTasks.begin(), newTasks.end());
+        // started on first use, and kept, idle, until exit
+        int numThreads = getNumWarmupThreads();
+        while((int)threads.size() < numThreads) {
+            threads.push_back(std::thread(&WarmupPool::run, this));
+        }
+        cv.notify_all();
+    }
+
+protected:
+    void run() {
+        while(true) {
+            WarmupTask task;
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                cv.wait(lock, [this]() {
+                    return stopping || tasks.size() > 0;
+                });
+                if(stopping) {
+                    return;
+                }
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            warmupKernel(task.context, task.kernel);
+        }
+    }
+
+    std::mutex mu;
+    std::condition_variable cv;
+    std::deque<WarmupTask> tasks;
+    std::vector<std::thread> threads;
+    bool stopping = false;
+};
+
+static WarmupPool &getWarmupPool() {
+    static WarmupPool warmupPool;
+    return warmupPool;
+}
+
+void warmupKernels(Context *context) {
+    if(getenv("COCL_LOAD_CL") != 0) {
+        // COCL_LOAD_CL numbers the files by the order kernels are built in, which we'd scramble
+        cout << "Warning: ignoring kernel warmup, since COCL_LOAD_CL is set" << endl;
+        return;
+    }
+    std::vector<RegisteredKernel> kernels = getAllRegisteredKernels();
+    std::vector<WarmupTask> tasks;
+    for(auto it = kernels.begin(); it != kernels.end(); it++) {
+        WarmupTask task;
+        task.context = context;
+        task.kernel = *it;
+        tasks.push_back(task);
+    }
+    COCL_PRINT("warming up " << tasks.size() << " kernels");
+    getWarmupPool().add(tasks);
+}
+
+void warmupKernelsIfRequested(Context *context) {
+    if(getenv(WARMUP_KERNELS_ENV_VAR) != 0 && string(getenv(WARMUP_KERNELS_ENV_VAR)) == "1") {
+        warmupKernels(context);
+    }
+}
+
+} // namespace cocl
+
+void coclWarmupKernels() {
+    warmupKernels(getThreadVars()->getContext());
+}
@@ -14,31 +14,226 @@
 
 #include "cocl/fill_buffer.h"
 
-#include "cocl/hostside_opencl_funcs.h"
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_device.h"
 
 #include "EasyCL/EasyCL.h"
 
 #include <iostream>
 #include <string>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+using namespace easycl;
 
 namespace cocl {
 
-static std::string get_enqueueFillBuffer_sourcecode();
+static std::string get_fill_sourcecode();
+
+// how many workgroups per compute unit, for the grid-stride loops. enough to keep each compute
+// unit busy, without launching a workgroup per element, for big fills
+static const int WORKGROUPS_PER_COMPUTE_UNIT = 8;
+
+static cl_kernel createKernel(cl_program program, const char *name) {
+    cl_int err;
+    cl_kernel kernel = clCreateKernel(program, name, &err);
+    EasyCL::checkError(err);
+    return kernel;
+}
+
+FillEngine::FillEngine(Context *context) :
+        context(context) {
+    EasyCL *cl = context->getCl();
+    cl_device_id deviceId = cl->device;
+
+    workgroupSize = 256;
+    size_t maxWorkgroupSize = getDeviceInfoInt64(deviceId, CL_DEVICE_MAX_WORK_GROUP_SIZE);
+    if(workgroupSize > maxWorkgroupSize) {
+        workgroupSize = maxWorkgroupSize;
+    }
+    maxWorkgroups = getDeviceInfoInt(deviceId, CL_DEVICE_MAX_COMPUTE_UNITS) * WORKGROUPS_PER_COMPUTE_UNIT;
+
+    std::string source = get_fill_sourcecode();
+    const char *sourceChars = source.c_str();
+    size_t sourceLength = source.size();
+    cl_int err;
+    program = clCreateProgramWithSource(*cl->context, 1, &sourceChars, &sourceLength, &err);
+    EasyCL::checkError(err);
+    err = clBuildProgram(program, 1, &deviceId, "", 0, 0);
+    if(err != CL_SUCCESS) {
+        char buildLog[10240];
+        buildLog[0] = 0;
+        clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, sizeof(buildLog), buildLog, 0);
+        cout << "FillEngine failed to build fill kernels:" << endl;
+        cout << buildLog << endl;
+        EasyCL::checkError(err);
+    }
+    fillUlongKernel = createKernel(program, "fill_ulong");
+    fillUint4Kernel = createKernel(program, "fill_uint4");
+    fillRectKernel = createKernel(program, "fill_rect");
+}
+
+FillEngine::~FillEngine() {
+    clReleaseKernel(fillUlongKernel);
+    clReleaseKernel(fillUint4Kernel);
+    clReleaseKernel(fillRectKernel);
+    clReleaseProgram(program);
+}
+
+void FillEngine::fill(cl_command_queue queue, cl_mem clmem, const void *pattern, int patternBytes,
+        size_t offsetBytes, size_t countBytes) {
+    if(patternBytes != 1 && patternBytes != 2 && patternBytes != 4 && patternBytes != 8) {
+        cout << "FillEngine::fill: patternBytes should be 1, 2, 4 or 8, but was " << patternBytes << endl;
+        throw runtime_error("FillEngine::fill: patternBytes should be 1, 2, 4 or 8");
+    }
+    if(countBytes == 0) {
+        return;
+    }
+    if(countBytes < minKernelBytes) {
+        cl_int err = clEnqueueFillBuffer(queue, clmem, pattern, patternBytes, offsetBytes, countBytes, 0, 0, 0);
+        EasyCL::checkError(err);
+        return;
+    }
+    // the kernels index the pattern by absolute byte position, modulo 16, so repeat it out to 16
+    // bytes. since offsetBytes is a multiple of patternBytes, the phase works out
+    unsigned int pattern16[4];
+    for(int i = 0; i < 16; i += patternBytes) {
+        memcpy((char *)pattern16 + i, pattern, patternBytes);
+    }
+    if(countBytes >= minUint4Bytes) {
+        runFillKernel(queue, fillUint4Kernel, 16, clmem, pattern16, offsetBytes, countBytes);
+    } else {
+        runFillKernel(queue, fillUlongKernel, 8, clmem, pattern16, offsetBytes, countBytes);
+    }
+}
+
+size_t FillEngine::getFillGlobalSize(int elementBytes, size_t countBytes) {
+    size_t numElements = countBytes / elementBytes + 1;
+    size_t numWorkgroups = (numElements + workgroupSize - 1) / workgroupSize;
+    if(numWorkgroups > maxWorkgroups) {
+        numWorkgroups = maxWorkgroups;
+    }
+    return numWorkgroups * workgroupSize;
+}
+
+static void setFillArgs(cl_kernel kernel, cl_mem clmem, const unsigned int *pattern16, size_t offsetBytes,
+        size_t countBytes) {
+    cl_ulong offset = offsetBytes;
+    cl_ulong count = countBytes;
+    cl_int err;
+    err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &clmem);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(kernel, 1, sizeof(cl_ulong), &offset);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(kernel, 2, sizeof(cl_ulong), &count);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(kernel, 3, sizeof(unsigned int) * 4, pattern16);
+    EasyCL::checkError(err);
+}
+
+void FillEngine::runFillKernel(cl_command_queue queue, cl_kernel kernel, int elementBytes, cl_mem clmem,
+        const unsigned int *pattern16, size_t offsetBytes, size_t countBytes) {
+    size_t globalSize = getFillGlobalSize(elementBytes, countBytes);
+
+    std::lock_guard<std::mutex> lock(mu);
+    setFillArgs(kernel, clmem, pattern16, offsetBytes, countBytes);
+    cl_int err = clEnqueueNDRangeKernel(queue, kernel, 1, 0, &globalSize, &workgroupSize, 0, 0, 0);
+    EasyCL::checkError(err);
+}
+
+void FillEngine::prepareFill(PreparedFill *fill, cl_mem clmem, unsigned char value, size_t offsetBytes,
+        size_t countBytes) {
+    if(fill->kernel != 0) {
+        clReleaseKernel(fill->kernel);
+        fill->kernel = 0;
+    }
+    fill->clmem = clmem;
+    fill->offsetBytes = offsetBytes;
+    fill->countBytes = countBytes;
+    fill->value = value;
+    if(countBytes < minKernelBytes) {
+        return;
+    }
+    // same kernel choice as fill(). the kernel is the fill's own, so no one else touches its args
+    int elementBytes = countBytes >= minUint4Bytes ? 16 : 8;
+    fill->kernel = createKernel(program, elementBytes == 16 ? "fill_uint4" : "fill_ulong");
+    fill->globalSize = getFillGlobalSize(elementBytes, countBytes);
+    fill->workgroupSize = workgroupSize;
+    unsigned int pattern16[4];
+    memset(pattern16, value, sizeof(pattern16));
+    setFillArgs(fill->kernel, clmem, pattern16, offsetBytes, countBytes);
+}
+
+PreparedFill::PreparedFill() :
+        kernel(0), globalSize(0), workgroupSize(0), clmem(0), offsetBytes(0), countBytes(0), value(0) {
+}
 
-inline int getNumThreads() {
-  // int blockSize = 1024;
-  // int maxWorkgroupSize = ((easycl::DeviceInfo *)state->deviceInfoByDevice[state->currentDevice])->maxWorkGroupSize;
-  // if( blockSize > maxWorkgroupSize ) {
-  //   blockSize = maxWorkgroupSize;
-  // }
-  // return blockSize;
-    return 256; // just hardcode to 256 for now, which covers amd, intel, nvidia, just not always most efficiently, but
-                // kind of ok
+PreparedFill::~PreparedFill() {
+    if(kernel != 0) {
+        clReleaseKernel(kernel);
+    }
 }
 
-// CL: number of blocks for threads.
-inline int GET_BLOCKS(const int N) {
-  return (N + getNumThreads() - 1) / getNumThreads();
+void PreparedFill::enqueue(cl_command_queue queue) const {
+    if(countBytes == 0) {
+        return;
+    }
+    cl_int err;
+    if(kernel == 0) {
+        err = clEnqueueFillBuffer(queue, clmem, &value, 1, offsetBytes, countBytes, 0, 0, 0);
+    } else {
+        err = clEnqueueNDRangeKernel(queue, kernel, 1, 0, &globalSize, &workgroupSize, 0, 0, 0);
+    }
+    EasyCL::checkError(err);
+}
+
+void FillEngine::fill2D(cl_command_queue queue, cl_mem clmem, unsigned char value, size_t offsetBytes,
+        size_t pitch, size_t width, size_t height) {
+    if(width == 0 || height == 0) {
+        return;
+    }
+    if(pitch == width || height == 1) {
+        fill(queue, clmem, &value, 1, offsetBytes, width * height);
+        return;
+    }
+    size_t numWorkgroups = (width * height + workgroupSize - 1) / workgroupSize;
+    if(numWorkgroups > maxWorkgroups) {
+        numWorkgroups = maxWorkgroups;
+    }
+    size_t globalSize = numWorkgroups * workgroupSize;
+    cl_ulong offset = offsetBytes;
+    cl_ulong clPitch = pitch;
+    cl_ulong clWidth = width;
+    cl_ulong clHeight = height;
+    cl_uchar clValue = value;
+
+    std::lock_guard<std::mutex> lock(mu);
+    cl_int err;
+    err = clSetKernelArg(fillRectKernel, 0, sizeof(cl_mem), &clmem);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(fillRectKernel, 1, sizeof(cl_ulong), &offset);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(fillRectKernel, 2, sizeof(cl_ulong), &clPitch);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(fillRectKernel, 3, sizeof(cl_ulong), &clWidth);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(fillRectKernel, 4, sizeof(cl_ulong), &clHeight);
+    EasyCL::checkError(err);
+    err = clSetKernelArg(fillRectKernel, 5, sizeof(cl_uchar), &clValue);
+    EasyCL::checkError(err);
+    err = clEnqueueNDRangeKernel(queue, fillRectKernel, 1, 0, &globalSize, &workgroupSize, 0, 0, 0);
+    EasyCL::checkError(err);
+}
+
+FillEngine *getFillEngine() {
+    ThreadVars *v = getThreadVars();
+    Context *context = v->getContext();
+    ContextMutex contextMutex(context);
+    if(!context->fillEngine) {
+        context->fillEngine.reset(new FillEngine(context));
+    }
+    return context->fillEngine.get();
 }
 
 int myEnqueueFillBuffer(
@@ -46,42 +241,66 @@ int myEnqueueFillBuffer(
     cl_mem clmem,
     unsigned int value,
     int offsetBytes, int countInts) {
+    getFillEngine()->fill(queue, clmem, &value, sizeof(unsigned int), offsetBytes, (size_t)countInts * 4);
+    return 0;
+}
 
-    easycl::CLKernel *kernel = compileOpenCLKernel("enqueueFillBuffer", get_enqueueFillBuffer_sourcecode());
-
-    kernel->inout(&clmem);
-    kernel->in((int32_t)(offsetBytes >> 2));
-
-    kernel->in((int32_t)countInts);
-    kernel->in(value);
-
-    int workgroupSize = getNumThreads();
-    int globalSize = GET_BLOCKS(countInts) * workgroupSize;
-    kernel->run_1d(&queue, globalSize, workgroupSize);
+int myEnqueueFillBufferBytes(
+    cl_command_queue queue,
+    cl_mem clmem,
+    unsigned char value,
+    size_t offsetBytes, size_t countBytes) {
+    getFillEngine()->fill(queue, clmem, &value, sizeof(unsigned char), offsetBytes, countBytes);
     return 0;
 }
 
-// this shouldnt be necessary, since clEnqueueFillBuffer should do this, but
-// clEnqueueFillBuffer fails for me on Radeon Pro 450, eg see
-// http://stackoverflow.com/questions/38556710/clenqueuefillbuffer-fills-a-buffer-correctly-only-at-random/43727913#43727913
-std::string get_enqueueFillBuffer_sourcecode() {
+// we use our own kernels for big fills, since clEnqueueFillBuffer writes one pattern at a time,
+// which is slow for single-byte patterns. for fills under FillEngine::minKernelBytes, launching a
+// kernel costs more than that, so those go to clEnqueueFillBuffer
+std::string get_fill_sourcecode() {
     return R"(
-// CL: grid stride looping
-#define CL_KERNEL_LOOP(i, n)                        \
-  for (int i = get_group_id(0) * get_local_size(0) + get_local_id(0); \
-      i < (n);                                       \
-      i += get_local_size(0) * get_num_groups(0))
-
-kernel void enqueueFillBuffer(
-        global unsigned int *target_data, const int target_offset,
-        const int N,
-        unsigned int value) {
-    global unsigned int *target = target_data + target_offset;
-  CL_KERNEL_LOOP(n, N) {
-    if(n < N) {
-        target[n] = value;
-    }
-  }
+// byte pos of the (16-byte) pattern, where pos is the absolute position in the buffer
+inline unsigned char patternByte(const uint4 pattern, ulong pos) {
+    uint word = (pos & 8) ? ((pos & 4) ? pattern.w : pattern.z) : ((pos & 4) ? pattern.y : pattern.x);
+    return (word >> ((pos & 3) * 8)) & 255;
+}
+
+// fills N bytes from offset. body is the aligned part, written as T; the head and tail on either side
+// are written a byte at a time
+#define DEFINE_FILL_KERNEL(NAME, T, VALUE) \
+kernel void NAME(global unsigned char *data, const ulong offset, const ulong N, const uint4 pattern) { \
+    ulong headBytes = (sizeof(T) - (offset & (sizeof(T) - 1))) & (sizeof(T) - 1); \
+    if(headBytes > N) { \
+        headBytes = N; \
+    } \
+    ulong bodyCount = (N - headBytes) / sizeof(T); \
+    ulong tailStart = headBytes + bodyCount * sizeof(T); \
+    ulong tid = get_global_id(0); \
+    if(tid < headBytes) { \
+        data[offset + tid] = patternByte(pattern, offset + tid); \
+    } \
+    if(tid < N - tailStart) { \
+        data[offset + tailStart + tid] = patternByte(pattern, offset + tailStart + tid); \
+    } \
+    global T *body = (global T *)(data + offset + headBytes); \
+    const T value = VALUE; \
+    for(ulong n = tid; n < bodyCount; n += get_global_size(0)) { \
+        body[n] = value; \
+    } \
+}
+
+DEFINE_FILL_KERNEL(fill_ulong, ulong, as_ulong(pattern.xy))
+DEFINE_FILL_KERNEL(fill_uint4, uint4, pattern)
+
+// fills width bytes in each of height rows, starting pitch bytes apart
+kernel void fill_rect(global unsigned char *data, const ulong offset, const ulong pitch,
+        const ulong width, const ulong height, const unsigned char value) {
+    ulong N = width * height;
+    for(ulong n = get_global_id(0); n < N; n += get_global_size(0)) {
+        ulong row = n / width;
+        ulong col = n - row * width;
+        data[offset + row * pitch + col] = value;
+    }
 }
 )";
 }
@@ -19,8 +19,10 @@
 #include "cocl/basicblockdumper.h"
 #include "EasyCL/util/easycl_stringhelper.h"
 #include "cocl/new_instruction_dumper.h"
+#include "cocl/readIR.h"
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 
 #include <sstream>
 
@@ -180,16 +182,67 @@ void FunctionDumper::addPHIDeclaration(llvm::PHINode *phi) {
     phiDeclarationsByName[name] = declaration;
 }
 
+// extern __shared__ arrays all start at the dynamicShared kernel parameter, like in cuda. so each
+// one becomes a local pointer onto that
 std::vector<std::string> FunctionDumper::dumpSharedDefinition(llvm::Value *value) {
     std::vector<std::string> declarations;
+    if(!ReadIR::isDynamicShared(value)) {
+        return declarations;
+    }
+    Type *elementType = cast<GlobalVariable>(value)->getValueType();
+    if(ArrayType *arrayType = dyn_cast<ArrayType>(elementType)) {
+        elementType = arrayType->getElementType();
+    }
+    string typeString = "local " + typeDumper->dumpType(elementType) + "*";
+    string name = localValueInfos.at(value)->name;
+    declarations.push_back(typeString + " " + name + " = (" + typeString + ")pGlobalVars->dynamicShared");
     return declarations;
 }
 
 std::string FunctionDumper::dumpSharedDefinitions(std::string indent) {
     ostringstream oss;
+    vector<string> declarations;
+    for(auto it = localValueInfos.begin(); it != localValueInfos.end(); it++) {
+        vector<string> valueDeclarations = dumpSharedDefinition(it->first);
+        declarations.insert(declarations.end(), valueDeclarations.begin(), valueDeclarations.end());
+    }
+    std::sort(declarations.begin(), declarations.end());
+    for(auto it=declarations.begin(); it != declarations.end(); it++) {
+        oss << indent << *it << ";\n";
+    }
     return oss.str();
 }
 
+int FunctionDumper::countKernelClmemArgs(llvm::Function *F) {
+    // has to match the clmemArgIndex bookkeeping in dumpKernelFunctionDeclarationWithoutReturn
+    int numClmemArgs = 0;
+    for(auto it=F->arg_begin(); it != F->arg_end(); it++) {
+        PointerType *ptrType = dyn_cast<PointerType>(it->getType());
+        if(ptrType == 0) {
+            continue;
+        }
+        StructType *structType = dyn_cast<StructType>(ptrType->getElementType());
+        if(structType == 0 || structType->getName().str() == "struct.float4") {
+            numClmemArgs++;
+            continue;
+        }
+        unique_ptr<StructInfo> structInfo(new StructInfo());
+        StructCloner::walkStructType(F->getParent(), structInfo.get(), 0, 0, std::vector<int>(), "", structType);
+        if(structInfo->pointerInfos.size() == 0) {
+            numClmemArgs++;
+            continue;
+        }
+        numClmemArgs++; // the _nopointers struct
+        for(auto pointerit=structInfo->pointerInfos.begin(); pointerit != structInfo->pointerInfos.end(); pointerit++) {
+            Type *pointerElementType = cast<PointerType>((*pointerit)->type)->getElementType();
+            if(pointerElementType->getPrimitiveSizeInBits() != 0) {
+                numClmemArgs++;
+            }
+        }
+    }
+    return numClmemArgs;
+}
+
 std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Function *F) {
     std::ostringstream declaration;
     shimCode = "";
@@ -298,10 +351,21 @@ std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Fun
         }
         i++;
     }
-    if(i > 0) {
-        declaration << ", ";
+    numClmemArgs = clmemArgIndex;
+    vector<string> localParams;
+    if(!_dropScratch) {
+        localParams.push_back("local int *scratch");
+    }
+    if(_addDynamicShared) {
+        localParams.push_back("local char *dynamicShared");
+    }
+    for(auto it=localParams.begin(); it != localParams.end(); it++) {
+        if(i > 0) {
+            declaration << ", ";
+        }
+        declaration << *it;
+        i++;
     }
-    declaration << "local int *scratch";
     declaration << ")";
     return declaration.str();
 }
@@ -499,7 +563,11 @@ void FunctionDumper::toCl(ostream &os) {
         os << shimCode << "\n";
     }
     if(isKernel) {
-    os << R"(    const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };
+    os << "    const struct GlobalVars globalVars = { " << (_dropScratch ? "0" : "scratch") << ", clmem0, clmem_vmem_offset0";
+    if(_addDynamicShared) {
+        os << ", dynamicShared";
+    }
+    os << R"( };
     const struct GlobalVars* const pGlobalVars = &globalVars;
 
 )";
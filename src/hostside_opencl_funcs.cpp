@@ -15,9 +15,13 @@
 #include "cocl/hostside_opencl_funcs_ext.h"
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_memory.h"
+#include "cocl/cocl_slab_allocator.h"
+#include "cocl/cocl_arg_ring_buffer.h"
 #include "cocl/cocl_clsources.h"
 #include "cocl/cocl_streams.h"
 #include "cocl/cocl_funcs.h"
+#include "cocl/cocl_graph.h"
+#include "cocl/cocl_kernel_disk_cache.h"
 
 #include <iostream>
 #include <memory>
@@ -25,7 +29,11 @@
 #include <map>
 #include <set>
 #include <cstdlib>
+#include <cstring>
 #include <mutex>
+#include <future>
+#include <functional>
+#include <algorithm>
 
 #include "EasyCL/EasyCL.h"
 #include "EasyCL/util/easycl_stringhelper.h"
@@ -63,24 +71,45 @@ void hostside_opencl_funcs_assure_initialized(void) {
 }
 
 namespace cocl {
-    // this lock works as follows:
-    // - configureKernel takes out a lock, and does not release it. This first level of locking will remain locked, until
-    //   the kernelGo funcgtion is called, and completed
-    // - then, each setArg etc method takes out an additional level of locking, in case they are called in parallel
-    //   (this second level might not be stricly necessary, I'm not sure...)
-    //   this second level is per-call, released at hte end
-    // - finally, kernelGo is called, takes out a second-level lock, then at the end releases both levels
-    //
-    // I suppose we could do this with two standard locks, rather than one recursive one. Might be easier to udnerstand/read
-    // in fact
-    std::recursive_mutex launchMutex;
+    // the launch being built is per-thread, in ThreadVars, so there's no lock around a launch as a
+    // whole. what we do lock:
+    // - the context's kernel caches, via Context::kernelCacheMutex
+    // - setting args on a kernel, and running it, via StreamKernel::mu. each stream has its own
+    //   clone of each kernel, so thats only contended by threads sharing a stream
+    // generating and building kernels, on a cache miss, happens outside the cache lock, and without
+    // any other lock, so several kernels can be generated and built at once, eg for
+    // coclWarmupKernels. each thread translates in its own LLVMContext, see
+    // convertEmbeddedLlStringToCl. Context::kernelsBeingBuilt makes sure each is only built once
+
+    static LaunchConfiguration &getLaunchConfiguration() {
+        ThreadVars *v = getThreadVars();
+        if(!v->launchConfiguration) {
+            v->launchConfiguration.reset(new LaunchConfiguration());
+            v->debugDumper.reset(new DebugDumper(v->launchConfiguration.get()));
+        }
+        return *v->launchConfiguration;
+    }
+
+    // ready for the next launch on this thread. drops any args left over from a launch that threw
+    static void clearLaunchArgs(LaunchConfiguration &launchConfiguration) {
+        for(auto it=launchConfiguration.kernelArgsToBeReleased.begin(); it != launchConfiguration.kernelArgsToBeReleased.end(); it++) {
+            cl_int err = clReleaseMemObject(*it);
+            EasyCL::checkError(err);
+        }
+        launchConfiguration.kernelArgsToBeReleased.clear();
+        launchConfiguration.args.clear();
+
+        launchConfiguration.firstClmem = 0;
+        launchConfiguration.clmemByClmemArgIndex.clear();
+        launchConfiguration.clmemIndexByClmem.clear();
+        launchConfiguration.clmems.clear();
+        launchConfiguration.clmemIndexByClmemArgIndex.clear();
+        launchConfiguration.pointerArgs.clear();
+    }
 }
 
 using namespace cocl;
 
-static LaunchConfiguration launchConfiguration;
-static DebugDumper debugDumper(&launchConfiguration);
-
 std::unique_ptr< ArgStore_base > g_arg;
 
 size_t cuInit(unsigned int flags) {
@@ -90,19 +119,13 @@ size_t cuInit(unsigned int flags) {
 int cudaConfigureCall(
         dim3 grid,
         dim3 block, long long sharedMem, char *queue_as_voidstar) {
-    // pthread_mutex_lock(&launchMutex);
-    // std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    launchMutex.lock();
+    LaunchConfiguration &launchConfiguration = getLaunchConfiguration();
     CoclStream *coclStream = (CoclStream *)queue_as_voidstar;
     ThreadVars *v = getThreadVars();
     if(coclStream == 0) {
         coclStream = v->currentContext->default_stream.get();
     }
     CLQueue *clqueue = coclStream->clqueue;
-    if(sharedMem != 0) {
-        COCL_PRINT("cudaConfigureCall: Not implemented: non-zero shared memory");
-        throw runtime_error("cudaConfigureCall: Not implemented: non-zero shared memory");
-    }
     int grid_x = grid.x;
     int grid_y = grid.y;
     int grid_z = grid.z;
@@ -114,6 +137,7 @@ int cudaConfigureCall(
 
     launchConfiguration.queue = clqueue;
     launchConfiguration.coclStream = coclStream;
+    launchConfiguration.sharedMem = sharedMem;
     launchConfiguration.grid[0] = grid_x;
     launchConfiguration.grid[1] = grid_y;
     launchConfiguration.grid[2] = grid_z;
@@ -125,26 +149,155 @@ int cudaConfigureCall(
 
 namespace cocl {
 
-std::string Int32Arg::str() {
-    ostringstream oss;
-    oss << "Int32Arg=" << v;
-    return oss.str();
+void LaunchArgs::add(ArgType type, const void *value, int bytes) {
+    if(numArgs >= maxArgs || numBytes + bytes > maxBytes) {
+        cout << "LaunchArgs: too many kernel args, max is " << maxArgs << endl;
+        throw runtime_error("LaunchArgs: too many kernel args");
+    }
+    types[numArgs] = type;
+    sizes[numArgs] = bytes;
+    offsets[numArgs] = numBytes;
+    memcpy(data + numBytes, value, bytes);
+    numArgs++;
+    // keep each value aligned for its type
+    numBytes += (bytes + 7) & ~7;
 }
 
-std::string Int64Arg::str() {
+int64_t LaunchArgs::getInteger(int i) const {
+    switch(types[i]) {
+        case AT_Int8:
+            return *(const char *)getValue(i);
+        case AT_Int32:
+            return *(const int32_t *)getValue(i);
+        case AT_UInt32:
+            return *(const uint32_t *)getValue(i);
+        case AT_Int64:
+            return *(const int64_t *)getValue(i);
+        default:
+            throw runtime_error("LaunchArgs::getInteger: arg " + easycl::toString(i) + " is not an integer");
+    }
+}
+
+std::string LaunchArgs::str(int i) const {
     ostringstream oss;
-    oss << "Int64Arg=" << v;
+    switch(types[i]) {
+        case AT_Int8:
+            oss << "Int8Arg=" << (int)*(const char *)getValue(i);
+            break;
+        case AT_Int32:
+            oss << "Int32Arg=" << getInteger(i);
+            break;
+        case AT_UInt32:
+            oss << "UInt32Arg=" << getInteger(i);
+            break;
+        case AT_Int64:
+            oss << "Int64Arg=" << getInteger(i);
+            break;
+        case AT_Float:
+            oss << "FloatArg=" << *(const float *)getValue(i);
+            break;
+    }
     return oss.str();
 }
 
 int32_t getNumCachedKernels() {
-    return getThreadVars()->getContext()->kernelCache.size();
+    Context *context = getThreadVars()->getContext();
+    std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+    return context->kernelCacheById.size() + context->kernelCache.size();
 }
 
 int32_t getNumKernelCalls() {
-    return getThreadVars()->getContext()->numKernelCalls;
+    Context *context = getThreadVars()->getContext();
+    std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+    return context->numKernelCalls;
+}
+
+int64_t getNumKernelCacheHits() {
+    Context *context = getThreadVars()->getContext();
+    std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+    return context->numKernelCacheHits;
+}
+
+int64_t getNumKernelCacheMisses() {
+    Context *context = getThreadVars()->getContext();
+    std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+    return context->numKernelCacheMisses;
+}
+
+int64_t getNumKernelDiskCacheHits() {
+    Context *context = getThreadVars()->getContext();
+    return context->kernelDiskCache ? context->kernelDiskCache->numHits.load() : 0;
+}
+
+int64_t getNumKernelDiskCacheMisses() {
+    Context *context = getThreadVars()->getContext();
+    return context->kernelDiskCache ? context->kernelDiskCache->numMisses.load() : 0;
+}
+
+int64_t getNumPrebuiltKernelsUsed() {
+    return getThreadVars()->getContext()->numPrebuiltKernelsUsed.load();
+}
+
+int64_t getNumKernelsGenerated() {
+    return getThreadVars()->getContext()->numKernelsGenerated.load();
+}
+
+StreamKernel::StreamKernel(CLKernel *clKernel) {
+    cl_int err;
+    kernel = clCreateKernel(clKernel->program, clKernel->kernelName.c_str(), &err);
+    EasyCL::checkError(err);
+}
+
+StreamKernel::~StreamKernel() {
+    clReleaseKernel(kernel);
+}
+
+void StreamKernel::setArg(cl_uint argIndex, size_t size, const void *value) {
+    if(argIndex >= argStates.size()) {
+        argStates.resize(argIndex + 1);
+    }
+    ArgState &state = argStates[argIndex];
+    bool isLocal = value == 0;
+    if(state.size == size && state.isLocal == isLocal &&
+            (isLocal || memcmp(&state.value, value, size) == 0)) {
+        return;
+    }
+    cl_int err = clSetKernelArg(kernel, argIndex, size, value);
+    EasyCL::checkError(err);
+    numClSetKernelArgCalls++;
+    if(size > sizeof(state.value)) {
+        // too big to remember, so we'll just set it every time
+        state.size = 0;
+        return;
+    }
+    state.size = size;
+    state.isLocal = isLocal;
+    if(!isLocal) {
+        memcpy(&state.value, value, size);
+    }
+}
+
+void StreamKernel::setMemArg(cl_uint argIndex, cl_mem clmem) {
+    if(argIndex >= argStates.size()) {
+        argStates.resize(argIndex + 1);
+    }
+    cl_int err = clSetKernelArg(kernel, argIndex, sizeof(cl_mem), &clmem);
+    EasyCL::checkError(err);
+    numClSetKernelArgCalls++;
+    argStates[argIndex].size = 0;
+}
+
+size_t KernelCacheKeyHash::operator()(const KernelCacheKey &key) const {
+    size_t hash = std::hash<int32_t>()(key.kernelId);
+    hash = hash * 31 + key.uniqueClmemCount;
+    for(auto it=key.clmemIndexByClmemArgIndex.begin(); it != key.clmemIndexByClmemArgIndex.end(); it++) {
+        hash = hash * 31 + *it;
+    }
+    return hash;
 }
 
+static CLKernel *buildOpenCLKernel(Context *context, string uniqueKernelName, string shortKernelName, string clSourcecode);
+
 CLKernel *compileOpenCLKernel(string originalKernelName, string clSourcecode) {
     return compileOpenCLKernel(originalKernelName, originalKernelName, originalKernelName, clSourcecode);
 }
@@ -155,16 +308,26 @@ CLKernel *compileOpenCLKernel(string originalKernelName, string uniqueKernelName
     // (opencl generation has already happened prior to this function)
 
     ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
-    ofstream f;
+    std::lock_guard<std::mutex> lock(v->getContext()->kernelCacheMutex);
     v->getContext()->numKernelCalls++;
     if(v->getContext()->kernelCache.find(uniqueKernelName) != v->getContext()->kernelCache.end()) {
         return v->getContext()->kernelCache[uniqueKernelName];
     }
-    // compile the kernel.  we are still locking the mutex, but I cnat think of a better
-    // way right now...
+    // compile the kernel.  we are still holding the cache lock, so other threads on this context
+    // wait for us, rather than compiling the same kernel again
+    CLKernel *kernel = buildOpenCLKernel(v->getContext(), uniqueKernelName, shortKernelName, clSourcecode);
+    v->getContext()->getCl()->storeKernel(uniqueKernelName, kernel, true);  // this will cause the kernel to be deleted with cl.  Not clean yet, but a start
+    v->getContext()->kernelCache[uniqueKernelName] = kernel;
+    return kernel;
+}
+
+static CLKernel *buildOpenCLKernel(Context *context, string uniqueKernelName, string shortKernelName, string clSourcecode) {
+    // builds clSourcecode. doesnt need the kernelCacheMutex, so kernels can be built in parallel. the
+    // caller should hand the kernel to the EasyCL, with storeKernel, so it's deleted with the EasyCL
 
-    string filename = "/tmp/" + easycl::toString(v->getContext()->kernelCache.size()) + ".cl";
+    EasyCL *cl = context->getCl();
+    ofstream f;
+    string filename = "/tmp/" + easycl::toString(context->nextClDumpIndex++) + ".cl";
     if(getenv("COCL_LOAD_CL") != 0) {
         cout << "loading cl sourcecode from " << filename << endl;
         ifstream f;
@@ -204,61 +367,103 @@ CLKernel *compileOpenCLKernel(string originalKernelName, string uniqueKernelName
 
         throw e;
     }
-    v->getContext()->kernelCache[uniqueKernelName] = kernel;
-    cl->storeKernel(uniqueKernelName, kernel, true);  // this will cause the kernel to be deleted with cl.  Not clean yet, but a start
     return kernel;
 }
 
+static string makeUniqueKernelName(const string &origKernelName, const std::vector<int> &clmemIndexByClmemArgIndex, size_t numClmemArgs) {
+    std::ostringstream uniqueKernelName_ss;
+    uniqueKernelName_ss << origKernelName;
+    for(size_t i = 0; i < numClmemArgs; i++) {
+        uniqueKernelName_ss << "_" << clmemIndexByClmemArgIndex[i];
+    }
+    return uniqueKernelName_ss.str();
+}
+
+static GenerateOpenCLResult makeGenerateOpenCLResult(const string &origKernelName, const string &shortKernelName,
+        const std::vector<int> &clmemIndexByClmemArgIndex, const ModuleClRes &res, const string &diskCacheKey) {
+    KernelInfo kernelInfo;
+    kernelInfo.usesVmem = res.usesVmem;
+    kernelInfo.usesScratch = res.usesScratch;
+    kernelInfo.usesDynamicShared = res.usesDynamicShared;
+    kernelInfo.numClmemArgs = res.numClmemArgs;
+    // callers that dont know how many pointer args the kernel has, eg cudaOccupancy*, pass
+    // clmemIndexByClmemArgIndex longer than it needs to be. name the kernel as a launch would
+    string uniqueKernelName = makeUniqueKernelName(
+        origKernelName, clmemIndexByClmemArgIndex, std::min<size_t>(clmemIndexByClmemArgIndex.size(), res.numClmemArgs));
+    string clSourcecode = "// origKernelName: " + origKernelName + "\n" +
+        "// uniqueKernelName: " + uniqueKernelName + "\n" +
+        "// shortKernelName: " + shortKernelName + "\n" +
+        "\n" +
+        res.clSourcecode;
+    return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName, kernelInfo, diskCacheKey };
+}
+
 GenerateOpenCLResult generateOpenCL(
-        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, string devicellsourcecode) {
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, const char *devicellsourcecode) {
     // generates OpenCL source-code, based on passed-in bytecode
-    // returns cached source-code if available
+    // caching is up to the caller, see kernelGo
 
     ThreadVars *v = getThreadVars();
 
     ofstream f;
-    launchConfiguration.shortKernelName = origKernelName.substr(0, 20);
-
-    std::ostringstream uniqueKernelName_ss;
-    uniqueKernelName_ss << origKernelName;
-    for(int i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
-        uniqueKernelName_ss << "_" << clmemIndexByClmemArgIndex[i];
+    string shortKernelName = origKernelName.substr(0, 20);
+
+    string uniqueKernelName = makeUniqueKernelName(origKernelName, clmemIndexByClmemArgIndex, clmemIndexByClmemArgIndex.size());
+
+    // COCL_LOAD_CL replaces the opencl we build, so we shouldnt use, or store, cached binaries
+    KernelDiskCache *diskCache = getenv("COCL_LOAD_CL") == 0 ? v->getContext()->kernelDiskCache.get() : 0;
+    string diskCacheKey = "";
+    if(diskCache != 0) {
+        diskCacheKey = diskCache->makeKey(
+            devicellsourcecode, origKernelName, uniqueClmemCount, clmemIndexByClmemArgIndex, v->offsets_32bit);
+        KernelDiskCacheEntry cached;
+        if(diskCache->load(diskCacheKey, &cached)) {
+            uniqueKernelName = makeUniqueKernelName(
+                origKernelName, clmemIndexByClmemArgIndex, std::min<size_t>(clmemIndexByClmemArgIndex.size(), cached.kernelInfo.numClmemArgs));
+            return GenerateOpenCLResult { cached.clSourcecode, origKernelName, shortKernelName, uniqueKernelName,
+                cached.kernelInfo, diskCacheKey, cached.programBinary };
+        }
     }
-    launchConfiguration.uniqueKernelName = uniqueKernelName_ss.str();
-    if(v->getContext()->clSourceCodeCache.find(launchConfiguration.uniqueKernelName) != v->getContext()->clSourceCodeCache.end()) {
-        std::string clSourcecode = v->getContext()->clSourceCodeCache[launchConfiguration.uniqueKernelName];
-        return GenerateOpenCLResult { clSourcecode, origKernelName, launchConfiguration.shortKernelName, launchConfiguration.uniqueKernelName };
+
+    // cocl --aot generates the opencl for the usual clmem patterns when the program is built, so
+    // we only need llvm for unusual ones
+    PrebuiltKernel prebuiltKernel;
+    if(findPrebuiltKernel(devicellsourcecode, origKernelName, uniqueClmemCount, clmemIndexByClmemArgIndex, v->offsets_32bit, &prebuiltKernel)) {
+        COCL_PRINT("using opencl generated at build time for " << uniqueKernelName);
+        v->getContext()->numPrebuiltKernelsUsed++;
+        ModuleClRes res;
+        res.clSourcecode = prebuiltKernel.clSourcecode;
+        res.usesVmem = prebuiltKernel.usesVmem;
+        res.usesScratch = prebuiltKernel.usesScratch;
+        res.usesDynamicShared = prebuiltKernel.usesDynamicShared;
+        res.numClmemArgs = prebuiltKernel.numClmemArgs;
+        return makeGenerateOpenCLResult(origKernelName, shortKernelName, clmemIndexByClmemArgIndex, res, diskCacheKey);
     }
 
     // convert to opencl first... based on the kernel name required
     try {
-        string filename = "/tmp/" + easycl::toString(v->getContext()->clSourceCodeCache.size()) + "-device.ll";
         if(getenv("COCL_DUMP_BYTECODE") != 0) {
+            size_t numCached = 0;
+            {
+                std::lock_guard<std::mutex> lock(v->getContext()->kernelCacheMutex);
+                numCached = v->getContext()->kernelCacheById.size();
+            }
+            string filename = "/tmp/" + easycl::toString(numCached) + "-device.ll";
             cout << "saving deviceside bytecode to " << filename << endl;
             ofstream f;
             f.open(filename, ios_base::out);
             f << devicellsourcecode << endl;
             f.close();
         }
-        ModuleClRes res = convertLlStringToCl(
-            uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, launchConfiguration.shortKernelName, v->offsets_32bit);
-        std::string clSourcecode = res.clSourcecode;
-        KernelInfo kernelInfo;
-        kernelInfo.usesVmem = res.usesVmem;
-        kernelInfo.usesScratch = res.usesScratch;
-        clSourcecode = "// origKernelName: " + origKernelName + "\n" +
-            "// uniqueKernelName: " + launchConfiguration.uniqueKernelName + "\n" +
-            "// shortKernelName: " + launchConfiguration.shortKernelName + "\n" +
-            "\n" +
-            clSourcecode;
-        v->getContext()->clSourceCodeCache[launchConfiguration.uniqueKernelName] = clSourcecode;
-        v->getContext()->kernelInfoByUniqueName[launchConfiguration.uniqueKernelName] = kernelInfo;
-        return GenerateOpenCLResult { clSourcecode, origKernelName, launchConfiguration.shortKernelName, launchConfiguration.uniqueKernelName };
+        ModuleClRes res = convertEmbeddedLlStringToCl(
+            uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, shortKernelName, v->offsets_32bit);
+        v->getContext()->numKernelsGenerated++;
+        return makeGenerateOpenCLResult(origKernelName, shortKernelName, clmemIndexByClmemArgIndex, res, diskCacheKey);
     } catch(runtime_error &e) {
         cout << "generateOpenCL failed to generate opencl sourcecode" << endl;
         cout << "kernel name orig=" << origKernelName << endl;
-        cout << "kernel name short=" << launchConfiguration.shortKernelName << endl;
-        cout << "kernel name unique=" << launchConfiguration.uniqueKernelName << endl;
+        cout << "kernel name short=" << shortKernelName << endl;
+        cout << "kernel name unique=" << uniqueKernelName << endl;
         cout << "writing ll to /tmp/failed-kernel.ll" << endl;
         f.open("/tmp/failed-kernel.ll", ios_base::out);
         f << devicellsourcecode << endl;
@@ -267,56 +472,232 @@ GenerateOpenCLResult generateOpenCL(
     }
 }
 
+size_t getScratchBytes(size_t blockX) {
+    // eg __shfl_down_3 reads mem[warpstart + warpsrc], with warpsrc up to 31, even for the last,
+    // partial, warp
+    return (blockX + 31) / 32 * 32 * sizeof(int);
+}
+
+int getNumClmemArgs(string origKernelName, const char *devicellsourcecode) {
+    return getEmbeddedKernelNumClmemArgs(devicellsourcecode, origKernelName);
+}
+
+static StreamKernel *getStreamKernelLocked(KernelCacheEntry &entry, CoclStream *coclStream) {
+    // caller should hold the kernelCacheMutex
+    std::unique_ptr<StreamKernel> &streamKernel = entry.kernelByStream[coclStream];
+    if(!streamKernel) {
+        streamKernel.reset(new StreamKernel(entry.kernel));
+    }
+    return streamKernel.get();
+}
+
+static const KernelCacheEntry &getKernelCacheEntry(Context *context, LaunchConfiguration &launchConfiguration, StreamKernel **pStreamKernel) {
+    // one hash lookup, keyed on the kernel id and the clmem pattern of this launch. on a miss,
+    // generates and builds the kernel. entries are never removed, and unordered_map doesnt move
+    // its elements, so the returned reference stays good
+    // also gets the clone of the kernel for the launch's stream, see StreamKernel, unless
+    // pStreamKernel is 0, eg when capturing, where the graph makes its own
+    KernelCacheKey &key = launchConfiguration.cacheKey;
+    key.kernelId = launchConfiguration.kernelId;
+    key.uniqueClmemCount = launchConfiguration.clmems.size();
+    key.clmemIndexByClmemArgIndex = launchConfiguration.clmemIndexByClmemArgIndex;
+    {
+        std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+        context->numKernelCalls++;
+        auto it = context->kernelCacheById.find(key);
+        if(it != context->kernelCacheById.end()) {
+            context->numKernelCacheHits++;
+            if(pStreamKernel != 0) {
+                *pStreamKernel = getStreamKernelLocked(it->second, launchConfiguration.coclStream);
+            }
+            return it->second;
+        }
+        context->numKernelCacheMisses++;
+    }
+    KernelCacheEntry &entry = getOrBuildKernelCacheEntry(context, key, [&launchConfiguration, &key]() {
+        return generateOpenCL(
+            key.uniqueClmemCount, launchConfiguration.clmemIndexByClmemArgIndex, launchConfiguration.kernelName, launchConfiguration.devicellsourcecode);
+    });
+    if(pStreamKernel != 0) {
+        std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+        *pStreamKernel = getStreamKernelLocked(entry, launchConfiguration.coclStream);
+    }
+    return entry;
+}
+
+static KernelCacheEntry buildKernelCacheEntry(Context *context, const GenerateOpenCLResult &res) {
+    // doesnt need the kernelCacheMutex. the kernel isnt stored with the EasyCL yet, see
+    // addKernelCacheEntryLocked
+    KernelCacheEntry entry;
+    KernelDiskCache *diskCache = context->kernelDiskCache.get();
+    if(res.programBinary.size() > 0) {
+        entry.kernel = KernelDiskCache::buildKernelFromBinary(context->getCl(), res.programBinary, res.shortKernelName, res.clSourcecode);
+        if(entry.kernel == 0) {
+            COCL_PRINT("cached binary for " << res.uniqueKernelName << " rejected by the driver, building from source");
+        }
+    }
+    if(entry.kernel == 0) {
+        entry.kernel = buildOpenCLKernel(context, res.uniqueKernelName, res.shortKernelName, res.clSourcecode);
+        if(diskCache != 0 && res.diskCacheKey != "") {
+            KernelDiskCacheEntry diskEntry;
+            diskEntry.clSourcecode = res.clSourcecode;
+            diskEntry.kernelInfo = res.kernelInfo;
+            diskEntry.programBinary = KernelDiskCache::getProgramBinary(entry.kernel->program);
+            diskCache->store(res.diskCacheKey, diskEntry);
+        }
+    }
+    entry.clSourcecode = res.clSourcecode;
+    entry.kernelInfo = res.kernelInfo;
+    entry.uniqueKernelName = res.uniqueKernelName;
+    return entry;
+}
+
+static KernelCacheEntry &addKernelCacheEntryLocked(Context *context, const KernelCacheKey &key, KernelCacheEntry &&entry) {
+    // caller should hold the kernelCacheMutex
+    auto it = context->kernelCacheById.find(key);
+    if(it != context->kernelCacheById.end()) {
+        delete entry.kernel;
+        return it->second;
+    }
+    // the unique kernel name isnt unique across modules, so the kernel id goes into the name we
+    // store the kernel under
+    string storeName = "kernelid" + easycl::toString(key.kernelId) + "_" + entry.uniqueKernelName;
+    context->getCl()->storeKernel(storeName, entry.kernel, true);  // deleted with the EasyCL
+    return context->kernelCacheById.emplace(key, std::move(entry)).first->second;
+}
+
+KernelCacheEntry &getOrBuildKernelCacheEntry(Context *context, const KernelCacheKey &key, std::function<GenerateOpenCLResult()> generate) {
+    // generates and builds without holding the cache lock, so launches of kernels we already have,
+    // and builds of other kernels, dont wait for us. a thread that wants a kernel another thread is
+    // already building waits on that build's future
+    std::promise<void> built;
+    while(true) {
+        std::shared_future<void> otherBuild;
+        {
+            std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+            auto it = context->kernelCacheById.find(key);
+            if(it != context->kernelCacheById.end()) {
+                return it->second;
+            }
+            auto buildingIt = context->kernelsBeingBuilt.find(key);
+            if(buildingIt == context->kernelsBeingBuilt.end()) {
+                context->kernelsBeingBuilt[key] = built.get_future().share();
+                break;
+            }
+            otherBuild = buildingIt->second;
+        }
+        COCL_PRINT("waiting for another thread to build kernel id " << key.kernelId);
+        // if that build fails, we go round again, and try ourselves
+        otherBuild.wait();
+    }
+    try {
+        KernelCacheEntry entry = buildKernelCacheEntry(context, generate());
+        std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+        KernelCacheEntry &stored = addKernelCacheEntryLocked(context, key, std::move(entry));
+        context->kernelsBeingBuilt.erase(key);
+        built.set_value();
+        return stored;
+    } catch(...) {
+        {
+            std::lock_guard<std::mutex> lock(context->kernelCacheMutex);
+            context->kernelsBeingBuilt.erase(key);
+        }
+        built.set_value();
+        throw;
+    }
+}
+
+// kernel ids are handed out on first launch from each launch site, and are the same for every context
+static std::mutex kernelIdMutex;
+static int32_t nextKernelId = 1;
+
+int32_t getKernelId(int32_t *kernelIdSlot) {
+    int32_t kernelId = __atomic_load_n(kernelIdSlot, __ATOMIC_ACQUIRE);
+    if(kernelId != 0) {
+        return kernelId;
+    }
+    std::lock_guard<std::mutex> lock(kernelIdMutex);
+    if(*kernelIdSlot == 0) {
+        __atomic_store_n(kernelIdSlot, nextKernelId++, __ATOMIC_RELEASE);
+    }
+    return *kernelIdSlot;
+}
+
 } // namespace cocl
 
 void configureKernel(const char *kernelName, const char *devicellsourcecode) {
-    // pthread_mutex_lock(&launchMutex);
-    // launchMutex.lock();
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
+    // for code patched before patch_hostside passed kernel ids. we look up a slot per kernel name,
+    // which makes the same assumption the name-keyed cache used to: one kernel per name
+    static std::mutex slotMutex;
+    static std::map<std::string, int32_t> kernelIdSlotByName;
+    int32_t *kernelIdSlot = 0;
+    {
+        std::lock_guard<std::mutex> lock(slotMutex);
+        kernelIdSlot = &kernelIdSlotByName[kernelName];
+    }
+    configureKernelWithId(kernelIdSlot, kernelName, devicellsourcecode);
+}
+
+void configureKernelWithId(int32_t *kernelIdSlot, const char *kernelName, const char *devicellsourcecode) {
+    LaunchConfiguration &launchConfiguration = getLaunchConfiguration();
     COCL_PRINT("=========================================");
+    launchConfiguration.kernelId = getKernelId(kernelIdSlot);
     launchConfiguration.kernelName = kernelName;
     launchConfiguration.devicellsourcecode = devicellsourcecode;
 
-    // in order to handle by-value structs containing pointers to gpu structs, we're first going
-    // to add the first Memory object to the clmems, so it is available to the kernel, for
-    // dereferencing vmemlocs
+    // in order to handle by-value structs containing pointers to gpu structs, we're going to
+    // make the first Memory object clmem0, so it is available to the kernel, for dereferencing
+    // vmemlocs, see assignClmemIndexes
     // we are going to assume the first memory is at vmemloc=128 :-). very hacky :-DDD
     // Memory *firstMem = findMemory((const char *)128);
 
-    // we're simply going to assume there is a single memory allocated and take that
+    // we're simply going to assume there is a single clmem allocated and take that. with the slab
+    // allocator, thats the first slab, which all the suballocations in it share
     // we'll verify this assumption before launhc, if we are in fact using vmem
     ThreadVars *v = getThreadVars();
-    Memory *firstMem = *v->getContext()->memories.begin();
+    Context *context = v->getContext();
+    Memory *firstMem = 0;
+    if(context->slabAllocator) {
+        firstMem = context->slabAllocator->getFirstSlab();
+    }
+    if(firstMem == 0) {
+        ContextMutex contextMutex(context);
+        if(context->memoryByClmem.size() > 0) {
+            firstMem = context->memoryByClmem.begin()->second;
+        }
+    }
     // std::cout << "setKernelArgHostsideBuffer firstMem=" << firstMem << std::endl;
     // if its not zero, then pass it into kernel
     if(firstMem != 0) {
-        launchConfiguration.clmems.push_back(firstMem->clmem);
-        // addClmemArg(firstMem->clmem);
+        launchConfiguration.firstClmem = firstMem->clmem;
     }
+}
 
-    // pthread_mutex_unlock(&launchMutex);
+static void addClmemArg(LaunchConfiguration &launchConfiguration, cl_mem clmem) {
+    // which clmem param it gets depends on the other args, so thats left to kernelGo
+    launchConfiguration.clmemByClmemArgIndex.push_back(clmem);
 }
 
 void addClmemArg(cl_mem clmem) {
-    int clmemIndex = 0;
-    if(launchConfiguration.clmemIndexByClmem.find(clmem) == launchConfiguration.clmemIndexByClmem.end()) {
-        clmemIndex = launchConfiguration.clmems.size();
-        launchConfiguration.clmems.push_back(clmem);
-        launchConfiguration.clmemIndexByClmem[clmem] = clmemIndex;
-    } else {
-        clmemIndex = launchConfiguration.clmemIndexByClmem.find(clmem)->second;
+    addClmemArg(getLaunchConfiguration(), clmem);
+}
+
+static ArgRingBuffer *getArgRingBuffer(Context *context, CoclStream *coclStream) {
+    ContextMutex contextMutex(context);
+    if(coclStream->argRingBuffer == 0) {
+        coclStream->argRingBuffer = new ArgRingBuffer(context->getCl(), coclStream->clqueue->queue);
     }
-    launchConfiguration.clmemIndexByClmemArgIndex.push_back(clmemIndex);
+    return coclStream->argRingBuffer;
 }
 
 void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
     // this receives a hostside struct. it will
-    // - allocate a gpu buffer, to hold the struct
+    // - find space for the struct in the stream's ArgRingBuffer (or, if its huge, allocate a gpu
+    //   buffer, to hold the struct)
     // - queue an OpenCL command, to copy the hostside buffer to the gpu buffer
     // - adds the gpu buffer, and its offset, to the kernel parameters:
-    //   - add the gpu buffer to list of unique clmems (if not already there)
-    //   - records the unique clmem index, for use in generation
-    //   - adds an integer arg, with value 0, as the offset arg
+    //   - add the gpu buffer to the clmem args, which kernelGo turns into clmem params
+    //   - adds an integer arg, with the struct's offset in the buffer, as the offset arg
     //
     // Things this doesnt do:
     // - parse/walk the struct (thats handled during opencl generation, later on, not here)
@@ -329,64 +710,73 @@ void setKernelArgHostsideBuffer(char *pCpuStruct, int structAllocateSize) {
     //   anything to the setKernelArgGpuBuffer method (which expects an incoming
     //   pointer to be a virtual pointer, not a cl_mem)
 
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
+    LaunchConfiguration &launchConfiguration = getLaunchConfiguration();
     ThreadVars *v = getThreadVars();
     EasyCL *cl = v->getContext()->getCl();
     cl_context *ctx = cl->context;
     // we're going to:
-    // allocate a cl_mem for the struct
-    // copy the cpu struct to the cl_mem
-    // pass the cl_mem into the kernel
+    // copy the cpu struct into the stream's ring buffer, with a non-blocking write
+    // pass the ring buffer's cl_mem, and the struct's offset in it, into the kernel
 
-    // we should also:
-    // deallocate the cl_mem after calling the kernel
     // (we assume hte struct is passed by-value, so we dont have to actually copy it back afterwards)
     COCL_PRINT("setKernelArgHostsideBuffer size=" << structAllocateSize);
     if(structAllocateSize < 4) {
         structAllocateSize = 4;
     }
-    cl_int err;
-    cl_mem gpu_struct = clCreateBuffer(*ctx, CL_MEM_READ_WRITE, structAllocateSize,
-                                           NULL, &err);
-    EasyCL::checkError(err);
-    err = clEnqueueWriteBuffer(launchConfiguration.queue->queue, gpu_struct, CL_TRUE, 0,
-                                      structAllocateSize, pCpuStruct, 0, NULL, NULL);
-    EasyCL::checkError(err);
-    launchConfiguration.kernelArgsToBeReleased.push_back(gpu_struct);
+    // a captured launch can be replayed any time later, so its struct needs a buffer of its own,
+    // which the graph takes
+    long long offsetElements = -1;
+    ArgRingBuffer *argRingBuffer = 0;
+    if(launchConfiguration.coclStream->capturingGraph == 0) {
+        argRingBuffer = getArgRingBuffer(v->getContext(), launchConfiguration.coclStream);
+        offsetElements = argRingBuffer->write(pCpuStruct, structAllocateSize);
+    }
+    if(offsetElements >= 0) {
+        addClmemArg(launchConfiguration, argRingBuffer->clmem);
+    } else {
+        // too big for the ring buffer. give it its own buffer, which we release once the kernel
+        // is enqueued
+        cl_int err;
+        cl_mem gpu_struct = clCreateBuffer(*ctx, CL_MEM_READ_WRITE, structAllocateSize,
+                                               NULL, &err);
+        EasyCL::checkError(err);
+        err = clEnqueueWriteBuffer(launchConfiguration.queue->queue, gpu_struct, CL_TRUE, 0,
+                                          structAllocateSize, pCpuStruct, 0, NULL, NULL);
+        EasyCL::checkError(err);
+        launchConfiguration.kernelArgsToBeReleased.push_back(gpu_struct);
 
-    addClmemArg(gpu_struct);
+        addClmemArg(launchConfiguration, gpu_struct);
+        offsetElements = 0;
+    }
 
-    int offsetElements = 0;
     if(v->offsets_32bit) {
-       launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg((uint32_t)offsetElements)));
+       launchConfiguration.args.addUInt32((uint32_t)offsetElements);
     } else {
-       launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg((int64_t)offsetElements)));
+       launchConfiguration.args.addInt64((int64_t)offsetElements);
     }
-
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize) {
-    // This adds a gpu buffer to the kernel args, adding it to the list of unique clmems,
-    // if not already present, and adding the offset, as a kernel parameter
+    // This adds a gpu buffer to the kernel args, adding it to the clmem args, and adding the
+    // offset, as a kernel parameter
     //
     // The size of the buffer is not needed (though the virtual memory system knows it :-) )
     // The elementSize used to be used, but is no longer used/needed. Should probably be
     // removed from the method parameters at some point.
 
-    // pthread_mutex_lock(&launchMutex);
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
+    LaunchConfiguration &launchConfiguration = getLaunchConfiguration();
     ThreadVars *v = getThreadVars();
 
     Memory *memory = findMemory(memory_as_charstar);
     if(memory == 0) {
         COCL_PRINT("setKernelArgGpuBuffer nullptr");
-        addClmemArg(0);
+        addClmemArg(launchConfiguration, 0);
+        launchConfiguration.pointerArgs.push_back(LaunchPointerArg { memory_as_charstar,
+            (int)launchConfiguration.clmemByClmemArgIndex.size() - 1, launchConfiguration.args.size(), 0 });
         if(v->offsets_32bit) {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg(0)));
+            launchConfiguration.args.addUInt32(0);
         } else {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(0)));
+            launchConfiguration.args.addInt64(0);
         }
     } else {
         size_t offset = memory->getOffset(memory_as_charstar);
@@ -397,68 +787,111 @@ void setKernelArgGpuBuffer(char *memory_as_charstar, int32_t elementSize) {
 
         COCL_PRINT("setKernelArgGpuBuffer offset=" << offset);
 
-        addClmemArg(clmem);
+        addClmemArg(launchConfiguration, clmem);
+        launchConfiguration.pointerArgs.push_back(LaunchPointerArg { memory_as_charstar,
+            (int)launchConfiguration.clmemByClmemArgIndex.size() - 1, launchConfiguration.args.size(), 0 });
 
         if(v->offsets_32bit) {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg((uint32_t)offsetElements)));
+            launchConfiguration.args.addUInt32((uint32_t)offsetElements);
         } else {
-            launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg((int64_t)offsetElements)));
+            launchConfiguration.args.addInt64((int64_t)offsetElements);
         }
     }
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt64(int64_t value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(value)));
+    getLaunchConfiguration().args.addInt64(value);
     COCL_PRINT("setKernelArgInt64 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt32(int value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int32Arg(value)));
+    getLaunchConfiguration().args.addInt32(value);
     COCL_PRINT("setKernelArgInt32 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt8(char value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int8Arg(value)));
+    getLaunchConfiguration().args.addInt8(value);
     COCL_PRINT("setKernelArgInt8 " << value);
-    // pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgFloat(float value) {
-    std::lock_guard< std::recursive_mutex > guard(launchMutex);
-    // pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new FloatArg(value)));
+    getLaunchConfiguration().args.addFloat(value);
     COCL_PRINT("setKernelArgFloat " << value);
-    // pthread_mutex_unlock(&launchMutex);
+}
+
+static void assignClmemIndexes(Context *context, LaunchConfiguration &launchConfiguration) {
+    // generateOpenCL makes a different kernel for each pattern of which clmem args share a
+    // buffer, and one kernel launched with lots of aliasing patterns ends up compiled lots of
+    // times. so, unless the args are all in the one buffer, which the slab allocator makes the
+    // usual case, and where a single clmem param is worth having, each clmem arg gets a param of
+    // its own, whether or not it aliases another. the params arent restrict, so passing the same
+    // cl_mem to several of them is fine. COCL_SPECIALIZE_ALIASING changes which launches share
+    const std::vector<cl_mem> &clmemByClmemArgIndex = launchConfiguration.clmemByClmemArgIndex;
+    bool allInOneBuffer = true;
+    for(size_t i = 1; i < clmemByClmemArgIndex.size(); i++) {
+        if(clmemByClmemArgIndex[i] != clmemByClmemArgIndex[0]) {
+            allInOneBuffer = false;
+            break;
+        }
+    }
+    bool shareClmems = context->specializeAliasing == SpecializeAliasingAlways ||
+        (context->specializeAliasing == SpecializeAliasingShared && allInOneBuffer);
+
+    std::map<cl_mem, int> &clmemIndexByClmem = launchConfiguration.clmemIndexByClmem;
+    std::vector<cl_mem> &clmems = launchConfiguration.clmems;
+    std::vector<int> &clmemIndexByClmemArgIndex = launchConfiguration.clmemIndexByClmemArgIndex;
+    // clmem0 is the first allocation, if there is one, see configureKernelWithId. the args dont
+    // share it, even if they're in it, so the patterns dont depend on which allocation is first
+    if(launchConfiguration.firstClmem != 0) {
+        clmems.push_back(launchConfiguration.firstClmem);
+    }
+    for(size_t i = 0; i < clmemByClmemArgIndex.size(); i++) {
+        cl_mem clmem = clmemByClmemArgIndex[i];
+        auto it = clmemIndexByClmem.find(clmem);
+        if(shareClmems && it != clmemIndexByClmem.end()) {
+            clmemIndexByClmemArgIndex.push_back(it->second);
+        } else {
+            clmemIndexByClmem[clmem] = clmems.size();
+            clmemIndexByClmemArgIndex.push_back(clmems.size());
+            clmems.push_back(clmem);
+        }
+    }
+    for(auto it=launchConfiguration.pointerArgs.begin(); it != launchConfiguration.pointerArgs.end(); it++) {
+        it->clmemIndex = clmemIndexByClmemArgIndex[it->clmemArgIndex];
+    }
+    COCL_PRINT("clmem args " << clmemByClmemArgIndex.size() << " share clmems " << shareClmems << " => clmems " << clmems.size());
 }
 
 void kernelGo() {
+    LaunchConfiguration &launchConfiguration = getLaunchConfiguration();
     try {
-    launchMutex.lock();
-    // pthread_mutex_lock(&launchMutex);
     // COCL_PRINT("kernelGo queue=" << (void *)launchConfiguration.queue);
 
     ThreadVars *v = getThreadVars();
-
-    GenerateOpenCLResult res = generateOpenCL(
-        launchConfiguration.clmems.size(), launchConfiguration.clmemIndexByClmemArgIndex, launchConfiguration.kernelName, launchConfiguration.devicellsourcecode);
-    COCL_PRINT("kernelGo() kernel: " << launchConfiguration.kernelName);
-    CLKernel *kernel = compileOpenCLKernel(launchConfiguration.kernelName, res.uniqueKernelName, res.shortKernelName, res.clSourcecode);
+    Context *context = v->getContext();
+
+    assignClmemIndexes(context, launchConfiguration);
+    StreamKernel *streamKernel = 0;
+    bool capturing = launchConfiguration.coclStream->capturingGraph != 0;
+    const KernelCacheEntry &cacheEntry = getKernelCacheEntry(context, launchConfiguration,
+        capturing ? 0 : &streamKernel);
+    CLKernel *kernel = cacheEntry.kernel;
+    const KernelInfo &kernelInfo = cacheEntry.kernelInfo;
+    launchConfiguration.uniqueKernelName = cacheEntry.uniqueKernelName;  // for the debug dumper
+    COCL_PRINT("kernelGo() kernel: " << launchConfiguration.kernelName << " id " << launchConfiguration.kernelId);
     COCL_PRINT("kernelGo() uniqueKernelName: " << launchConfiguration.uniqueKernelName);
 
-    KernelInfo kernelInfo = v->getContext()->kernelInfoByUniqueName[launchConfiguration.uniqueKernelName];
     COCL_PRINT("kernel uses vmem?: " << kernelInfo.usesVmem);
     COCL_PRINT("kernel uses scratch?: " << kernelInfo.usesScratch);
     if(kernelInfo.usesVmem) {
-        if(v->getContext()->memories.size() > 1) {
+        // vmem only works if every allocation lives in clmem0. memoryByClmem has one entry per
+        // distinct clmem, with the slab allocator thats one per slab
+        size_t numClmems = 0;
+        {
+            ContextMutex contextMutex(context);
+            numClmems = context->memoryByClmem.size();
+        }
+        if(numClmems > 1) {
             std::cout << std::endl;
             std::cout << "Error: you are trying to use a kernel that uses double-indirected pointers ('float **' et al)" << std::endl;
             std::cout << "whilst you have allocated multiple gpu buffers" << std::endl;
@@ -468,35 +901,23 @@ void kernelGo() {
             std::cout << "Your options are:" << std::endl;
             std::cout << "- update your GPU kernel, to not use double-indirected pointers" << std::endl;
             std::cout << "- allocate one single huge GPU memory buffer, instead of many smaller ones" << std::endl;
+            std::cout << "- set COCL_SLAB_ALLOCATOR=1, and make sure COCL_SLAB_BYTES is big enough for all your allocations" << std::endl;
             std::cout << std::endl;
             throw std::runtime_error("Error: using vmem with multiple allocations");
         } else {
-            WHEN_SPAMMING(Memory *memory = *v->getContext()->memories.begin());
-            COCL_PRINT("Memory allocation ok: one single allocation at vmem=" << memory->fakePos << " sizeByes=" << memory->bytes);
+            COCL_PRINT("Memory allocation ok: one single clmem");
         }
     }
 
-    // ThreadVars *v = getThreadVars();
+    // look up the vmem base of each clmem before taking the run lock
+    std::vector<uint64_t> &vmemlocs = launchConfiguration.vmemlocs;
+    vmemlocs.assign(launchConfiguration.clmems.size(), 0);
     for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
-        COCL_PRINT("clmem" << i);
-        kernel->inout(&launchConfiguration.clmems[i]);
-        // we also need to write out the offset of this clmem, in our virtual memory system
-        cl_mem clmem = launchConfiguration.clmems[i];
-        Memory *memory = findMemoryByClmem(clmem);
-        uint64_t vmemloc = 0;
+        Memory *memory = findMemoryByClmem(launchConfiguration.clmems[i]);
         if(memory != 0) {  // hostsidegpu buffers will be 0
-            vmemloc = memory->fakePos;
-        }
-        if(v->offsets_32bit) {
-            kernel->in((uint32_t)vmemloc);
-        } else {
-            kernel->in((int64_t)vmemloc);
+            vmemlocs[i] = memory->fakePos;
         }
     }
-    for(int i = 0; i < launchConfiguration.args.size(); i++) {
-        COCL_PRINT("i=" << i << " " << launchConfiguration.args[i]->str());
-        launchConfiguration.args[i]->inject(kernel);
-    }
 
     size_t global[3];
     for(int i = 0; i < 3; i++) {
@@ -504,51 +925,85 @@ void kernelGo() {
     }
     COCL_PRINT("grid: " << launchConfiguration.grid << " block: " << launchConfiguration.block
         << " global: " << global);
-    int workgroupSize = launchConfiguration.block[0] * launchConfiguration.block[1] * launchConfiguration.block[2];
-    COCL_PRINT("workgroupSize=" << workgroupSize);
-    kernel->localInts(max(4, workgroupSize));
-
-    try {
-        kernel->run(launchConfiguration.queue, 3, global, launchConfiguration.block);
-    } catch(runtime_error &e) {
-        if(kernel->buildLog != "") {
-            std::cout << kernel->buildLog << std::endl;
-        }
-        cout << "kernel failed to run" << endl;
-        cout << "kernel name: [" << launchConfiguration.kernelName << "]" << endl;
-        launchMutex.unlock();
-        launchMutex.unlock();
-        // pthread_mutex_unlock(&launchMutex);
-        // pthread_mutex_unlock(&launchMutex);
-        throw e;
+    // kernels only have a scratch param if they call the __shfl shims. those index it by
+    // get_local_id(0), and read across the whole warp, so it needs one int per thread in x, in
+    // whole warps
+    size_t scratchBytes = 0;
+    if(kernelInfo.usesScratch) {
+        scratchBytes = getScratchBytes(launchConfiguration.block[0]);
     }
-    COCL_PRINT(".. kernel queued");
-    cl_int err;
-    err = clFinish(launchConfiguration.queue->queue);
-    EasyCL::checkError(err);
-    debugDumper.maybeDump();
-
-    for(auto it=launchConfiguration.kernelArgsToBeReleased.begin(); it != launchConfiguration.kernelArgsToBeReleased.end(); it++) {
-        cl_mem memObject = *it;
-        err = clReleaseMemObject(memObject);
-        EasyCL::checkError(err);
+    COCL_PRINT("scratchBytes=" << scratchBytes);
+    // extern __shared__ memory is a local param after the scratch, if the kernel uses it. opencl
+    // wont take a zero-sized local arg
+    size_t dynamicSharedBytes = 0;
+    if(kernelInfo.usesDynamicShared) {
+        dynamicSharedBytes = max((size_t)4, launchConfiguration.sharedMem);
+    }
+    COCL_PRINT("dynamicSharedBytes=" << dynamicSharedBytes);
+
+    if(capturing) {
+        // recorded for cudaGraphLaunch, rather than run
+        captureKernel(launchConfiguration.coclStream->capturingGraph, kernel, launchConfiguration, global,
+            scratchBytes, dynamicSharedBytes, v->offsets_32bit);
+        clearLaunchArgs(launchConfiguration);
+        return;
     }
-    launchConfiguration.kernelArgsToBeReleased.clear();
-    launchConfiguration.args.clear();
 
-    launchConfiguration.clmemIndexByClmem.clear();
-    launchConfiguration.clmems.clear();
-    launchConfiguration.clmemIndexByClmemArgIndex.clear();
+    {
+        // only other threads launching this kernel on the same stream can be using this cl_kernel
+        std::lock_guard<std::mutex> runLock(streamKernel->mu);
+        // each clmem, and its offset in our virtual memory system, then the args, then the scratch
+        // and dynamic shared local memory. setArg skips any that are the same as last launch, but the
+        // clmems are always set, see StreamKernel
+        cl_kernel clKernel = streamKernel->kernel;
+        cl_uint argIndex = 0;
+        for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
+            COCL_PRINT("clmem" << i);
+            streamKernel->setMemArg(argIndex++, launchConfiguration.clmems[i]);
+            if(v->offsets_32bit) {
+                uint32_t vmemloc = (uint32_t)launchConfiguration.vmemlocs[i];
+                streamKernel->setArg(argIndex++, sizeof(vmemloc), &vmemloc);
+            } else {
+                int64_t vmemloc = (int64_t)launchConfiguration.vmemlocs[i];
+                streamKernel->setArg(argIndex++, sizeof(vmemloc), &vmemloc);
+            }
+        }
+        const LaunchArgs &args = launchConfiguration.args;
+        for(int i = 0; i < args.size(); i++) {
+            COCL_PRINT("i=" << i << " " << args.str(i));
+            streamKernel->setArg(argIndex++, args.getSize(i), args.getValue(i));
+        }
+        if(scratchBytes != 0) {
+            streamKernel->setArg(argIndex++, scratchBytes, 0);
+        }
+        if(dynamicSharedBytes != 0) {
+            streamKernel->setArg(argIndex++, dynamicSharedBytes, 0);
+        }
 
-    err = clFinish(launchConfiguration.queue->queue);
+        cl_int err = clEnqueueNDRangeKernel(launchConfiguration.queue->queue, clKernel, 3, 0, global, launchConfiguration.block, 0, 0, 0);
+        if(err != CL_SUCCESS) {
+            if(kernel->buildLog != "") {
+                std::cout << kernel->buildLog << std::endl;
+            }
+            cout << "kernel failed to run" << endl;
+            cout << "kernel name: [" << launchConfiguration.kernelName << "]" << endl;
+            EasyCL::checkError(err);
+        }
+    }
+    COCL_PRINT(".. kernel queued");
+    // like cuda, we dont wait for the kernel. the flush gets it started, and anything the caller
+    // does on this stream afterwards is ordered after it. the only thing that waits is the debug
+    // dumper, if COCL_DUMP_CONFIG is set
+    cl_int err = clFlush(launchConfiguration.queue->queue);
     EasyCL::checkError(err);
+    v->debugDumper->maybeDump();
 
-    launchMutex.unlock();
-    launchMutex.unlock();
-    // pthread_mutex_unlock(&launchMutex);
-    // pthread_mutex_unlock(&launchMutex);
+    // the struct buffers can be released straight away: opencl only deletes a buffer once the
+    // commands using it have finished
+    clearLaunchArgs(launchConfiguration);
     } catch(runtime_error &e) {
         std::cout << "caught runtime error " << e.what() << std::endl;
+        clearLaunchArgs(launchConfiguration);
         throw e;
     }
 }
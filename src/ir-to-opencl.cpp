@@ -18,13 +18,21 @@
 
 #include "cocl/ir-to-opencl-common.h"
 #include "cocl/kernel_dumper.h"
+#include "cocl/function_dumper.h"
 
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/IR/Module.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/IR/Verifier.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
+#include <map>
+#include <set>
+#include <vector>
 
 namespace cocl {
 
@@ -33,11 +41,14 @@ ModuleClRes convertModuleToCl(
         bool offsets_32bit) {
     cocl::KernelDumper kernelDumper(M, specificFunction, generatedName, offsets_32bit);
     kernelDumper.addIRToCl();
+    kernelDumper.dropUnusedScratch();
     std::string cl = kernelDumper.toCl(uniqueClmemCount, clmemIndexByClmemArgIndex);
     ModuleClRes res;
     res.clSourcecode = cl;
     res.usesVmem = kernelDumper.usesVmem;
     res.usesScratch = kernelDumper.usesScratch;
+    res.usesDynamicShared = kernelDumper.usesDynamicShared;
+    res.numClmemArgs = kernelDumper.numClmemArgs;
     return res;
 }
 
@@ -58,4 +69,136 @@ ModuleClRes convertLlStringToCl(
     return res;
 }
 
+static void addUsedGlobals(const llvm::Value *value, std::set<const llvm::GlobalValue *> &usedGlobals,
+        std::set<const llvm::Value *> &seen, std::vector<const llvm::GlobalValue *> &toVisit) {
+    // finds the globals value refers to, looking through constant expressions, and constant
+    // aggregates, eg the initializers of global arrays of function pointers
+    if(seen.find(value) != seen.end()) {
+        return;
+    }
+    seen.insert(value);
+    if(const llvm::GlobalValue *global = llvm::dyn_cast<llvm::GlobalValue>(value)) {
+        if(usedGlobals.find(global) == usedGlobals.end()) {
+            usedGlobals.insert(global);
+            toVisit.push_back(global);
+        }
+        return;
+    }
+    if(const llvm::Constant *constant = llvm::dyn_cast<llvm::Constant>(value)) {
+        for(auto it = constant->op_begin(); it != constant->op_end(); it++) {
+            addUsedGlobals(it->get(), usedGlobals, seen, toVisit);
+        }
+    }
+}
+
+std::unique_ptr<llvm::Module> cloneFunctionCallGraph(const llvm::Module *M, std::string functionName) {
+    const llvm::Function *F = M->getFunction(functionName);
+    if(F == 0) {
+        throw std::runtime_error("cloneFunctionCallGraph: couldnt find function " + functionName);
+    }
+    std::set<const llvm::GlobalValue *> usedGlobals;
+    std::set<const llvm::Value *> seen;
+    std::vector<const llvm::GlobalValue *> toVisit;
+    usedGlobals.insert(F);
+    toVisit.push_back(F);
+    while(toVisit.size() > 0) {
+        const llvm::GlobalValue *global = toVisit.back();
+        toVisit.pop_back();
+        if(const llvm::Function *usedF = llvm::dyn_cast<llvm::Function>(global)) {
+            for(auto block_it = usedF->begin(); block_it != usedF->end(); block_it++) {
+                for(auto inst_it = block_it->begin(); inst_it != block_it->end(); inst_it++) {
+                    for(auto op_it = inst_it->op_begin(); op_it != inst_it->op_end(); op_it++) {
+                        if(llvm::isa<llvm::Constant>(op_it->get())) {
+                            addUsedGlobals(op_it->get(), usedGlobals, seen, toVisit);
+                        }
+                    }
+                }
+            }
+        } else if(const llvm::GlobalVariable *globalVar = llvm::dyn_cast<llvm::GlobalVariable>(global)) {
+            if(globalVar->hasInitializer()) {
+                addUsedGlobals(globalVar->getInitializer(), usedGlobals, seen, toVisit);
+            }
+        }
+    }
+    // the declarations of everything else stay, in the same order, so KernelDumper gives the
+    // functions the same short names as it would for the whole module
+    llvm::ValueToValueMapTy vmap;
+    return llvm::CloneModule(M, vmap, [&usedGlobals](const llvm::GlobalValue *global) {
+        return usedGlobals.find(global) != usedGlobals.end();
+    });
+}
+
+int getKernelNumClmemArgs(llvm::Module *M, std::string kernelName) {
+    llvm::Function *F = M->getFunction(kernelName);
+    if(F == 0) {
+        throw std::runtime_error("kernel " + kernelName + " not found");
+    }
+    return FunctionDumper::countKernelClmemArgs(F);
+}
+
+std::vector<std::string> getKernelNames(const llvm::Module *M) {
+    // the cuda front-end marks each __global__ function with a "kernel" entry in nvvm.annotations
+    std::vector<std::string> kernelNames;
+    const llvm::NamedMDNode *annotations = M->getNamedMetadata("nvvm.annotations");
+    if(annotations == 0) {
+        return kernelNames;
+    }
+    for(unsigned i = 0; i < annotations->getNumOperands(); i++) {
+        const llvm::MDNode *node = annotations->getOperand(i);
+        if(node->getNumOperands() < 2) {
+            continue;
+        }
+        const llvm::MDString *kind = llvm::dyn_cast_or_null<llvm::MDString>(node->getOperand(1).get());
+        if(kind == 0 || kind->getString() != "kernel") {
+            continue;
+        }
+        const llvm::Function *F = llvm::mdconst::dyn_extract_or_null<llvm::Function>(node->getOperand(0));
+        if(F != 0 && !F->isDeclaration()) {
+            kernelNames.push_back(F->getName().str());
+        }
+    }
+    return kernelNames;
+}
+
+namespace {
+    class ParsedModules {
+    public:
+        // declared before the modules, so it outlives them
+        llvm::LLVMContext context;
+        std::map<const char *, std::unique_ptr<llvm::Module> > moduleByLlString;
+    };
+}
+
+static llvm::Module *getParsedModule(const char *llString) {
+    // one set per thread, since an LLVMContext, and everything in it, can only be used by one thread
+    // at a time. so threads, eg the coclWarmupKernels ones, translate in parallel, at the cost of
+    // each parsing the device ir itself
+    static thread_local ParsedModules parsedModules;
+    std::unique_ptr<llvm::Module> &M = parsedModules.moduleByLlString[llString];
+    if(!M) {
+        std::unique_ptr<llvm::MemoryBuffer> llMemoryBuffer = llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(llString));
+        llvm::SMDiagnostic smDiagnostic;
+        M = parseIR(llMemoryBuffer->getMemBufferRef(), smDiagnostic, parsedModules.context);
+        if(!M) {
+            parsedModules.moduleByLlString.erase(llString);
+            smDiagnostic.print("irtopencl", llvm::errs());
+            throw std::runtime_error("failed to parse IR");
+        }
+    }
+    return M.get();
+}
+
+ModuleClRes convertEmbeddedLlStringToCl(
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, const char *llString, std::string specificFunction, std::string generatedName,
+        bool offsets_32bit) {
+    // KernelDumper renames and rewrites the module it's given, so it gets a copy
+    std::unique_ptr<llvm::Module> M = cloneFunctionCallGraph(getParsedModule(llString), specificFunction);
+    return convertModuleToCl(uniqueClmemCount, clmemIndexByClmemArgIndex, M.get(), specificFunction, generatedName, offsets_32bit);
+}
+
+int getEmbeddedKernelNumClmemArgs(const char *llString, std::string kernelName) {
+    // only reads the parsed module, so doesnt need a copy
+    return getKernelNumClmemArgs(getParsedModule(llString), kernelName);
+}
+
 } // namespace cocl
@@ -14,6 +14,9 @@
 
 #include "argparsecpp/argparsecpp.h"
 #include "cocl/kernel_dumper.h"
+#include "cocl/ir-to-opencl.h"
+#include "cocl/cocl_aot_file.h"
+#include "cocl/cocl_clsources.h"
 
 #include "EasyCL/util/easycl_stringhelper.h"
 
@@ -24,6 +27,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 using namespace cocl;
@@ -31,34 +36,135 @@ using namespace llvm;
 
 #define OFFSETS_32BIT_ENV_VAR "COCL_OFFSETS_32BIT"
 
+static vector<int> parseCmemIndexes(string cmem_indexes) {
+    vector<int> cmemIndexes;
+    vector<string> split_cmem_indexes = easycl::split(cmem_indexes, ",");
+    for(int i = 0; i < (int)split_cmem_indexes.size(); i++) {
+        cmemIndexes.push_back(easycl::atoi(split_cmem_indexes[i]));
+    }
+    return cmemIndexes;
+}
+
+static bool generateAotKernel(ostream &of, Module *M, string kernelName, string pattern, bool offsets_32bit) {
+    // pattern is "distinct", "shared", or explicit indexes, eg "1,1,2". returns false if
+    // the kernel couldnt be converted for this pattern, which isnt fatal: the runtime will just
+    // generate it when it's launched
+    // cmem0 is the first allocation, which the runtime passes for vmem, so the args start at
+    // cmem1, see configureKernelWithId in hostside_opencl_funcs.cpp
+    string shortKernelName = kernelName.substr(0, 20);
+    try {
+        int numClmemArgs = getKernelNumClmemArgs(M, kernelName);
+        vector<int> cmemIndexes;
+        if(pattern == "shared") {
+            cmemIndexes = vector<int>(numClmemArgs, 1);
+        } else if(pattern == "distinct") {
+            for(int i = 0; i < numClmemArgs; i++) {
+                cmemIndexes.push_back(i + 1);
+            }
+        } else {
+            cmemIndexes = parseCmemIndexes(pattern);
+            if((int)cmemIndexes.size() != numClmemArgs) {
+                cout << "warning: " << kernelName << " has " << numClmemArgs << " pointer args, skipping cmem indexes " << pattern << endl;
+                return false;
+            }
+        }
+        // a launch with no pointer args only has clmem0
+        int numCmems = cmemIndexes.size() > 0 ? *max_element(cmemIndexes.begin(), cmemIndexes.end()) + 1 : 1;
+        unique_ptr<Module> clone = cloneFunctionCallGraph(M, kernelName);
+        ModuleClRes res = convertModuleToCl(numCmems, cmemIndexes, clone.get(), kernelName, shortKernelName, offsets_32bit);
+        AotKernel aotKernel;
+        aotKernel.kernelName = kernelName;
+        aotKernel.clmemIndexes = makeClmemIndexesString(cmemIndexes);
+        aotKernel.uniqueClmemCount = numCmems;
+        aotKernel.offsets32bit = offsets_32bit;
+        aotKernel.usesVmem = res.usesVmem;
+        aotKernel.usesScratch = res.usesScratch;
+        aotKernel.usesDynamicShared = res.usesDynamicShared;
+        aotKernel.numClmemArgs = res.numClmemArgs;
+        aotKernel.clSourcecode = res.clSourcecode;
+        writeAotKernel(of, aotKernel);
+    } catch(runtime_error &e) {
+        cout << "warning: couldnt generate " << kernelName << " for " << pattern << ": " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
+
+static int generateAot(Module *M, string aotFilename, string manifestFilename, bool offsets_32bit) {
+    // without a manifest, each kernel gets the pattern where every pointer arg is in its own clmem,
+    // which is what launches use unless all the args are in one buffer. manifest lines look like
+    // "<kernelname or *> <distinct|shared|cmem indexes>", and # starts a comment
+    vector<string> kernelNames = getKernelNames(M);
+    vector<pair<string, string> > patterns;
+    if(manifestFilename == "") {
+        patterns.push_back(make_pair("*", "distinct"));
+    } else {
+        ifstream manifest(manifestFilename);
+        if(!manifest) {
+            cout << "couldnt open " << manifestFilename << endl;
+            return -1;
+        }
+        string line;
+        while(getline(manifest, line)) {
+            istringstream lineSs(line);
+            string kernelName;
+            string pattern;
+            if(!(lineSs >> kernelName) || kernelName[0] == '#') {
+                continue;
+            }
+            if(!(lineSs >> pattern)) {
+                cout << "couldnt parse manifest line: " << line << endl;
+                return -1;
+            }
+            patterns.push_back(make_pair(kernelName, pattern));
+        }
+    }
+
+    ofstream of(aotFilename, ios_base::out | ios_base::binary);
+    writeAotFileMagic(of);
+    int numGenerated = 0;
+    for(int i = 0; i < (int)kernelNames.size(); i++) {
+        for(int j = 0; j < (int)patterns.size(); j++) {
+            if(patterns[j].first == "*" || patterns[j].first == kernelNames[i]) {
+                if(generateAotKernel(of, M, kernelNames[i], patterns[j].second, offsets_32bit)) {
+                    numGenerated++;
+                }
+            }
+        }
+    }
+    of.close();
+    if(!of) {
+        cout << "failed to write " << aotFilename << endl;
+        return -1;
+    }
+    cout << "generated " << numGenerated << " opencl kernels ahead of time" << endl;
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     string llFilename;
     string ClFilename;
     string kernelname = "";
     string cmem_indexes = "";
+    string aotFilename = "";
+    string aotManifestFilename = "";
     bool add_ir_to_cl = false;
 
     argparsecpp::ArgumentParser parser;
     parser.add_string_argument("--inputfile", &llFilename)->required();
-    parser.add_string_argument("--outputfile", &ClFilename)->required();
-    parser.add_string_argument("--kernelname", &kernelname)->required();
-    parser.add_string_argument("--cmem-indexes", &cmem_indexes)->required()->help("comma-separated, eg 0,1,2,1");
+    parser.add_string_argument("--outputfile", &ClFilename)->help("required, unless --aot-outputfile");
+    parser.add_string_argument("--kernelname", &kernelname)->help("required, unless --aot-outputfile");
+    parser.add_string_argument("--cmem-indexes", &cmem_indexes)->help("comma-separated, eg 0,1,2,1. required, unless --aot-outputfile");
+    parser.add_string_argument("--aot-outputfile", &aotFilename)->help("generate opencl for every kernel, for patch_hostside --aotfile");
+    parser.add_string_argument("--aot-manifest", &aotManifestFilename)->help("which cmem indexes to generate each kernel for, with --aot-outputfile");
     parser.add_bool_argument("--add_ir_to_cl", &add_ir_to_cl)->help("Adds some approximation of the original IR to the opencl code, for debugging");
     if(!parser.parse_args(argc, argv)) {
         return -1;
     }
-
-    vector<string> split_cmem_indexes = easycl::split(cmem_indexes, ",");
-    int numCmems = 0;
-    vector<int> cmemIndexes;
-    for(int i = 0; i < (int)split_cmem_indexes.size(); i++) {
-        int index = easycl::atoi(split_cmem_indexes[i]);
-        cmemIndexes.push_back(index);
-        if(index + 1 > numCmems) {
-            numCmems = index + 1;
-        }
+    if(aotFilename == "" && (ClFilename == "" || kernelname == "" || cmem_indexes == "")) {
+        cout << "Please provide --outputfile, --kernelname and --cmem-indexes, or --aot-outputfile" << endl;
+        return -1;
     }
-    cout << "numCmems " << numCmems << endl; 
 
     llvm::LLVMContext context;
     SMDiagnostic smDiagnostic;
@@ -76,6 +182,19 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if(aotFilename != "") {
+        return generateAot(M.get(), aotFilename, aotManifestFilename, offsets_32bit);
+    }
+
+    vector<int> cmemIndexes = parseCmemIndexes(cmem_indexes);
+    int numCmems = 0;
+    for(int i = 0; i < (int)cmemIndexes.size(); i++) {
+        if(cmemIndexes[i] + 1 > numCmems) {
+            numCmems = cmemIndexes[i] + 1;
+        }
+    }
+    cout << "numCmems " << numCmems << endl; 
+
     KernelDumper kernelDumper(M.get(), kernelname, kernelname, offsets_32bit);
     if(add_ir_to_cl) {
         kernelDumper.addIRToCl();
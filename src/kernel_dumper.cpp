@@ -20,6 +20,8 @@
 #include "cocl/type_dumper.h"
 #include "cocl/function_dumper.h"
 #include "cocl/mutations.h"
+#include "cocl/readIR.h"
+#include "cocl/new_instruction_dumper.h"
 #include "EasyCL/util/easycl_stringhelper.h"
 
 #include "llvm/IR/Constants.h"
@@ -49,6 +51,52 @@ static std::string createShortKernelName(string origName, std::set<std::string>
     return name;
 }
 
+static bool referencesDynamicShared(Value *value) {
+    if(ReadIR::isDynamicShared(value)) {
+        return true;
+    }
+    if(ConstantExpr *expr = dyn_cast<ConstantExpr>(value)) {
+        for(auto it=expr->op_begin(); it != expr->op_end(); it++) {
+            if(referencesDynamicShared(it->get())) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// F, and the functions it calls, directly or not
+static void addReachableFunctions(Function *F, std::set<Function *> &reachable) {
+    if(reachable.find(F) != reachable.end()) {
+        return;
+    }
+    reachable.insert(F);
+    for(auto block_it=F->begin(); block_it != F->end(); block_it++) {
+        for(auto inst_it=block_it->begin(); inst_it != block_it->end(); inst_it++) {
+            Instruction *inst = &*inst_it;
+            for(auto op_it=inst->op_begin(); op_it != inst->op_end(); op_it++) {
+                if(Function *childF = dyn_cast<Function>(op_it->get())) {
+                    addReachableFunctions(childF, reachable);
+                }
+            }
+        }
+    }
+}
+
+static bool functionUsesDynamicShared(Function *F) {
+    for(auto block_it=F->begin(); block_it != F->end(); block_it++) {
+        for(auto inst_it=block_it->begin(); inst_it != block_it->end(); inst_it++) {
+            Instruction *inst = &*inst_it;
+            for(auto op_it=inst->op_begin(); op_it != inst->op_end(); op_it++) {
+                if(referencesDynamicShared(op_it->get())) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
 std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex) {
     Function *F = M->getFunction(kernelName);
     if(F == 0) {
@@ -95,6 +143,25 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
     isKernel.insert(F);
     neededFunctions.insert(F);
 
+    // the scratch and dynamicShared parameters go into the kernel signature, so we need to know
+    // whether anything the kernel calls uses them before we generate it
+    std::set<Function *> reachableFunctions;
+    addReachableFunctions(F, reachableFunctions);
+    bool needsScratch = false;
+    for(auto it=reachableFunctions.begin(); it != reachableFunctions.end(); it++) {
+        Function *reachableF = *it;
+        if(NewInstructionDumper::callUsesScratch(reachableF->getName().str())) {
+            needsScratch = true;
+        }
+        if(functionUsesDynamicShared(reachableF)) {
+            usesDynamicShared = true;
+        }
+    }
+    bool dropScratch = _dropUnusedScratch && !needsScratch;
+    if(_dropUnusedScratch) {
+        usesScratch = needsScratch;
+    }
+
     int nothingHappenedCount = 0;
     while(returnTypeByFunction.size() < neededFunctions.size()) {
         bool changedSomething = false;
@@ -122,6 +189,12 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
             if(_addIRToCl) {
                 childFunctionDumper.addIRToCl();
             }
+            if(usesDynamicShared) {
+                childFunctionDumper.addDynamicShared();
+            }
+            if(dropScratch) {
+                childFunctionDumper.dropScratch();
+            }
             if(!childFunctionDumper.runGeneration(returnTypeByFunction)) {
                 neededFunctions.insert(childFunctionDumper.neededFunctions.begin(), childFunctionDumper.neededFunctions.end());
                 continue;
@@ -130,9 +203,16 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
                 this->usesVmem = true;
             }
             if(childFunctionDumper.usesScratch) {
+                if(dropScratch) {
+                    cout << "function " << functionName << " uses scratch, but the kernel has no scratch parameter" << endl;
+                    throw runtime_error("function " + functionName + " uses scratch, but the kernel has no scratch parameter");
+                }
                 this->usesScratch = true;
             }
 
+            if(_isKernel) {
+                numClmemArgs = childFunctionDumper.numClmemArgs;
+            }
             returnTypeByFunction[childF] = childFunctionDumper.returnType;
             changedSomething = true;
             ostringstream os;
@@ -181,7 +261,11 @@ struct GlobalVars {
     local int *scratch;
     global char *clmem0;
     unsigned long clmem_vmem_offset0;
-};
+)";
+    if(usesDynamicShared) {
+        functionDeclarationsStream << "    local char *dynamicShared;\n";
+    }
+    functionDeclarationsStream << R"(};
 
 inline global float *getGlobalPointer(__vmem__ unsigned long vmemloc, const struct GlobalVars* const globalVars) {
     return (global float *)(globalVars->clmem0 + vmemloc - globalVars->clmem_vmem_offset0);
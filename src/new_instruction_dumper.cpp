@@ -30,6 +30,7 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include <vector>
+#include <map>
 #include <string>
 #include <memory>
 #include <iostream>
@@ -746,6 +747,26 @@ void NewInstructionDumper::writeShimCall(LocalValueInfo *localValueInfo, std::st
     localValueInfo->setExpression(gencode_ss.str());
 }
 
+// the cuda functions that dumpCall turns into a call to one of our shims, see shims.cpp
+static const std::map<std::string, std::string> &getShimNameByFunctionName() {
+    static const std::map<std::string, std::string> shimNameByFunctionName = {
+        {"_Z8__umulhiii", "__umulhi"},
+        {"_Z9atomicAddIfET_PS0_S0_", "__atomic_add_float"},
+        {"_Z9atomicIncPjj", "__atomic_inc_uint"},
+        {"_Z11__shfl_downIfET_S0_ii", "__shfl_down_3"},
+        {"_Z11__shfl_downIfET_S0_i", "__shfl_down_2"}
+    };
+    return shimNameByFunctionName;
+}
+
+// KernelDumper uses this to decide up front whether the kernel needs a scratch parameter
+bool NewInstructionDumper::callUsesScratch(std::string functionName) {
+    static const Shims shimTable;
+    const std::map<std::string, std::string> &shimNameByFunctionName = getShimNameByFunctionName();
+    auto it = shimNameByFunctionName.find(functionName);
+    return it != shimNameByFunctionName.end() && shimTable.usesScratch(it->second);
+}
+
 void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::map<llvm::Function *, llvm::Type *> &returnTypeByFunction) {
     localValueInfo->clWriter.reset(new CallClWriter(localValueInfo));
     CallInst *instr = cast<CallInst>(localValueInfo->value);
@@ -754,6 +775,17 @@ void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::m
     string calledName = calledValue->getName().str();
 
     string functionName = instr->getCalledValue()->getName().str();
+    auto shimIt = getShimNameByFunctionName().find(functionName);
+    if(shimIt != getShimNameByFunctionName().end()) {
+        string shimName = shimIt->second;
+        if(shims->usesScratch(shimName)) {
+            writeShimCall(localValueInfo, shimName, "pGlobalVars->scratch, ", instr);
+            this->usesScratch = true;
+        } else {
+            writeShimCall(localValueInfo, shimName, "", instr);
+        }
+        return;
+    }
     bool internalfunc = false;
     if(functionName == "llvm.ptx.read.tid.x" || functionName == "llvm.nvvm.read.ptx.sreg.tid.x") { // second on is llvm 4.0, first is 3.8
         localValueInfo->setAddressSpace(0);
@@ -835,9 +867,6 @@ void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::m
         // ignore
         localValueInfo->skip();
         return;
-    } else if(functionName == "_Z8__umulhiii") {
-        writeShimCall(localValueInfo, "__umulhi", "", instr);
-        return;
     } else if(functionName == "_Z7sincosffPfS_") {
         localValueInfo->setAddressSpace(0);
         std::ostringstream gencode;
@@ -846,20 +875,6 @@ void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::m
         gencode << getOperand(instr->getOperand(2))->getExpr() << ");";
         localValueInfo->setExpression(gencode.str());
         return;
-    } else if(functionName == "_Z9atomicAddIfET_PS0_S0_") {
-        writeShimCall(localValueInfo, "__atomic_add_float", "", instr);
-        return;
-    } else if(functionName == "_Z9atomicIncPjj") {
-        writeShimCall(localValueInfo, "__atomic_inc_uint", "", instr);
-        return;
-    } else if(functionName == "_Z11__shfl_downIfET_S0_ii") {
-        writeShimCall(localValueInfo, "__shfl_down_3", "pGlobalVars->scratch, ", instr);
-        this->usesScratch = true;
-        return;
-    } else if(functionName == "_Z11__shfl_downIfET_S0_i") {
-        writeShimCall(localValueInfo, "__shfl_down_2", "pGlobalVars->scratch, ", instr);
-        this->usesScratch = true;
-        return;
     } else if(functionName == "llvm.lifetime.start") {
         // just ignore for now
         localValueInfo->skip();
@@ -15,6 +15,7 @@
 // For doc, please see the corresponding include file, patch_hostside.h
 
 #include "cocl/patch_hostside.h"
+#include "cocl/cocl_aot_file.h"
 
 #include "cocl/cocl_logging.h"
 
@@ -31,6 +32,7 @@
 #include "llvm/Support/raw_os_ostream.h"
 
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 #include <string>
 #include <fstream>
@@ -46,6 +48,7 @@ namespace cocl {
 static llvm::LLVMContext context;
 static std::string devicellcode_stringname;
 static string devicellfilename;
+static string aotfilename;
 
 static GlobalNames globalNames;
 static TypeDumper typeDumper(&globalNames);
@@ -518,15 +521,28 @@ void PatchHostside::patchCudaLaunch(
     Instruction *llSourcecodeValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
     llSourcecodeValue->insertBefore(inst->getInst());
 
+    // one kernel id slot per kernel per module, shared by all the launch sites for that kernel. the
+    // runtime fills it in with the kernel id on first launch, and keys its kernel cache on that,
+    // rather than on the kernel name
+    string kernelIdSlotName = "kernelid_" + ::devicellcode_stringname + "_" + kernelName;
+    GlobalVariable *kernelIdSlot = M->getNamedGlobal(kernelIdSlotName);
+    if(kernelIdSlot == 0) {
+        kernelIdSlot = new GlobalVariable(
+            *M, IntegerType::get(context, 32), false, GlobalValue::InternalLinkage,
+            ConstantInt::getSigned(IntegerType::get(context, 32), 0), kernelIdSlotName);
+        // cudaLaunch is passed the host-side stub of the kernel, ie the function we are in
+        addRegisterKernelInst(M, inst->getArgOperand(0), kernelIdSlot, kernelName);
+    }
+
     Function *configureKernel = cast<Function>(F->getParent()->getOrInsertFunction(
-        "configureKernel",
+        "configureKernelWithId",
         Type::getVoidTy(context),
+        PointerType::get(IntegerType::get(context, 32), 0),
         PointerType::get(IntegerType::get(context, 8), 0),
         PointerType::get(IntegerType::get(context, 8), 0),
-        // PointerType::get(IntegerType::get(context, 8), 0),
         NULL));
-    Value *args[] = {kernelNameValue, llSourcecodeValue};
-    CallInst *callConfigureKernel = CallInst::Create(configureKernel, ArrayRef<Value *>(&args[0], &args[2]));
+    Value *args[] = {kernelIdSlot, kernelNameValue, llSourcecodeValue};
+    CallInst *callConfigureKernel = CallInst::Create(configureKernel, ArrayRef<Value *>(&args[0], &args[3]));
     callConfigureKernel->insertBefore(inst->getInst());
     Instruction *lastInst = callConfigureKernel;
 
@@ -549,6 +565,80 @@ void PatchHostside::patchCudaLaunch(
     launchCallInfo->params.clear();
 }
 
+llvm::Function *PatchHostside::getRegisterKernelsFunction(llvm::Module *M) {
+    // one registration function per module, run as a global constructor, see patchModule
+    Function *registerKernels = M->getFunction("__cocl_register_kernels");
+    if(registerKernels == 0) {
+        registerKernels = Function::Create(
+            FunctionType::get(Type::getVoidTy(context), false), GlobalValue::InternalLinkage,
+            "__cocl_register_kernels", M);
+        BasicBlock *block = BasicBlock::Create(context, "entry", registerKernels);
+        ReturnInst::Create(context, block);
+    }
+    return registerKernels;
+}
+
+void PatchHostside::addRegisterKernelInst(llvm::Module *M, llvm::Value *hostFunction, llvm::GlobalVariable *kernelIdSlot,
+        std::string kernelName) {
+    Instruction *returnInst = getRegisterKernelsFunction(M)->getEntryBlock().getTerminator();
+
+    Instruction *kernelNameValue = addStringInstr(M, "s_" + ::devicellcode_stringname + "_" + kernelName, kernelName);
+    kernelNameValue->insertBefore(returnInst);
+    Instruction *llSourcecodeValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
+    llSourcecodeValue->insertBefore(returnInst);
+    Constant *hostFunctionValue = ConstantExpr::getBitCast(
+        cast<Constant>(hostFunction), PointerType::get(IntegerType::get(context, 8), 0));
+
+    Function *registerKernel = cast<Function>(M->getOrInsertFunction(
+        "coclRegisterKernel",
+        Type::getVoidTy(context),
+        PointerType::get(IntegerType::get(context, 8), 0),
+        PointerType::get(IntegerType::get(context, 32), 0),
+        PointerType::get(IntegerType::get(context, 8), 0),
+        PointerType::get(IntegerType::get(context, 8), 0),
+        NULL));
+    Value *args[] = {hostFunctionValue, kernelIdSlot, kernelNameValue, llSourcecodeValue};
+    CallInst *callRegisterKernel = CallInst::Create(registerKernel, ArrayRef<Value *>(&args[0], &args[4]));
+    callRegisterKernel->insertBefore(returnInst);
+}
+
+void PatchHostside::addPrebuiltKernelInsts(llvm::Module *M, std::string aotFilename) {
+    // the file is written by ir-to-opencl --aot-outputfile, see cocl_aot_file.h
+    vector<AotKernel> aotKernels = readAotFile(aotFilename);
+
+    Instruction *returnInst = getRegisterKernelsFunction(M)->getEntryBlock().getTerminator();
+    Type *charPointerType = PointerType::get(IntegerType::get(context, 8), 0);
+    Type *int32Type = IntegerType::get(context, 32);
+    Function *registerPrebuiltKernel = cast<Function>(M->getOrInsertFunction(
+        "coclRegisterPrebuiltKernel",
+        Type::getVoidTy(context),
+        charPointerType, charPointerType, charPointerType,
+        int32Type, int32Type, int32Type, int32Type, int32Type, int32Type,
+        charPointerType,
+        NULL));
+    for(int kernelIndex = 0; kernelIndex < (int)aotKernels.size(); kernelIndex++) {
+        const AotKernel &aotKernel = aotKernels[kernelIndex];
+        string namePrefix = "s_aot_" + ::devicellcode_stringname + "_" + easycl::toString(kernelIndex);
+        Instruction *llSourcecodeValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
+        llSourcecodeValue->insertBefore(returnInst);
+        Instruction *kernelNameValue = addStringInstr(M, "s_" + ::devicellcode_stringname + "_" + aotKernel.kernelName, aotKernel.kernelName);
+        kernelNameValue->insertBefore(returnInst);
+        Instruction *clmemIndexesValue = addStringInstr(M, namePrefix + "_clmemindexes", aotKernel.clmemIndexes);
+        clmemIndexesValue->insertBefore(returnInst);
+        Instruction *clSourcecodeValue = addStringInstr(M, namePrefix + "_cl", aotKernel.clSourcecode);
+        clSourcecodeValue->insertBefore(returnInst);
+        Value *args[] = {
+            llSourcecodeValue, kernelNameValue, clmemIndexesValue,
+            createInt32Constant(&context, aotKernel.uniqueClmemCount), createInt32Constant(&context, aotKernel.offsets32bit),
+            createInt32Constant(&context, aotKernel.usesVmem), createInt32Constant(&context, aotKernel.usesScratch),
+            createInt32Constant(&context, aotKernel.usesDynamicShared), createInt32Constant(&context, aotKernel.numClmemArgs),
+            clSourcecodeValue
+        };
+        CallInst *callRegister = CallInst::Create(registerPrebuiltKernel, ArrayRef<Value *>(&args[0], &args[10]));
+        callRegister->insertBefore(returnInst);
+    }
+}
+
 void PatchHostside::patchFunction(llvm::Module *M, const llvm::Module *MDevice, llvm::Function *F) {
     // this will take the calls to cudaSetupArgument(someArg, argSize, ...), and
     // cudaLaunch(function), and rewrite them to call Coriander instead
@@ -639,6 +729,14 @@ void PatchHostside::patchModule(Module *M, const Module *MDevice) {
         PatchHostside::patchFunction(M, MDevice, F);
         verifyFunction(*F);
     }
+    if(::aotfilename != "") {
+        addPrebuiltKernelInsts(M, ::aotfilename);
+    }
+
+    Function *registerKernels = M->getFunction("__cocl_register_kernels");
+    if(registerKernels != 0) {
+        appendToGlobalCtors(*M, registerKernels, 65535);
+    }
 }
 
 } // namespace cocl
@@ -653,6 +751,7 @@ int main(int argc, char *argv[]) {
     parser.add_string_argument("--hostrawfile", &rawhostfilename)->required()->help("input file");
     parser.add_string_argument("--devicellfile", &::devicellfilename)->required()->help("input file");
     parser.add_string_argument("--hostpatchedfile", &patchedhostfilename)->required()->help("output file");
+    parser.add_string_argument("--aotfile", &::aotfilename)->help("opencl generated ahead of time, by ir-to-opencl --aot-outputfile");
     if(!parser.parse_args(argc, argv)) {
         return -1;
     }
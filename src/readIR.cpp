@@ -20,6 +20,7 @@
 #include "llvm/IR/Value.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/Module.h"
 
 #include <iostream>
@@ -144,3 +145,15 @@ float ReadIR::readFloatConstant(Value *value) {
     // cout << "res " << res << endl;
     // return valueasdoubletofloat;
 }
+
+bool ReadIR::isDynamicShared(Value *value) {
+    GlobalVariable *global = dyn_cast<GlobalVariable>(value);
+    if(global == 0 || global->getType()->getAddressSpace() != 3) {
+        return false;
+    }
+    if(global->isDeclaration()) {
+        return true;
+    }
+    ArrayType *arrayType = dyn_cast<ArrayType>(global->getValueType());
+    return arrayType != 0 && arrayType->getNumElements() == 0;
+}
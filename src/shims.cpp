@@ -36,6 +36,7 @@ inline float __shfl_down_3(local int *scratch, float v0, int v1, int v2) {
     return mem[warpstart + warpsrc];
 }
 )";
+    _scratchShims.insert("__shfl_down_3");
 
     _shimClByName["__shfl_down_2"] = R"(
 inline float __shfl_down_2(local int *scratch, float v0, int v1) {
@@ -152,6 +153,20 @@ bool Shims::isUsed(std::string name) {
     return shimsToBeUsed.find(name) != shimsToBeUsed.end();
 }
 
+bool Shims::usesScratch(std::string name) const {
+    if(_scratchShims.find(name) != _scratchShims.end()) {
+        return true;
+    }
+    auto depsIt = _dependenciesByName.find(name);
+    if(depsIt != _dependenciesByName.end()) {
+        for(auto it=depsIt->second.begin(); it != depsIt->second.end(); it++) {
+            if(usesScratch(*it)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
 // std::string Shims::getClByName(std::string name) {
 //     return _shimClByName[name];
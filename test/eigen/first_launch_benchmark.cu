@@ -0,0 +1,78 @@
+// Measures how long the first launch of each of a few different Eigen kernels takes, ie including
+// generating and building the OpenCL, compared with launching them again
+//
+// Run it against two builds of Coriander to compare them. Set COCL_KERNEL_CACHE_DIR, and run it
+// twice, to see what the on-disk kernel cache saves
+
+#define EIGEN_TEST_NO_LONGDOUBLE
+#define EIGEN_TEST_NO_COMPLEX
+#define EIGEN_TEST_FUNC first_launch_benchmark
+#define EIGEN_USE_GPU
+
+#include <unsupported/Eigen/CXX11/Tensor>
+
+#include "main.h"
+
+#include <iostream>
+#include <chrono>
+
+using Eigen::Tensor;
+
+template<typename Op>
+double timeLaunch(Eigen::GpuDevice &gpu_device, Op op) {
+  auto start = std::chrono::steady_clock::now();
+  op();
+  assert(cudaStreamSynchronize(gpu_device.stream()) == cudaSuccess);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template<typename Op>
+void benchmarkOp(const char *name, Eigen::GpuDevice &gpu_device, Op op) {
+  double firstMs = timeLaunch(gpu_device, op);
+  double secondMs = timeLaunch(gpu_device, op);
+  std::cout << name << ": first launch " << firstMs << "ms, second launch " << secondMs << "ms" << std::endl;
+}
+
+void test_first_launch_benchmark()
+{
+  const int rows = 72;
+  const int cols = 97;
+  Tensor<float, 2> in1(rows, cols);
+  in1.setRandom();
+
+  float* d_in1;
+  float* d_out;
+  float* d_out_reduced;
+  cudaMalloc((void**)(&d_in1), in1.size() * sizeof(float));
+  cudaMalloc((void**)(&d_out), in1.size() * sizeof(float));
+  cudaMalloc((void**)(&d_out_reduced), cols * sizeof(float));
+  cudaMemcpy(d_in1, in1.data(), in1.size() * sizeof(float), cudaMemcpyHostToDevice);
+
+  Eigen::CudaStreamDevice stream;
+  Eigen::GpuDevice gpu_device(&stream);
+
+  Eigen::TensorMap<Eigen::Tensor<float, 2> > gpu_in1(d_in1, rows, cols);
+  Eigen::TensorMap<Eigen::Tensor<float, 2> > gpu_out(d_out, rows, cols);
+  Eigen::TensorMap<Eigen::Tensor<float, 1> > gpu_out_reduced(d_out_reduced, cols);
+
+  array<Eigen::DenseIndex, 1> reduction_axis;
+  reduction_axis[0] = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  benchmarkOp("abs", gpu_device, [&]() { gpu_out.device(gpu_device) = gpu_in1.abs(); });
+  benchmarkOp("add", gpu_device, [&]() { gpu_out.device(gpu_device) = gpu_in1 + gpu_in1; });
+  benchmarkOp("mul_constant", gpu_device, [&]() { gpu_out.device(gpu_device) = gpu_in1 * 3.0f; });
+  benchmarkOp("sum", gpu_device, [&]() { gpu_out_reduced.device(gpu_device) = gpu_in1.sum(reduction_axis); });
+  benchmarkOp("prod", gpu_device, [&]() { gpu_out_reduced.device(gpu_device) = gpu_in1.prod(reduction_axis); });
+  benchmarkOp("mean", gpu_device, [&]() { gpu_out_reduced.device(gpu_device) = gpu_in1.mean(reduction_axis); });
+  benchmarkOp("maximum", gpu_device, [&]() { gpu_out_reduced.device(gpu_device) = gpu_in1.maximum(reduction_axis); });
+  auto end = std::chrono::steady_clock::now();
+  std::cout << "total: " << std::chrono::duration<double, std::milli>(end - start).count() << "ms" << std::endl;
+  std::cout << "kernel disk cache hits: " << cocl::getNumKernelDiskCacheHits()
+    << " misses: " << cocl::getNumKernelDiskCacheMisses() << std::endl;
+
+  cudaFree(d_in1);
+  cudaFree(d_out);
+  cudaFree(d_out_reduced);
+}
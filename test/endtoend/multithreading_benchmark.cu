@@ -0,0 +1,96 @@
+// measures kernel launch throughput from several host threads at once, each on its own stream,
+// either each with its own context, like multithreading.cu, or all sharing one context
+
+#include "pthread.h"
+
+#include "hostside_opencl_funcs_ext.h"
+
+#include <iostream>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+const int N = 1024;
+const int LAUNCHES_PER_THREAD = 200;
+const int MAX_THREADS = 8;
+
+__global__ void addOne(float *data) {
+    int tid = threadIdx.x;
+    data[tid] += 1.0f;
+}
+
+struct ThreadInfo {
+    CUcontext sharedContext; // 0 => thread uses its own default context
+    pthread_barrier_t *barrier;
+    double elapsedMs;
+};
+
+void *thread_func(void *_info) {
+    ThreadInfo *info = (ThreadInfo *)_info;
+    if(info->sharedContext != 0) {
+        cuCtxSetCurrent(info->sharedContext);
+    }
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+    CUdeviceptr deviceFloats;
+    cuMemAlloc(&deviceFloats, N * sizeof(float));
+    cuMemsetD32(deviceFloats, 0, N);
+
+    // warm up, so kernel compilation isnt in the timings
+    addOne<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>((float *)deviceFloats);
+    cuStreamSynchronize(stream);
+
+    pthread_barrier_wait(info->barrier);
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < LAUNCHES_PER_THREAD; i++) {
+        addOne<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>((float *)deviceFloats);
+    }
+    cuStreamSynchronize(stream);
+    auto end = chrono::steady_clock::now();
+    info->elapsedMs = chrono::duration<double, milli>(end - start).count();
+
+    float hostFloats[32];
+    cuMemcpyDtoH(hostFloats, deviceFloats, 32 * sizeof(float));
+    assert(hostFloats[0] == LAUNCHES_PER_THREAD + 1);
+
+    cuMemFree(deviceFloats);
+    cuStreamDestroy(stream);
+    return 0;
+}
+
+void benchmark(int numThreads, CUcontext sharedContext) {
+    pthread_t threads[MAX_THREADS];
+    ThreadInfo infos[MAX_THREADS];
+    pthread_barrier_t barrier;
+    pthread_barrier_init(&barrier, NULL, numThreads);
+    for(int i = 0; i < numThreads; i++) {
+        infos[i].sharedContext = sharedContext;
+        infos[i].barrier = &barrier;
+        pthread_create(&threads[i], NULL, thread_func, &infos[i]);
+    }
+    double maxElapsedMs = 0;
+    for(int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+        if(infos[i].elapsedMs > maxElapsedMs) {
+            maxElapsedMs = infos[i].elapsedMs;
+        }
+    }
+    pthread_barrier_destroy(&barrier);
+    int totalLaunches = numThreads * LAUNCHES_PER_THREAD;
+    cout << (sharedContext != 0 ? "shared context" : "context per thread") << " threads=" << numThreads
+        << " launches=" << totalLaunches << " time=" << maxElapsedMs << "ms"
+        << " launches/sec=" << (totalLaunches * 1000.0 / maxElapsedMs) << endl;
+}
+
+int main(int argc, char *argv[]) {
+    CUcontext sharedContext;
+    cuCtxCreate(&sharedContext, 0, 0);
+    for(int numThreads = 1; numThreads <= MAX_THREADS; numThreads *= 2) {
+        benchmark(numThreads, 0);
+        benchmark(numThreads, sharedContext);
+    }
+    return 0;
+}
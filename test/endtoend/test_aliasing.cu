@@ -0,0 +1,86 @@
+// tests that launching a kernel with its pointer args aliasing each other in different ways
+// doesnt build a new variant for each way: they should all share the variant with one clmem per
+// arg. only having all the args in one buffer gets a variant of its own
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addArrays(float *out, float *a, float *b, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = a[tid] + b[tid];
+    }
+}
+
+void launch(float *out, float *a, float *b, int N) {
+    addArrays<<<dim3((N + 63) / 64, 1, 1), dim3(64, 1, 1)>>>(out, a, b, N);
+}
+
+void check(float *deviceData, int N, float offset, float scale) {
+    float *hostData = new float[N];
+    cudaMemcpy(hostData, deviceData, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        if(hostData[i] != offset + scale * i) {
+            cout << "mismatch i=" << i << " actual=" << hostData[i] << " expected=" << offset + scale * i << endl;
+            assert(false);
+        }
+    }
+    delete[] hostData;
+}
+
+int main(int argc, char *argv[]) {
+    // needs to be done before the context is created, ie before the first cuda call. either would
+    // change which launches share a variant
+    unsetenv("COCL_SPECIALIZE_ALIASING");
+    unsetenv("COCL_SLAB_ALLOCATOR");
+    int N = 1000;
+    float *hostX = new float[N];
+    float *hostY = new float[N];
+    float *hostZ = new float[N];
+    for(int i = 0; i < N; i++) {
+        hostX[i] = 0.0f;
+        hostY[i] = 1.0f;
+        hostZ[i] = (float)i;
+    }
+    float *x;
+    float *y;
+    float *z;
+    cudaMalloc((void **)&x, N * sizeof(float));
+    cudaMalloc((void **)&y, N * sizeof(float));
+    cudaMalloc((void **)&z, N * sizeof(float));
+    cudaMemcpy(x, hostX, N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(y, hostY, N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(z, hostZ, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    launch(x, y, z, N); // x = 1 + i
+    launch(x, x, y, N); // x = 2 + i
+    launch(x, y, x, N); // x = 3 + i
+    launch(y, x, x, N); // y = 6 + 2i
+    check(x, N, 3.0f, 1.0f);
+    check(y, N, 6.0f, 2.0f);
+    cout << "num cached kernels " << cocl::getNumCachedKernels() << endl;
+    assert(cocl::getNumCachedKernels() == 1);
+
+    launch(x, x, x, N); // x = 6 + 2i
+    launch(y, y, y, N); // y = 12 + 4i
+    check(x, N, 6.0f, 2.0f);
+    check(y, N, 12.0f, 4.0f);
+    cout << "num cached kernels " << cocl::getNumCachedKernels() << endl;
+    assert(cocl::getNumCachedKernels() == 2);
+
+    cudaFree(x);
+    cudaFree(y);
+    cudaFree(z);
+    delete[] hostX;
+    delete[] hostY;
+    delete[] hostZ;
+
+    cout << "finished ok" << endl;
+    return 0;
+}
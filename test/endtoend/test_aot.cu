@@ -0,0 +1,64 @@
+// tests that a program built with cocl --aot launches its kernels with the opencl generated at build
+// time, rather than converting the device ir when the kernel is first launched. the launch uses the
+// default pattern cocl --aot generates, where each pointer arg is in its own buffer. assumes
+// COCL_OFFSETS_32BIT is the same as when the test was built
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void scaleArray(float *out, float *in, float scale, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = in[tid] * scale;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // needs to be done before the context is created, ie before the first cuda call. the disk
+    // cache is checked before the prebuilt kernels, and the others change the clmem pattern
+    unsetenv("COCL_KERNEL_CACHE_DIR");
+    unsetenv("COCL_LOAD_CL");
+    unsetenv("COCL_SPECIALIZE_ALIASING");
+    unsetenv("COCL_SLAB_ALLOCATOR");
+
+    int N = 1000;
+    float *hostIn = new float[N];
+    float *hostOut = new float[N];
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = (float)i;
+    }
+    float *in;
+    float *out;
+    cudaMalloc((void **)&in, N * sizeof(float));
+    cudaMalloc((void **)&out, N * sizeof(float));
+    cudaMemcpy(in, hostIn, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    scaleArray<<<dim3((N + 63) / 64, 1, 1), dim3(64, 1, 1)>>>(out, in, 3.0f, N);
+    cudaMemcpy(hostOut, out, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        if(hostOut[i] != 3.0f * i) {
+            cout << "mismatch i=" << i << " actual=" << hostOut[i] << " expected=" << 3.0f * i << endl;
+            assert(false);
+        }
+    }
+
+    cout << "prebuilt kernels used " << cocl::getNumPrebuiltKernelsUsed() << endl;
+    cout << "kernels generated " << cocl::getNumKernelsGenerated() << endl;
+    assert(cocl::getNumKernelCacheMisses() == 1);
+    assert(cocl::getNumPrebuiltKernelsUsed() == 1);
+    assert(cocl::getNumKernelsGenerated() == 0);
+
+    cudaFree(in);
+    cudaFree(out);
+    delete[] hostIn;
+    delete[] hostOut;
+
+    cout << "finished ok" << endl;
+    return 0;
+}
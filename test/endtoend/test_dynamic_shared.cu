@@ -0,0 +1,79 @@
+// tests extern __shared__ memory, sized at launch time, including from a called device function
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+extern __shared__ float sdata[];
+
+__device__ float sumShared(int n) {
+    float sum = 0;
+    for(int i = 0; i < n; i++) {
+        sum += sdata[i];
+    }
+    return sum;
+}
+
+// each block sums its slice of in into out[blockIdx.x]
+__global__ void blockSum(float *in, float *out) {
+    int tid = threadIdx.x;
+    sdata[tid] = in[blockIdx.x * blockDim.x + tid];
+    __syncthreads();
+    if(tid == 0) {
+        out[blockIdx.x] = sumShared(blockDim.x);
+    }
+}
+
+void testBlockSum(int numBlocks, int blockSize, cudaStream_t stream) {
+    int N = numBlocks * blockSize;
+    float *hostIn = new float[N];
+    float *hostOut = new float[numBlocks];
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = (float)(i % 7);
+    }
+
+    float *deviceIn;
+    float *deviceOut;
+    cudaMalloc((void **)&deviceIn, N * sizeof(float));
+    cudaMalloc((void **)&deviceOut, numBlocks * sizeof(float));
+    cudaMemcpyAsync(deviceIn, hostIn, N * sizeof(float), cudaMemcpyHostToDevice, stream);
+
+    blockSum<<<dim3(numBlocks, 1, 1), dim3(blockSize, 1, 1), blockSize * sizeof(float), stream>>>(deviceIn, deviceOut);
+
+    cudaMemcpyAsync(hostOut, deviceOut, numBlocks * sizeof(float), cudaMemcpyDeviceToHost, stream);
+    cudaStreamSynchronize(stream);
+
+    for(int b = 0; b < numBlocks; b++) {
+        float expected = 0;
+        for(int i = 0; i < blockSize; i++) {
+            expected += hostIn[b * blockSize + i];
+        }
+        if(hostOut[b] != expected) {
+            cout << "mismatch blockSize=" << blockSize << " b=" << b
+                << " expected=" << expected << " actual=" << hostOut[b] << endl;
+            assert(false);
+        }
+    }
+    cudaFree(deviceIn);
+    cudaFree(deviceOut);
+    delete[] hostIn;
+    delete[] hostOut;
+}
+
+int main(int argc, char *argv[]) {
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    // different shared sizes for the same kernel
+    testBlockSum(4, 32, stream);
+    testBlockSum(3, 64, stream);
+    testBlockSum(2, 128, stream);
+
+    cudaStreamDestroy(stream);
+    cout << "finished ok" << endl;
+    return 0;
+}
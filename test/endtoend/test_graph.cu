@@ -0,0 +1,129 @@
+// tests stream capture, and replaying the captured graph, including patching a pointer between
+// launches. also checks that replaying doesnt go through the kernel cache
+
+#include "hostside_opencl_funcs_ext.h"
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+struct Scale {
+    float factor;
+    float offset;
+};
+
+__global__ void scaleAndAdd(float *out, const float *in, Scale scale, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = in[tid] * scale.factor + scale.offset;
+    }
+}
+
+__global__ void addOne(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += 1.0f;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 1000;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *hostIn = new float[N];
+    float *hostOut = new float[N];
+    float *deviceIn1;
+    float *deviceIn2;
+    float *deviceOut;
+    cudaMalloc((void **)&deviceIn1, N * sizeof(float));
+    cudaMalloc((void **)&deviceIn2, N * sizeof(float));
+    cudaMalloc((void **)&deviceOut, N * sizeof(float));
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = i;
+    }
+
+    Scale scale;
+    scale.factor = 2.0f;
+    scale.offset = 3.0f;
+
+    // run each kernel once first, so theyre in the kernel cache before we capture
+    scaleAndAdd<<<dim3((N + 255) / 256), dim3(256), 0, stream>>>(deviceOut, deviceIn1, scale, N);
+    addOne<<<dim3((N + 255) / 256), dim3(256), 0, stream>>>(deviceOut, N);
+    cudaStreamSynchronize(stream);
+
+    cudaStreamBeginCapture(stream, cudaStreamCaptureModeGlobal);
+    int captureStatus;
+    cudaStreamIsCapturing(stream, &captureStatus);
+    assert(captureStatus == cudaStreamCaptureStatusActive);
+    cudaMemcpyAsync(deviceIn1, hostIn, N * sizeof(float), cudaMemcpyHostToDevice, stream);
+    scaleAndAdd<<<dim3((N + 255) / 256), dim3(256), 0, stream>>>(deviceOut, deviceIn1, scale, N);
+    addOne<<<dim3((N + 255) / 256), dim3(256), 0, stream>>>(deviceOut, N);
+    cudaMemcpyAsync(hostOut, deviceOut, N * sizeof(float), cudaMemcpyDeviceToHost, stream);
+    cudaGraph_t graph;
+    cudaStreamEndCapture(stream, &graph);
+    cudaStreamIsCapturing(stream, &captureStatus);
+    assert(captureStatus == cudaStreamCaptureStatusNone);
+
+    size_t numNodes;
+    cudaGraphGetNumNodes(graph, &numNodes);
+    cout << "nodes: " << numNodes << endl;
+    assert(numNodes == 4);
+
+    cudaGraphExec_t graphExec;
+    cudaGraphInstantiate(&graphExec, graph, 0, 0, 0);
+    cudaGraphDestroy(graph);
+
+    int kernelCallsBefore = cocl::getNumKernelCalls();
+    for(int it = 0; it < 3; it++) {
+        for(int i = 0; i < N; i++) {
+            hostIn[i] = i + it;
+            hostOut[i] = -1.0f;
+        }
+        cudaGraphLaunch(graphExec, stream);
+        cudaStreamSynchronize(stream);
+        for(int i = 0; i < N; i++) {
+            float expected = (i + it) * 2.0f + 3.0f + 1.0f;
+            if(hostOut[i] != expected) {
+                cout << "it=" << it << " i=" << i << " expected " << expected << " got " << hostOut[i] << endl;
+                assert(false);
+            }
+        }
+    }
+    // the first two were captured, the replays dont launch through kernelGo at all
+    assert(cocl::getNumKernelCalls() == kernelCallsBefore);
+
+    // now switch the input buffer to deviceIn2. that changes both the copy from hostIn, and the
+    // kernel arg. deviceIn1 keeps what the last launch copied into it
+    for(int i = 0; i < N; i++) {
+        hostIn[i] = 100 + i;
+    }
+    coclGraphExecUpdatePointer(graphExec, deviceIn1, deviceIn2);
+    cudaGraphLaunch(graphExec, stream);
+    cudaStreamSynchronize(stream);
+    for(int i = 0; i < N; i++) {
+        float expected = (100 + i) * 2.0f + 3.0f + 1.0f;
+        if(hostOut[i] != expected) {
+            cout << "patched i=" << i << " expected " << expected << " got " << hostOut[i] << endl;
+            assert(false);
+        }
+    }
+    cudaMemcpy(hostOut, deviceIn1, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        assert(hostOut[i] == i + 2);
+    }
+
+    cudaGraphExecDestroy(graphExec);
+    cudaFree(deviceIn1);
+    cudaFree(deviceIn2);
+    cudaFree(deviceOut);
+    delete[] hostIn;
+    delete[] hostOut;
+    cudaStreamDestroy(stream);
+    cout << "finished ok" << endl;
+    return 0;
+}
@@ -35,9 +35,12 @@ void testfloatstar() {
 
     cout << "num kernels cached " << cocl::getNumCachedKernels() << endl;
     cout << "num kernel calls " << cocl::getNumKernelCalls() << endl;
+    cout << "kernel cache hits " << cocl::getNumKernelCacheHits() << " misses " << cocl::getNumKernelCacheMisses() << endl;
 
     assert(cocl::getNumCachedKernels() == 1);
     assert(cocl::getNumKernelCalls() == 4);
+    assert(cocl::getNumKernelCacheMisses() == 1);
+    assert(cocl::getNumKernelCacheHits() == 3);
 
     cuMemFreeHost(hostFloats1);
     cuMemFree(deviceFloats1);
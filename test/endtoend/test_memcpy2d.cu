@@ -0,0 +1,126 @@
+// tests cudaMallocPitch, cudaMemcpy2D/2DAsync, cudaMemset2D and cudaMemcpy3D, by copying a
+// rectangle through pitched device memory and back
+
+#include <iostream>
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+#include <cuda.h>
+
+void checkEqual(const char *name, int expected, int actual, int i) {
+    if(expected != actual) {
+        cout << name << " mismatch i=" << i << " expected=" << expected << " actual=" << actual << endl;
+        assert(false);
+    }
+}
+
+void test2D(cudaStream_t stream) {
+    const int width = 37;  // bytes per row
+    const int height = 19;
+    const int hostPitch = 50;
+    unsigned char *hostSrc = new unsigned char[hostPitch * height];
+    unsigned char *hostDst = new unsigned char[hostPitch * height];
+    for(int i = 0; i < hostPitch * height; i++) {
+        hostSrc[i] = (unsigned char)(i % 251);
+    }
+    memset(hostDst, 0xab, hostPitch * height);
+
+    unsigned char *devA;
+    unsigned char *devB;
+    size_t pitchA;
+    size_t pitchB;
+    cudaMallocPitch((void **)&devA, &pitchA, width, height);
+    cudaMallocPitch((void **)&devB, &pitchB, width + 3, height);
+    assert(pitchA >= width);
+
+    cudaMemcpy2D(devA, pitchA, hostSrc, hostPitch, width, height, cudaMemcpyHostToDevice);
+    cudaMemcpy2DAsync(devB + 3, pitchB, devA, pitchA, width, height, cudaMemcpyDeviceToDevice, stream);
+    cudaMemcpy2DAsync(hostDst, hostPitch, devB + 3, pitchB, width, height, cudaMemcpyDeviceToHost, stream);
+    cudaStreamSynchronize(stream);
+    for(int row = 0; row < height; row++) {
+        for(int col = 0; col < hostPitch; col++) {
+            int i = row * hostPitch + col;
+            checkEqual("memcpy2d", col < width ? hostSrc[i] : 0xab, hostDst[i], i);
+        }
+    }
+
+    // clear a 5-wide band in each row, then read the whole pitched buffer back
+    cudaMemset2D(devA + 2, pitchA, 0, 5, height);
+    unsigned char *hostPitched = new unsigned char[pitchA * height];
+    cudaMemcpy(hostPitched, devA, pitchA * height, cudaMemcpyDeviceToHost);
+    for(int row = 0; row < height; row++) {
+        for(int col = 0; col < width; col++) {
+            int expected = (col >= 2 && col < 7) ? 0 : hostSrc[row * hostPitch + col];
+            checkEqual("memset2d", expected, hostPitched[row * pitchA + col], row * pitchA + col);
+        }
+    }
+
+    cudaFree(devA);
+    cudaFree(devB);
+    delete[] hostPitched;
+    delete[] hostSrc;
+    delete[] hostDst;
+}
+
+void test3D() {
+    const int width = 24;
+    const int height = 7;
+    const int depth = 5;
+    int N = width * height * depth;
+    unsigned char *hostSrc = new unsigned char[N];
+    unsigned char *hostDst = new unsigned char[N];
+    for(int i = 0; i < N; i++) {
+        hostSrc[i] = (unsigned char)(i * 7 % 253);
+    }
+    memset(hostDst, 0, N);
+
+    cudaExtent extent = make_cudaExtent(width, height, depth);
+    cudaPitchedPtr devPtr;
+    cudaMalloc3D(&devPtr, extent);
+
+    cudaMemcpy3DParms toDevice;
+    memset(&toDevice, 0, sizeof(toDevice));
+    toDevice.srcPtr = make_cudaPitchedPtr(hostSrc, width, width, height);
+    toDevice.dstPtr = devPtr;
+    toDevice.extent = extent;
+    toDevice.kind = cudaMemcpyHostToDevice;
+    cudaMemcpy3D(&toDevice);
+
+    // read back all but the first slice and row
+    cudaMemcpy3DParms toHost;
+    memset(&toHost, 0, sizeof(toHost));
+    toHost.srcPtr = devPtr;
+    toHost.srcPos = make_cudaPos(0, 1, 1);
+    toHost.dstPtr = make_cudaPitchedPtr(hostDst, width, width, height);
+    toHost.dstPos = make_cudaPos(0, 1, 1);
+    toHost.extent = make_cudaExtent(width, height - 1, depth - 1);
+    toHost.kind = cudaMemcpyDeviceToHost;
+    cudaMemcpy3D(&toHost);
+
+    for(int z = 0; z < depth; z++) {
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                int i = (z * height + y) * width + x;
+                checkEqual("memcpy3d", (z >= 1 && y >= 1) ? hostSrc[i] : 0, hostDst[i], i);
+            }
+        }
+    }
+
+    cudaFree(devPtr.ptr);
+    delete[] hostSrc;
+    delete[] hostDst;
+}
+
+int main(int argc, char *argv[]) {
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    test2D(stream);
+    test3D();
+
+    cudaStreamDestroy(stream);
+    cout << "finished ok" << endl;
+    return 0;
+}
@@ -0,0 +1,52 @@
+// tests cudaMemsetAsync with unaligned offsets and counts, small and large, on a non-default stream
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstring>
+
+using namespace std;
+
+#include <cuda.h>
+
+void testMemset(size_t offset, size_t count, cudaStream_t stream) {
+    size_t N = offset + count + 16;
+    unsigned char *hostBytes = new unsigned char[N];
+    memset(hostBytes, 0xab, N);
+
+    unsigned char *deviceBytes;
+    cudaMalloc((void **)&deviceBytes, N);
+    cudaMemcpy(deviceBytes, hostBytes, N, cudaMemcpyHostToDevice);
+
+    cudaMemsetAsync(deviceBytes + offset, 0x12, count, stream);
+    cudaMemcpyAsync(hostBytes, deviceBytes, N, cudaMemcpyDeviceToHost, stream);
+    cudaStreamSynchronize(stream);
+
+    for(size_t i = 0; i < N; i++) {
+        unsigned char expected = (i >= offset && i < offset + count) ? 0x12 : 0xab;
+        if(hostBytes[i] != expected) {
+            cout << "mismatch offset=" << offset << " count=" << count << " i=" << i
+                << " expected=" << (int)expected << " actual=" << (int)hostBytes[i] << endl;
+            assert(false);
+        }
+    }
+    cudaFree(deviceBytes);
+    delete[] hostBytes;
+}
+
+int main(int argc, char *argv[]) {
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    size_t offsets[] = {0, 1, 2, 3, 5};
+    size_t counts[] = {0, 1, 3, 4, 7, 1000, 65536 + 3, 1024 * 1024 + 1};
+    for(int i = 0; i < (int)(sizeof(offsets) / sizeof(offsets[0])); i++) {
+        for(int j = 0; j < (int)(sizeof(counts) / sizeof(counts[0])); j++) {
+            testMemset(offsets[i], counts[j], stream);
+        }
+    }
+
+    cudaStreamDestroy(stream);
+    cout << "finished ok" << endl;
+    return 0;
+}
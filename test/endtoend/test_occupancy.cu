@@ -0,0 +1,65 @@
+// tests cudaOccupancyMaxPotentialBlockSize and cudaOccupancyMaxActiveBlocksPerMultiprocessor, including
+// before the kernel has been launched
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addOne(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] = data[tid] + 1.0f;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int minGridSize = 0;
+    int blockSize = 0;
+    cudaOccupancyMaxPotentialBlockSize(&minGridSize, &blockSize, addOne);
+    cout << "minGridSize=" << minGridSize << " blockSize=" << blockSize << endl;
+    assert(blockSize > 0);
+    assert(minGridSize > 0);
+
+    int limitedMinGridSize = 0;
+    int limitedBlockSize = 0;
+    cudaOccupancyMaxPotentialBlockSize(&limitedMinGridSize, &limitedBlockSize, addOne, 0, 32);
+    cout << "with limit 32: minGridSize=" << limitedMinGridSize << " blockSize=" << limitedBlockSize << endl;
+    assert(limitedBlockSize > 0);
+    assert(limitedBlockSize <= 32);
+
+    int numBlocks = 0;
+    cudaOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, addOne, blockSize, 0);
+    cout << "active blocks at blockSize " << blockSize << ": " << numBlocks << endl;
+    assert(numBlocks > 0);
+
+    cudaOccupancyMaxActiveBlocksPerMultiprocessor(&numBlocks, addOne, 1 << 20, 0);
+    assert(numBlocks == 0);
+
+    // and the block size we were given should actually work
+    int N = blockSize * 3 + 5;
+    float *hostData = new float[N];
+    for(int i = 0; i < N; i++) {
+        hostData[i] = (float)i;
+    }
+    float *deviceData;
+    cudaMalloc((void **)&deviceData, N * sizeof(float));
+    cudaMemcpy(deviceData, hostData, N * sizeof(float), cudaMemcpyHostToDevice);
+    int numGroups = (N + blockSize - 1) / blockSize;
+    addOne<<<dim3(numGroups, 1, 1), dim3(blockSize, 1, 1)>>>(deviceData, N);
+    cudaMemcpy(hostData, deviceData, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        if(hostData[i] != (float)i + 1.0f) {
+            cout << "mismatch i=" << i << " actual=" << hostData[i] << endl;
+            assert(false);
+        }
+    }
+    cudaFree(deviceData);
+    delete[] hostData;
+
+    cout << "finished ok" << endl;
+    return 0;
+}
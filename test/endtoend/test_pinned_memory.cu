@@ -0,0 +1,72 @@
+// tests cudaHostAlloc and cudaHostRegister, with cudaMemcpyAsync
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void incrValues(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+void checkRoundTrip(float *hostFloats, int N, cudaStream_t stream) {
+    float *deviceFloats;
+    cudaMalloc((void **)&deviceFloats, N * sizeof(float));
+
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = i;
+    }
+    cudaMemcpyAsync(deviceFloats, hostFloats, N * sizeof(float), cudaMemcpyHostToDevice, stream);
+    incrValues<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(deviceFloats, N, 3.0f);
+    cudaMemcpyAsync(hostFloats, deviceFloats, N * sizeof(float), cudaMemcpyDeviceToHost, stream);
+    cudaStreamSynchronize(stream);
+    for(int i = 0; i < N; i++) {
+        if(hostFloats[i] != i + 3.0f) {
+            cout << "mismatch i=" << i << " expected=" << (i + 3.0f) << " actual=" << hostFloats[i] << endl;
+            assert(false);
+        }
+    }
+    cudaFree(deviceFloats);
+}
+
+void testHostAlloc() {
+    int N = 1024;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *hostFloats;
+    cudaHostAlloc((void **)&hostFloats, N * sizeof(float), cudaHostAllocDefault);
+    checkRoundTrip(hostFloats, N, stream);
+    cudaFreeHost(hostFloats);
+
+    cudaStreamDestroy(stream);
+    cout << "testHostAlloc finished ok" << endl;
+}
+
+void testHostRegister() {
+    int N = 1024;
+    cudaStream_t stream;
+    cudaStreamCreate(&stream);
+
+    float *hostFloats = new float[N];
+    cudaHostRegister(hostFloats, N * sizeof(float), cudaHostRegisterDefault);
+    checkRoundTrip(hostFloats, N, stream);
+    cudaHostUnregister(hostFloats);
+    delete[] hostFloats;
+
+    cudaStreamDestroy(stream);
+    cout << "testHostRegister finished ok" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    testHostAlloc();
+    testHostRegister();
+    return 0;
+}
@@ -0,0 +1,77 @@
+// double indirection, ie float **, in kernel parameter
+
+// unlike test_floatstarstar, each buffer gets its own cudaMalloc. this only works with the slab
+// allocator, which carves them all out of one single clmem
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cstdlib>
+
+using namespace std;
+
+#include <cuda.h>
+
+struct BoundedArray {
+    float *bounded_array[8];
+};
+
+__global__ void run_bounded_array(struct BoundedArray boundedArray, int numBuffers, int N) {
+    for(int i = 0; i < numBuffers; i++) {
+        for(int j = 0; j < N; j++) {
+            boundedArray.bounded_array[i][j] = 123.0f + i + 1 + j;
+        }
+    }
+}
+
+void test1() {
+    int N = 1024;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    const int numBuffers = 3;
+
+    struct BoundedArray boundedArray;
+    float *hostFloats[numBuffers];
+
+    for(int i = 0; i < numBuffers; i++) {
+        cudaMalloc((void **)&boundedArray.bounded_array[i], N * sizeof(float));
+        std::cout << "bounded_array[" << i << "]=" << (long)boundedArray.bounded_array[i] << std::endl;
+        hostFloats[i] = new float[N];
+    }
+
+    run_bounded_array<<<dim3(1,1,1), dim3(32,1,1), 0, stream>>>(boundedArray, numBuffers, N);
+
+    for(int i = 0; i < numBuffers; i++) {
+        cudaMemcpy(hostFloats[i], boundedArray.bounded_array[i], N * sizeof(float), cudaMemcpyDeviceToHost);
+    }
+    cuStreamSynchronize(stream);
+
+    for(int i = 0; i < numBuffers; i++) {
+        for(int j=0; j < N; j++) {
+            float expected = 123.0f + 1 + i + j;
+            float actual = hostFloats[i][j];
+            if(actual != expected) {
+                std::cout << "mismatch for i=" << i << " j=" << j << " expected=" << expected << " actual=" << actual << std::endl;
+                assert(false);
+            }
+        }
+    }
+
+    for(int i=0; i < numBuffers; i++) {
+        delete[] hostFloats[i];
+        cudaFree(boundedArray.bounded_array[i]);
+    }
+
+    cuStreamDestroy(stream);
+    std::cout << "test1 finished ok" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    // needs to be set before the context is created, ie before the first cuda call
+    setenv("COCL_SLAB_ALLOCATOR", "1", 1);
+    setenv("COCL_SLAB_BYTES", "16777216", 1);
+    test1();
+    return 0;
+}
@@ -0,0 +1,63 @@
+// tests coclWarmupKernels: the kernels should be built in the background, in the variant the
+// launches below use, so launching them doesnt add any more variants
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addArrays(float *out, float *in, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = out[tid] + in[tid];
+    }
+}
+
+__global__ void timesTwo(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] = data[tid] * 2.0f;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    coclWarmupKernels();
+
+    int N = 1000;
+    float *hostOut = new float[N];
+    float *hostIn = new float[N];
+    for(int i = 0; i < N; i++) {
+        hostOut[i] = (float)i;
+        hostIn[i] = 3.0f;
+    }
+    float *deviceOut;
+    float *deviceIn;
+    cudaMalloc((void **)&deviceOut, N * sizeof(float));
+    cudaMalloc((void **)&deviceIn, N * sizeof(float));
+    cudaMemcpy(deviceOut, hostOut, N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(deviceIn, hostIn, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    // these wait for the warmup threads, if they havent got to these kernels yet
+    addArrays<<<dim3((N + 63) / 64, 1, 1), dim3(64, 1, 1)>>>(deviceOut, deviceIn, N);
+    timesTwo<<<dim3((N + 63) / 64, 1, 1), dim3(64, 1, 1)>>>(deviceOut, N);
+    cudaMemcpy(hostOut, deviceOut, N * sizeof(float), cudaMemcpyDeviceToHost);
+    for(int i = 0; i < N; i++) {
+        if(hostOut[i] != ((float)i + 3.0f) * 2.0f) {
+            cout << "mismatch i=" << i << " actual=" << hostOut[i] << endl;
+            assert(false);
+        }
+    }
+    cout << "num cached kernels " << cocl::getNumCachedKernels() << endl;
+    assert(cocl::getNumCachedKernels() == 2);
+
+    cudaFree(deviceOut);
+    cudaFree(deviceIn);
+    delete[] hostOut;
+    delete[] hostIn;
+
+    cout << "finished ok" << endl;
+    return 0;
+}
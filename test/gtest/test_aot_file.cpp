@@ -0,0 +1,147 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_aot_file.h"
+#include "cocl/cocl_clsources.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+// prebuilt kernels are keyed on the address of the device ir, so these dont collide with other tests
+const char testDevicell[] = "some device ir";
+const char otherDevicell[] = "some device ir";
+
+string makeTempFile() {
+    char fileTemplate[] = "/tmp/cocl_aot_XXXXXX";
+    int fd = mkstemp(fileTemplate);
+    close(fd);
+    return fileTemplate;
+}
+
+AotKernel makeAotKernel(string kernelName, string clmemIndexes, int uniqueClmemCount, bool offsets32bit) {
+    AotKernel kernel;
+    kernel.kernelName = kernelName;
+    kernel.clmemIndexes = clmemIndexes;
+    kernel.uniqueClmemCount = uniqueClmemCount;
+    kernel.offsets32bit = offsets32bit;
+    kernel.usesScratch = true;
+    kernel.numClmemArgs = uniqueClmemCount;
+    // the opencl can contain newlines, and things that look like headers
+    kernel.clSourcecode = "kernel void " + kernelName + "() {\n}\nkernel foo 1 2 3\n";
+    return kernel;
+}
+
+void registerAotKernel(const char *devicell, const AotKernel &kernel) {
+    // as the global constructor patch_hostside adds does. the strings have to live as long as the
+    // process
+    coclRegisterPrebuiltKernel(devicell, (new string(kernel.kernelName))->c_str(), (new string(kernel.clmemIndexes))->c_str(),
+        kernel.uniqueClmemCount, kernel.offsets32bit, kernel.usesVmem, kernel.usesScratch, kernel.usesDynamicShared,
+        kernel.numClmemArgs, (new string(kernel.clSourcecode))->c_str());
+}
+
+TEST(test_aot_file, test_write_read) {
+    string filename = makeTempFile();
+    {
+        ofstream f(filename, ios_base::out | ios_base::binary);
+        writeAotFileMagic(f);
+        writeAotKernel(f, makeAotKernel("mykernel", "1,2,3", 4, false));
+        writeAotKernel(f, makeAotKernel("nopointers", "", 1, true));
+    }
+    {
+        ifstream f(filename);
+        string magic;
+        getline(f, magic);
+        EXPECT_EQ("cocl-aot-v1", magic);
+    }
+
+    vector<AotKernel> kernels = readAotFile(filename);
+    ASSERT_EQ(2u, kernels.size());
+    EXPECT_EQ("mykernel", kernels[0].kernelName);
+    EXPECT_EQ("1,2,3", kernels[0].clmemIndexes);
+    EXPECT_EQ(4, kernels[0].uniqueClmemCount);
+    EXPECT_FALSE(kernels[0].offsets32bit);
+    EXPECT_FALSE(kernels[0].usesVmem);
+    EXPECT_TRUE(kernels[0].usesScratch);
+    EXPECT_FALSE(kernels[0].usesDynamicShared);
+    EXPECT_EQ(4, kernels[0].numClmemArgs);
+    EXPECT_EQ(makeAotKernel("mykernel", "1,2,3", 4, false).clSourcecode, kernels[0].clSourcecode);
+    EXPECT_EQ("nopointers", kernels[1].kernelName);
+    EXPECT_EQ("", kernels[1].clmemIndexes);
+    EXPECT_EQ(1, kernels[1].uniqueClmemCount);
+    EXPECT_TRUE(kernels[1].offsets32bit);
+    unlink(filename.c_str());
+}
+
+TEST(test_aot_file, test_bad_file) {
+    string filename = makeTempFile();
+    {
+        ofstream f(filename, ios_base::out | ios_base::binary);
+        f << "cocl-aot-v0\n";
+    }
+    EXPECT_THROW(readAotFile(filename), runtime_error);
+    {
+        // says 1000 bytes of opencl, but there arent that many
+        ofstream f(filename, ios_base::out | ios_base::binary);
+        writeAotFileMagic(f);
+        f << "kernel mykernel 1 2 0 0 0 0 1 1000\nkernel void mykernel() {}\n";
+    }
+    EXPECT_THROW(readAotFile(filename), runtime_error);
+    unlink(filename.c_str());
+}
+
+TEST(test_aot_file, test_find_prebuilt_kernel) {
+    string filename = makeTempFile();
+    {
+        ofstream f(filename, ios_base::out | ios_base::binary);
+        writeAotFileMagic(f);
+        writeAotKernel(f, makeAotKernel("mykernel", "1,2,3", 4, false));
+    }
+    vector<AotKernel> kernels = readAotFile(filename);
+    ASSERT_EQ(1u, kernels.size());
+    registerAotKernel(testDevicell, kernels[0]);
+
+    vector<int> clmemIndexes = {1, 2, 3};
+    PrebuiltKernel prebuiltKernel;
+    ASSERT_TRUE(findPrebuiltKernel(testDevicell, "mykernel", 4, clmemIndexes, false, &prebuiltKernel));
+    EXPECT_EQ(kernels[0].clSourcecode, prebuiltKernel.clSourcecode);
+    EXPECT_TRUE(prebuiltKernel.usesScratch);
+    EXPECT_FALSE(prebuiltKernel.usesVmem);
+    EXPECT_EQ(4, prebuiltKernel.numClmemArgs);
+
+    EXPECT_FALSE(findPrebuiltKernel(testDevicell, "otherkernel", 4, clmemIndexes, false, &prebuiltKernel));
+    EXPECT_FALSE(findPrebuiltKernel(testDevicell, "mykernel", 3, clmemIndexes, false, &prebuiltKernel));
+    vector<int> sharedClmemIndexes = {1, 1, 1};
+    EXPECT_FALSE(findPrebuiltKernel(testDevicell, "mykernel", 4, sharedClmemIndexes, false, &prebuiltKernel));
+    vector<int> fewerClmemIndexes = {1, 2};
+    EXPECT_FALSE(findPrebuiltKernel(testDevicell, "mykernel", 4, fewerClmemIndexes, false, &prebuiltKernel));
+    EXPECT_FALSE(findPrebuiltKernel(testDevicell, "mykernel", 4, clmemIndexes, true, &prebuiltKernel));
+    // same ir text, but a different module
+    EXPECT_FALSE(findPrebuiltKernel(otherDevicell, "mykernel", 4, clmemIndexes, false, &prebuiltKernel));
+    unlink(filename.c_str());
+}
+
+} // namespace
@@ -0,0 +1,67 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_arg_ring_buffer.h"
+
+#include "cocl/cocl.h"
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+namespace {
+
+TEST(test_arg_ring_buffer, test_write_and_wrap) {
+    ThreadVars *v = getThreadVars();
+    EasyCL *cl = v->getContext()->getCl();
+    cl_command_queue queue = v->getContext()->default_stream.get()->clqueue->queue;
+    // 4 segments of 1KB, so 4 structs of 200 bytes (256 aligned) per segment
+    ArgRingBuffer ring(cl, queue, 4096, 4);
+    EXPECT_EQ(1024u, ring.segmentBytes);
+    EXPECT_EQ(-1, ring.write(0, 1025));
+
+    vector<long long> offsets;
+    for(int i = 0; i < 100; i++) {
+        unsigned char data[200];
+        for(int j = 0; j < 200; j++) {
+            data[j] = (unsigned char)(i + j);
+        }
+        long long offset = ring.write(data, sizeof(data));
+        ASSERT_GE(offset, 0);
+        EXPECT_EQ(0, offset % ArgRingBuffer::alignment);
+        EXPECT_LE(offset + 200, 4096);
+        // pieces dont straddle segments
+        EXPECT_EQ(offset / 1024, (offset + 199) / 1024);
+        offsets.push_back(offset);
+
+        unsigned char readBack[200];
+        cl_int err = clEnqueueReadBuffer(queue, ring.clmem, CL_TRUE, offset, sizeof(readBack), readBack, 0, 0, 0);
+        EasyCL::checkError(err);
+        for(int j = 0; j < 200; j++) {
+            ASSERT_EQ((int)data[j], (int)readBack[j]);
+        }
+    }
+    // went round more than once
+    EXPECT_EQ(offsets[0], offsets[16]);
+    EXPECT_EQ(offsets[3], offsets[19]);
+    EXPECT_EQ(1024, offsets[4]);
+}
+
+} // namespace
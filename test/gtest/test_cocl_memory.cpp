@@ -0,0 +1,252 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_memory.h"
+#include "cocl/cocl_caching_allocator.h"
+#include "cocl/cocl_slab_allocator.h"
+#include "cocl/cocl_memory_stats.h"
+
+#include "cocl/cocl.h"
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+namespace {
+
+// lets us register lots of allocations without creating a cl buffer for each one. they all
+// share a single real clmem, which we retain once per allocation, so the destructors balance out
+class SharedClmemMemory : public Memory {
+public:
+    SharedClmemMemory(cl_mem clmem, size_t bytes) : Memory(clmem, bytes) {
+        clRetainMemObject(clmem);
+    }
+};
+
+cl_mem createSmallBuffer() {
+    ThreadVars *v = getThreadVars();
+    EasyCL *cl = v->getContext()->getCl();
+    cl_int err;
+    cl_mem clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, 128, NULL, &err);
+    EasyCL::checkError(err);
+    return clmem;
+}
+
+TEST(test_cocl_memory, test_find_memory) {
+    cl_mem clmem = createSmallBuffer();
+    vector<Memory *> memories;
+    size_t sizes[] = {4, 128, 300, 1, 1024};
+    for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        memories.push_back(new SharedClmemMemory(clmem, sizes[i]));
+    }
+    for(auto it=memories.begin(); it != memories.end(); it++) {
+        Memory *memory = *it;
+        char *start = (char *)memory->fakePos;
+        EXPECT_EQ(memory, findMemory(start));
+        EXPECT_EQ(memory, findMemory(start + memory->bytes - 1));
+        EXPECT_EQ(0u, memory->getOffset(start));
+        if(memory->bytes % 128 != 0) {
+            // allocations are 128-byte aligned, so there is a gap after this one
+            EXPECT_EQ(0, findMemory(start + memory->bytes));
+        }
+    }
+    EXPECT_EQ(0, findMemory((char *)0));
+
+    // deleted allocations are no longer found
+    Memory *second = memories[1];
+    char *secondStart = (char *)second->fakePos;
+    delete second;
+    EXPECT_EQ(0, findMemory(secondStart));
+    EXPECT_EQ(memories[0], findMemory((char *)memories[0]->fakePos));
+    EXPECT_EQ(memories[2], findMemory((char *)memories[2]->fakePos));
+
+    for(size_t i = 0; i < memories.size(); i++) {
+        if(i != 1) {
+            delete memories[i];
+        }
+    }
+    clReleaseMemObject(clmem);
+}
+
+TEST(test_cocl_memory, DISABLED_benchmark_find_memory) {
+    // not run by default, since it takes a while. run with --gtest_also_run_disabled_tests
+    // lookup cost should stay roughly flat as the number of live allocations grows
+    cl_mem clmem = createSmallBuffer();
+    int counts[] = {10, 1000, 100000, 1000000};
+    const int numLookups = 1000000;
+    for(int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+        int count = counts[c];
+        vector<Memory *> memories;
+        for(int i = 0; i < count; i++) {
+            memories.push_back(new SharedClmemMemory(clmem, 200));
+        }
+        size_t found = 0;
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < numLookups; i++) {
+            Memory *memory = memories[((size_t)i * 7919) % count];
+            if(findMemory((char *)(memory->fakePos + 100)) == memory) {
+                found++;
+            }
+        }
+        auto end = chrono::steady_clock::now();
+        double nsPerLookup = chrono::duration<double, nano>(end - start).count() / numLookups;
+        cout << "allocations=" << count << " ns/lookup=" << nsPerLookup << endl;
+        EXPECT_EQ((size_t)numLookups, found);
+        for(auto it=memories.begin(); it != memories.end(); it++) {
+            delete *it;
+        }
+    }
+    clReleaseMemObject(clmem);
+}
+
+TEST(test_cocl_memory, test_caching_allocator_bins) {
+    EXPECT_EQ(512u, CachingAllocator::getBinBytes(1));
+    EXPECT_EQ(512u, CachingAllocator::getBinBytes(512));
+    EXPECT_EQ(1024u, CachingAllocator::getBinBytes(513));
+    EXPECT_EQ((size_t)1 << 30, CachingAllocator::getBinBytes(((size_t)1 << 30) - 1));
+    EXPECT_EQ(0u, CachingAllocator::getBinBytes(((size_t)1 << 30) + 1));
+}
+
+TEST(test_cocl_memory, test_caching_allocator) {
+    ThreadVars *v = getThreadVars();
+    CachingAllocator allocator(v->getContext(), 4096);
+
+    Memory *a = allocator.allocate(1000);
+    EXPECT_EQ(1024u, a->bytes);
+    EXPECT_EQ(a, findMemory((char *)a->fakePos));
+    cl_mem clmemA = a->clmem;
+    size_t fakePosA = a->fakePos;
+    allocator.release(a);
+    // parked in the cache, so no longer visible to lookups
+    EXPECT_EQ(0, findMemory((char *)fakePosA));
+
+    CachingAllocatorStats stats = allocator.getStats();
+    EXPECT_EQ(0u, stats.hits);
+    EXPECT_EQ(1u, stats.misses);
+    EXPECT_EQ(0u, stats.bytesInUse);
+    EXPECT_EQ(1024u, stats.bytesCached);
+
+    // same bin => same clmem comes back. the markers recorded when it was freed have been turned
+    // into barriers, or had already completed
+    Memory *b = allocator.allocate(600);
+    EXPECT_EQ(clmemA, b->clmem);
+    EXPECT_EQ(0u, b->releaseMarkers.size());
+    EXPECT_EQ(b, findMemory((char *)b->fakePos));
+    stats = allocator.getStats();
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(1024u, stats.bytesInUse);
+    EXPECT_EQ(0u, stats.bytesCached);
+
+    // going over the high-water mark releases to the driver instead of caching
+    Memory *c = allocator.allocate(4096);
+    allocator.release(b);
+    allocator.release(c);
+    stats = allocator.getStats();
+    EXPECT_EQ(1024u, stats.bytesCached);
+    EXPECT_EQ(4096u, stats.bytesReleased);
+
+    allocator.trim();
+    stats = allocator.getStats();
+    EXPECT_EQ(0u, stats.bytesCached);
+    EXPECT_EQ(4096u + 1024u, stats.bytesReleased);
+}
+
+TEST(test_cocl_memory, test_slab_allocator) {
+    ThreadVars *v = getThreadVars();
+    SlabAllocator allocator(v->getContext(), 4096);
+
+    Memory *a = allocator.allocate(100);
+    Memory *b = allocator.allocate(1000);
+    Memory *c = allocator.allocate(128);
+    ASSERT_EQ(1u, allocator.slabs.size());
+    Memory *slab = allocator.getFirstSlab();
+
+    // suballocations share the slab clmem, and map straight onto slab offsets
+    EXPECT_EQ(slab->clmem, a->clmem);
+    EXPECT_EQ(slab->clmem, b->clmem);
+    EXPECT_EQ(0u, a->slabOffset);
+    EXPECT_EQ(128u, b->slabOffset);
+    EXPECT_EQ(128u + 1024u, c->slabOffset);
+    EXPECT_EQ(slab->fakePos + b->slabOffset, b->fakePos);
+    EXPECT_EQ(b, findMemory((char *)b->fakePos + 10));
+    EXPECT_EQ(b->slabOffset + 10, b->getOffset((char *)b->fakePos + 10));
+    EXPECT_EQ(slab, findMemoryByClmem(slab->clmem));
+
+    // freed blocks coalesce, so a and b's space can be reused for one bigger allocation
+    allocator.release(a);
+    allocator.release(b);
+    Memory *d = allocator.allocate(1100);
+    EXPECT_EQ(0u, d->slabOffset);
+    // d took the whole merged block, so its release markers went with it
+    EXPECT_EQ(0u, allocator.slabs[0]->releaseMarkersByOffset.count(0));
+
+    // too big for whats left => overflow slab, which goes away again once empty
+    Memory *e = allocator.allocate(4000);
+    EXPECT_EQ(2u, allocator.slabs.size());
+    EXPECT_NE(slab->clmem, e->clmem);
+    allocator.release(e);
+    EXPECT_EQ(1u, allocator.slabs.size());
+
+    allocator.release(c);
+    allocator.release(d);
+    EXPECT_EQ(1u, allocator.slabs[0]->freeBytesByOffset.size());
+    EXPECT_EQ(4096u, allocator.slabs[0]->freeBytesByOffset[0]);
+}
+
+TEST(test_cocl_memory, test_memory_stats) {
+    EXPECT_EQ(0, MemoryStats::getHistogramBin(0));
+    EXPECT_EQ(1, MemoryStats::getHistogramBin(1));
+    EXPECT_EQ(10, MemoryStats::getHistogramBin(1000));
+    EXPECT_EQ(11, MemoryStats::getHistogramBin(1024));
+
+    MemoryStats before = getMemoryStats();
+
+    void *a;
+    void *b;
+    cudaMalloc(&a, 1000);
+    cudaMalloc(&b, 1024 * 1024);
+    MemoryStats stats = getMemoryStats();
+    EXPECT_EQ(before.allocatedBytes + 1000 + 1024 * 1024, stats.allocatedBytes);
+    EXPECT_EQ(before.numAllocations + 2, stats.numAllocations);
+    EXPECT_EQ(before.totalAllocations + 2, stats.totalAllocations);
+    EXPECT_EQ(before.histogram[10] + 1, stats.histogram[10]);
+    EXPECT_EQ(before.histogram[21] + 1, stats.histogram[21]);
+    EXPECT_LE(stats.allocatedBytes, stats.deviceBytes);
+    EXPECT_GE(stats.peakAllocatedBytes, stats.allocatedBytes);
+    EXPECT_EQ(stats.deviceBytes - stats.allocatedBytes, stats.reservedBytes);
+
+    // free memory reflects what we're holding, not the max alloc size
+    size_t freeAfter, total;
+    cuMemGetInfo(&freeAfter, &total);
+    EXPECT_EQ(total - stats.deviceBytes, freeAfter);
+
+    cudaFree(a);
+    cudaFree(b);
+    stats = getMemoryStats();
+    EXPECT_EQ(before.allocatedBytes, stats.allocatedBytes);
+    EXPECT_EQ(before.numAllocations, stats.numAllocations);
+    EXPECT_EQ(before.totalFrees + 2, stats.totalFrees);
+    EXPECT_EQ(before.histogram[21], stats.histogram[21]);
+    cout << stats.toString() << endl;
+}
+
+} // namespace
@@ -0,0 +1,165 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/fill_buffer.h"
+
+#include "cocl/cocl.h"
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+namespace {
+
+cl_command_queue getQueue() {
+    ThreadVars *v = getThreadVars();
+    return v->getContext()->default_stream.get()->clqueue->queue;
+}
+
+cl_mem createBuffer(size_t bytes) {
+    ThreadVars *v = getThreadVars();
+    EasyCL *cl = v->getContext()->getCl();
+    cl_int err;
+    cl_mem clmem = clCreateBuffer(*cl->context, CL_MEM_READ_WRITE, bytes, NULL, &err);
+    EasyCL::checkError(err);
+    return clmem;
+}
+
+void checkFill(int patternBytes, size_t offset, size_t count) {
+    unsigned char pattern[8] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88};
+    size_t bytes = offset + count + 64;
+    cl_mem clmem = createBuffer(bytes);
+    cl_command_queue queue = getQueue();
+    vector<unsigned char> host(bytes, 0xab);
+    cl_int err = clEnqueueWriteBuffer(queue, clmem, CL_TRUE, 0, bytes, &host[0], 0, 0, 0);
+    EasyCL::checkError(err);
+
+    getFillEngine()->fill(queue, clmem, pattern, patternBytes, offset, count);
+
+    err = clEnqueueReadBuffer(queue, clmem, CL_TRUE, 0, bytes, &host[0], 0, 0, 0);
+    EasyCL::checkError(err);
+    for(size_t i = 0; i < bytes; i++) {
+        unsigned char expected = 0xab;
+        if(i >= offset && i < offset + count) {
+            expected = pattern[(i - offset) % patternBytes];
+        }
+        if(host[i] != expected) {
+            cout << "patternBytes=" << patternBytes << " offset=" << offset << " count=" << count << " i=" << i << endl;
+            ASSERT_EQ((int)expected, (int)host[i]);
+        }
+    }
+    clReleaseMemObject(clmem);
+}
+
+TEST(test_fill_buffer, test_patterns) {
+    size_t counts[] = {1, 16, 1000, FillEngine::minKernelBytes, FillEngine::minKernelBytes + 8,
+        FillEngine::minUint4Bytes, FillEngine::minUint4Bytes + 24};
+    int patternSizes[] = {1, 2, 4, 8};
+    for(int p = 0; p < 4; p++) {
+        int patternBytes = patternSizes[p];
+        for(int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+            size_t count = (counts[c] / patternBytes) * patternBytes;
+            // offsets have to be multiples of the pattern size
+            for(size_t offset = 0; offset <= 24; offset += 8 + patternBytes) {
+                checkFill(patternBytes, offset, count);
+            }
+        }
+    }
+}
+
+TEST(test_fill_buffer, test_prepared_fill) {
+    // small and big fills, then each prepared again at another offset, as a graph pointer update would
+    size_t counts[] = {1000, FillEngine::minKernelBytes + 8, FillEngine::minUint4Bytes + 24};
+    for(int c = 0; c < (int)(sizeof(counts) / sizeof(counts[0])); c++) {
+        size_t count = counts[c];
+        size_t bytes = count + 64;
+        cl_mem clmem = createBuffer(bytes);
+        cl_command_queue queue = getQueue();
+        vector<unsigned char> host(bytes, 0xab);
+        cl_int err = clEnqueueWriteBuffer(queue, clmem, CL_TRUE, 0, bytes, &host[0], 0, 0, 0);
+        EasyCL::checkError(err);
+
+        PreparedFill fill;
+        getFillEngine()->prepareFill(&fill, clmem, 0x11, 3, count);
+        EXPECT_EQ(count >= FillEngine::minKernelBytes, fill.kernel != 0);
+        fill.enqueue(queue);
+        getFillEngine()->prepareFill(&fill, clmem, 0x22, 40, count);
+        fill.enqueue(queue);
+
+        err = clEnqueueReadBuffer(queue, clmem, CL_TRUE, 0, bytes, &host[0], 0, 0, 0);
+        EasyCL::checkError(err);
+        for(size_t i = 0; i < bytes; i++) {
+            unsigned char expected = 0xab;
+            if(i >= 40 && i < 40 + count) {
+                expected = 0x22;
+            } else if(i >= 3 && i < 3 + count) {
+                expected = 0x11;
+            }
+            if(host[i] != expected) {
+                cout << "count=" << count << " i=" << i << endl;
+                ASSERT_EQ((int)expected, (int)host[i]);
+            }
+        }
+        clReleaseMemObject(clmem);
+    }
+}
+
+TEST(test_fill_buffer, DISABLED_benchmark_fill) {
+    // not run by default, since it takes a while. run with --gtest_also_run_disabled_tests
+    // compares with clEnqueueFillBuffer, for a single-byte pattern, from 4 bytes to 1GB
+    ThreadVars *v = getThreadVars();
+    cl_device_id deviceId = v->getContext()->getCl()->device;
+    size_t maxBytes = 1024 * 1024 * 1024;
+    size_t maxAlloc = getDeviceInfoInt64(deviceId, CL_DEVICE_MAX_MEM_ALLOC_SIZE);
+    if(maxBytes > maxAlloc) {
+        maxBytes = maxAlloc;
+    }
+    cl_mem clmem = createBuffer(maxBytes);
+    cl_command_queue queue = getQueue();
+    FillEngine *fillEngine = getFillEngine();
+    unsigned char value = 0x12;
+    for(size_t bytes = 4; bytes <= maxBytes; bytes *= 4) {
+        int its = bytes < 1024 * 1024 ? 100 : 10;
+        double times[2];
+        for(int method = 0; method < 2; method++) {
+            // warm up
+            fillEngine->fill(queue, clmem, &value, 1, 0, bytes);
+            clFinish(queue);
+            auto start = chrono::steady_clock::now();
+            for(int it = 0; it < its; it++) {
+                if(method == 0) {
+                    fillEngine->fill(queue, clmem, &value, 1, 0, bytes);
+                } else {
+                    cl_int err = clEnqueueFillBuffer(queue, clmem, &value, 1, 0, bytes, 0, 0, 0);
+                    EasyCL::checkError(err);
+                }
+            }
+            clFinish(queue);
+            auto end = chrono::steady_clock::now();
+            times[method] = chrono::duration<double, micro>(end - start).count() / its;
+        }
+        cout << "bytes=" << bytes << " FillEngine=" << times[0] << "us clEnqueueFillBuffer=" << times[1] << "us" << endl;
+    }
+    clReleaseMemObject(clmem);
+}
+
+} // namespace
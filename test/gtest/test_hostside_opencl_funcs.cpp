@@ -57,4 +57,75 @@ kernel void myKernel(global float *data) {
     delete [] hostdata;
 }
 
+TEST(test_hostside_opencl_funcs, test_stream_kernel_skips_unchanged_args) {
+    string kernelSource = R"(
+kernel void addValue(global float *data, float value, local int *scratch) {
+    data[get_global_id(0)] += value;
+}
+)";
+    ThreadVars *v = getThreadVars();
+    cl_command_queue queue = v->getContext()->default_stream.get()->clqueue->queue;
+    CLKernel *clKernel = compileOpenCLKernel("addValue", kernelSource);
+    StreamKernel streamKernel(clKernel);
+    EXPECT_NE(clKernel->kernel, streamKernel.kernel);
+
+    const int N = 32;
+    Memory *memory = Memory::newDeviceAlloc(N * sizeof(float));
+    float zero = 0.0f;
+    cl_int err = clEnqueueFillBuffer(queue, memory->clmem, &zero, sizeof(float), 0, N * sizeof(float), 0, 0, 0);
+    EasyCL::checkError(err);
+
+    size_t global = N;
+    size_t workgroupSize = 32;
+    float values[] = {1.0f, 1.0f, 2.0f};
+    for(int it = 0; it < 3; it++) {
+        std::lock_guard<std::mutex> lock(streamKernel.mu);
+        streamKernel.setMemArg(0, memory->clmem);
+        streamKernel.setArg(1, sizeof(float), &values[it]);
+        streamKernel.setArg(2, workgroupSize * sizeof(int), 0);
+        err = clEnqueueNDRangeKernel(queue, streamKernel.kernel, 1, 0, &global, &workgroupSize, 0, 0, 0);
+        EasyCL::checkError(err);
+    }
+    // 3 args on the first launch, just the clmem on the second, the clmem and the value on the
+    // third. clmems are always set, since a released one's handle can be reused
+    EXPECT_EQ(6, streamKernel.numClSetKernelArgCalls);
+
+    float hostdata[N];
+    err = clEnqueueReadBuffer(queue, memory->clmem, CL_TRUE, 0, N * sizeof(float), hostdata, 0, NULL, NULL);
+    EasyCL::checkError(err);
+    EXPECT_EQ(4.0f, hostdata[0]);
+    EXPECT_EQ(4.0f, hostdata[N - 1]);
+    delete memory;
+}
+
+TEST(test_hostside_opencl_funcs, test_launch_args) {
+    LaunchArgs args;
+    args.addInt8(-3);
+    args.addInt32(123456);
+    args.addUInt32(4000000000u);
+    args.addInt64(-12345678901234ll);
+    args.addFloat(1.5f);
+    EXPECT_EQ(5, args.size());
+
+    EXPECT_EQ(LaunchArgs::AT_Int8, args.getType(0));
+    EXPECT_EQ(1u, args.getSize(0));
+    EXPECT_EQ(-3, args.getInteger(0));
+    EXPECT_EQ(4u, args.getSize(1));
+    EXPECT_EQ(123456, args.getInteger(1));
+    EXPECT_EQ(4000000000ll, args.getInteger(2));
+    EXPECT_EQ(8u, args.getSize(3));
+    EXPECT_EQ(-12345678901234ll, args.getInteger(3));
+    EXPECT_EQ(0u, (size_t)args.getValue(3) % 8);
+    EXPECT_EQ(1.5f, *(const float *)args.getValue(4));
+    EXPECT_THROW(args.getInteger(4), runtime_error);
+
+    args.clear();
+    EXPECT_EQ(0, args.size());
+    for(int i = 0; i < LaunchArgs::maxArgs; i++) {
+        args.addInt64(i);
+    }
+    EXPECT_EQ(LaunchArgs::maxArgs - 1, args.getInteger(LaunchArgs::maxArgs - 1));
+    EXPECT_THROW(args.addInt32(0), runtime_error);
+}
+
 } // namespace
@@ -0,0 +1,138 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_kernel_disk_cache.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+string makeTempDir() {
+    char dirTemplate[] = "/tmp/cocl_kernel_cache_XXXXXX";
+    return mkdtemp(dirTemplate);
+}
+
+KernelDiskCacheEntry makeEntry(string clSourcecode, size_t binaryBytes) {
+    KernelDiskCacheEntry entry;
+    entry.clSourcecode = clSourcecode;
+    entry.kernelInfo.usesScratch = true;
+    entry.kernelInfo.numClmemArgs = 3;
+    for(size_t i = 0; i < binaryBytes; i++) {
+        entry.programBinary.push_back((unsigned char)(i * 7));
+    }
+    return entry;
+}
+
+void setLastUsed(const KernelDiskCache &cache, string key, time_t when) {
+    struct utimbuf times;
+    times.actime = when;
+    times.modtime = when;
+    utime((cache.cacheDir + "/" + key + ".coclkernel").c_str(), &times);
+}
+
+bool entryExists(const KernelDiskCache &cache, string key) {
+    struct stat st;
+    return stat((cache.cacheDir + "/" + key + ".coclkernel").c_str(), &st) == 0;
+}
+
+TEST(test_kernel_disk_cache, test_store_load) {
+    KernelDiskCache cache(makeTempDir(), 1024 * 1024, "somedevice");
+    vector<int> clmemIndexByClmemArgIndex = {0, 0, 1};
+    string key = cache.makeKey("some ir", "mykernel", 2, clmemIndexByClmemArgIndex, false);
+
+    KernelDiskCacheEntry loaded;
+    EXPECT_FALSE(cache.load(key, &loaded));
+    EXPECT_EQ(1, cache.numMisses.load());
+
+    cache.store(key, makeEntry("kernel void mykernel() {}", 100));
+    EXPECT_EQ(1, cache.numStores.load());
+    ASSERT_TRUE(cache.load(key, &loaded));
+    EXPECT_EQ(1, cache.numHits.load());
+    EXPECT_EQ("kernel void mykernel() {}", loaded.clSourcecode);
+    EXPECT_TRUE(loaded.kernelInfo.usesScratch);
+    EXPECT_FALSE(loaded.kernelInfo.usesVmem);
+    EXPECT_FALSE(loaded.kernelInfo.usesDynamicShared);
+    EXPECT_EQ(3, loaded.kernelInfo.numClmemArgs);
+    EXPECT_EQ(makeEntry("", 100).programBinary, loaded.programBinary);
+}
+
+TEST(test_kernel_disk_cache, test_key) {
+    KernelDiskCache cache(makeTempDir(), 1024 * 1024, "somedevice");
+    KernelDiskCache otherDeviceCache(cache.cacheDir, 1024 * 1024, "otherdevice");
+    vector<int> clmemIndexByClmemArgIndex = {0, 0, 1};
+    vector<int> otherClmemIndexByClmemArgIndex = {0, 1, 1};
+    string key = cache.makeKey("some ir", "mykernel", 2, clmemIndexByClmemArgIndex, false);
+    EXPECT_EQ(32u, key.size());
+    EXPECT_EQ(key, cache.makeKey("some ir", "mykernel", 2, clmemIndexByClmemArgIndex, false));
+    EXPECT_NE(key, cache.makeKey("other ir", "mykernel", 2, clmemIndexByClmemArgIndex, false));
+    EXPECT_NE(key, cache.makeKey("some ir", "otherkernel", 2, clmemIndexByClmemArgIndex, false));
+    EXPECT_NE(key, cache.makeKey("some ir", "mykernel", 2, otherClmemIndexByClmemArgIndex, false));
+    EXPECT_NE(key, cache.makeKey("some ir", "mykernel", 2, clmemIndexByClmemArgIndex, true));
+    EXPECT_NE(key, otherDeviceCache.makeKey("some ir", "mykernel", 2, clmemIndexByClmemArgIndex, false));
+}
+
+TEST(test_kernel_disk_cache, test_evict_least_recently_used) {
+    // each entry is a bit over 1000 bytes, and there's room for three
+    KernelDiskCache cache(makeTempDir(), 3500, "somedevice");
+    vector<int> clmemIndexByClmemArgIndex = {0};
+    vector<string> keys;
+    for(int i = 0; i < 3; i++) {
+        string key = cache.makeKey("ir" + to_string(i), "mykernel", 1, clmemIndexByClmemArgIndex, false);
+        cache.store(key, makeEntry("source", 1000));
+        keys.push_back(key);
+    }
+    setLastUsed(cache, keys[0], 1000);
+    setLastUsed(cache, keys[1], 3000);
+    setLastUsed(cache, keys[2], 2000);
+    for(int i = 0; i < 3; i++) {
+        EXPECT_TRUE(entryExists(cache, keys[i]));
+    }
+
+    // loading keys[0] makes it the most recently used, so keys[2] goes first, then keys[1]
+    KernelDiskCacheEntry loaded;
+    ASSERT_TRUE(cache.load(keys[0], &loaded));
+    string newKey = cache.makeKey("ir3", "mykernel", 1, clmemIndexByClmemArgIndex, false);
+    cache.store(newKey, makeEntry("source", 1000));
+    EXPECT_TRUE(entryExists(cache, keys[0]));
+    EXPECT_TRUE(entryExists(cache, keys[1]));
+    EXPECT_FALSE(entryExists(cache, keys[2]));
+    EXPECT_TRUE(entryExists(cache, newKey));
+}
+
+TEST(test_kernel_disk_cache, test_unreadable_entry) {
+    KernelDiskCache cache(makeTempDir(), 1024 * 1024, "somedevice");
+    vector<int> clmemIndexByClmemArgIndex = {0};
+    string key = cache.makeKey("some ir", "mykernel", 1, clmemIndexByClmemArgIndex, false);
+    ofstream f(cache.cacheDir + "/" + key + ".coclkernel");
+    f << "truncated";
+    f.close();
+    KernelDiskCacheEntry loaded;
+    EXPECT_FALSE(cache.load(key, &loaded));
+    EXPECT_EQ(1, cache.numMisses.load());
+}
+
+} // namespace
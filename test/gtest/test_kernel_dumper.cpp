@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include "cocl/kernel_dumper.h"
+#include "cocl/ir-to-opencl.h"
 
 #include "cocl/type_dumper.h"
 #include "cocl/GlobalNames.h"
@@ -468,6 +469,92 @@ v1:;
     EXPECT_FALSE(cl.find(" = returnsVoid") != string::npos);
 }
 
+TEST(test_kernel_dumper, test_dynamicshared) {
+    GlobalWrapper G("test_dynamicshared");
+    KernelDumper *kernelDumper = G.kernelDumper.get();
+
+    string cl = runKernelDumper(kernelDumper, 1);
+    cout << "kernel cl: [" << cl << "]" << endl;
+    EXPECT_TRUE(kernelDumper->usesDynamicShared);
+    EXPECT_TRUE(cl.find("    local char *dynamicShared;\n};") != string::npos);
+    EXPECT_TRUE(cl.find("uint data_offset, local int *scratch, local char *dynamicShared) {") != string::npos);
+    EXPECT_TRUE(cl.find("const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0, dynamicShared };") != string::npos);
+    // once in the kernel, and once in the function it calls
+    string sharedDefinition = "    local float* dynshared = (local float*)pGlobalVars->dynamicShared;\n";
+    size_t pos = cl.find(sharedDefinition);
+    EXPECT_TRUE(pos != string::npos);
+    EXPECT_TRUE(cl.find(sharedDefinition, pos + 1) != string::npos);
+    EXPECT_FALSE(cl.find("dynshared[0]") != string::npos);
+}
+
+TEST(test_kernel_dumper, test_nodynamicshared) {
+    GlobalWrapper G("test_randomintarray");
+    KernelDumper *kernelDumper = G.kernelDumper.get();
+
+    string cl = runKernelDumper(kernelDumper, 1);
+    EXPECT_FALSE(kernelDumper->usesDynamicShared);
+    EXPECT_FALSE(cl.find("dynamicShared") != string::npos);
+}
+
+TEST(test_kernel_dumper, test_drop_unused_scratch) {
+    GlobalWrapper G("test_randomintarray");
+    KernelDumper *kernelDumper = G.kernelDumper.get();
+    kernelDumper->dropUnusedScratch();
+
+    string cl = runKernelDumper(kernelDumper, 1);
+    cout << "kernel cl: [" << cl << "]" << endl;
+    EXPECT_FALSE(kernelDumper->usesScratch);
+    EXPECT_TRUE(cl.find("kernel void test_randomintarray(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset) {") != string::npos);
+    EXPECT_TRUE(cl.find("const struct GlobalVars globalVars = { 0, clmem0, clmem_vmem_offset0 };") != string::npos);
+}
+
+TEST(test_kernel_dumper, test_keep_used_scratch) {
+    // the __shfl_down call is in a function the kernel calls, not the kernel itself
+    GlobalWrapper G("test_shfl");
+    KernelDumper *kernelDumper = G.kernelDumper.get();
+    kernelDumper->dropUnusedScratch();
+
+    string cl = runKernelDumper(kernelDumper, 1);
+    cout << "kernel cl: [" << cl << "]" << endl;
+    EXPECT_TRUE(kernelDumper->usesScratch);
+    EXPECT_TRUE(cl.find("kernel void test_shfl(global char* clmem0, unsigned long clmem_vmem_offset0, uint data_offset, local int *scratch) {") != string::npos);
+    EXPECT_TRUE(cl.find("const struct GlobalVars globalVars = { scratch, clmem0, clmem_vmem_offset0 };") != string::npos);
+    EXPECT_TRUE(cl.find("__shfl_down_2(pGlobalVars->scratch, ") != string::npos);
+}
+
+TEST(test_kernel_dumper, test_clone_call_graph) {
+    // generating from a copy of just the kernel's call graph should give the same opencl as
+    // generating from the whole module
+    GlobalWrapper G("test_dynamicshared");
+    unique_ptr<Module> clone = cloneFunctionCallGraph(G.getM(), "test_dynamicshared");
+    EXPECT_FALSE(clone->getFunction("test_dynamicshared")->isDeclaration());
+    EXPECT_FALSE(clone->getFunction("readDynShared")->isDeclaration());
+    EXPECT_TRUE(clone->getFunction("someKernel")->isDeclaration());
+    EXPECT_TRUE(clone->getFunction("usesPointerFunction")->isDeclaration());
+    EXPECT_TRUE(clone->getNamedGlobal("dynshared") != 0);
+
+    vector<int> clmemIndexByClmemArgIndex = {0};
+    ModuleClRes cloneRes = convertModuleToCl(1, clmemIndexByClmemArgIndex, clone.get(), "test_dynamicshared", "test_dynamicshared", true);
+    ModuleClRes fullRes = convertModuleToCl(1, clmemIndexByClmemArgIndex, G.getM(), "test_dynamicshared", "test_dynamicshared", true);
+    EXPECT_EQ(fullRes.clSourcecode, cloneRes.clSourcecode);
+    EXPECT_TRUE(cloneRes.usesDynamicShared);
+}
+
+TEST(test_kernel_dumper, test_one_clmem_per_arg) {
+    // with clmem0 left for the first allocation, each pointer arg gets its own clmem, which is
+    // what a launch uses whatever the args alias, unless they're all in one buffer
+    GlobalWrapper G("someKernel");
+    int numClmemArgs = getKernelNumClmemArgs(G.getM(), "someKernel");
+    EXPECT_EQ(2, numClmemArgs);
+    vector<int> clmemIndexByClmemArgIndex = {1, 2};
+    string cl = G.kernelDumper->toCl(numClmemArgs + 1, clmemIndexByClmemArgIndex);
+    EXPECT_EQ(numClmemArgs, G.kernelDumper->numClmemArgs);
+    EXPECT_TRUE(cl.find("kernel void someKernel(global char* clmem0, unsigned long clmem_vmem_offset0, global char* clmem1, unsigned long clmem_vmem_offset1, global char* clmem2, unsigned long clmem_vmem_offset2, uint d1_offset, uint d2_offset, local int *scratch) {") != string::npos);
+    EXPECT_TRUE(cl.find("global float* d1 = (global float*)(clmem1 + d1_offset);") != string::npos);
+    EXPECT_TRUE(cl.find("global float* d2 = (global float*)(clmem2 + d2_offset);") != string::npos);
+    EXPECT_TRUE(cl.find("restrict") == string::npos);
+}
+
 // TEST(test_kernel_dumper, test_long_conflicting_names) {
 //     GlobalWrapper G("mysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamemysuperlongfunctionnamec");
 //     KernelDumper *kernelDumper = G.kernelDumper.get();
@@ -82,3 +82,33 @@ define void @test_randomintarray(i32 *%data) {
   store i32 %8, i32* %data
   ret void
 }
+
+@dynshared = external addrspace(3) global [0 x float]
+
+define float @readDynShared(i32 %i) {
+  %1 = getelementptr inbounds [0 x float], [0 x float] addrspace(3)* @dynshared, i32 0, i32 %i
+  %2 = load float, float addrspace(3)* %1
+  ret float %2
+}
+
+define void @test_dynamicshared(float *%data) {
+  %1 = getelementptr inbounds [0 x float], [0 x float] addrspace(3)* @dynshared, i32 0, i32 3
+  store float 2.0, float addrspace(3)* %1
+  %2 = call float @readDynShared(i32 3)
+  store float %2, float *%data
+  ret void
+}
+
+declare float @_Z11__shfl_downIfET_S0_i(float, i32)
+
+define float @shflHelper(float %v) {
+  %1 = call float @_Z11__shfl_downIfET_S0_i(float %v, i32 1)
+  ret float %1
+}
+
+define void @test_shfl(float *%data) {
+  %1 = load float, float *%data
+  %2 = call float @shflHelper(float %1)
+  store float %2, float *%data
+  ret void
+}
@@ -0,0 +1,144 @@
+// Copyright Hugh Perkins 2017
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_memcpy_batch.h"
+
+#include "cocl/cocl.h"
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+namespace {
+
+ResolvedCopy makeCopy(cl_mem src, cl_mem dst, size_t srcOffset, size_t dstOffset, size_t bytes) {
+    ResolvedCopy copy;
+    copy.srcClmem = src;
+    copy.dstClmem = dst;
+    copy.srcOffset = srcOffset;
+    copy.dstOffset = dstOffset;
+    copy.bytes = bytes;
+    return copy;
+}
+
+TEST(test_memcpy_batch, test_coalesce) {
+    cl_mem a = (cl_mem)0x100;
+    cl_mem b = (cl_mem)0x200;
+    vector<ResolvedCopy> copies;
+    copies.push_back(makeCopy(a, b, 100, 1100, 50));
+    copies.push_back(makeCopy(a, b, 0, 1000, 100)); // followed by the first one, in both src and dst
+    copies.push_back(makeCopy(a, b, 150, 2000, 10)); // src carries on, but dst doesnt
+    copies.push_back(makeCopy(b, a, 0, 0, 10)); // different pair
+    copies.push_back(makeCopy(a, b, 500, 500, 0)); // empty, dropped
+    MemcpyBatchEngine::coalesce(copies);
+    ASSERT_EQ(3u, copies.size());
+    EXPECT_EQ(0u, copies[0].srcOffset);
+    EXPECT_EQ(1000u, copies[0].dstOffset);
+    EXPECT_EQ(150u, copies[0].bytes);
+    EXPECT_EQ(150u, copies[1].srcOffset);
+    EXPECT_EQ(2000u, copies[1].dstOffset);
+    EXPECT_EQ(b, copies[2].srcClmem);
+}
+
+TEST(test_memcpy_batch, test_copies) {
+    // mix of aligned, unaligned, adjacent and big copies, between two allocations
+    const size_t N = 256 * 1024;
+    vector<unsigned char> hostSrc(N);
+    vector<unsigned char> hostDst(N, 0);
+    for(size_t i = 0; i < N; i++) {
+        hostSrc[i] = (unsigned char)(i % 251);
+    }
+    unsigned char *src;
+    unsigned char *dst;
+    cudaMalloc((void **)&src, N);
+    cudaMalloc((void **)&dst, N);
+    cudaMemcpy(src, &hostSrc[0], N, cudaMemcpyHostToDevice);
+    cudaMemcpy(dst, &hostDst[0], N, cudaMemcpyHostToDevice);
+
+    vector<CoclMemcpyBatchEntry> entries;
+    size_t pos = 0;
+    for(int i = 0; i < 500; i++) {
+        size_t bytes = (i % 3 == 0) ? 16 : (i % 7) + 1;
+        CoclMemcpyBatchEntry entry = {dst + pos + 3, src + pos, bytes};
+        entries.push_back(entry);
+        pos += bytes + (i % 5 == 0 ? 13 : 0);
+    }
+    CoclMemcpyBatchEntry big = {dst + 128 * 1024, src + 64 * 1024, 100 * 1024};
+    entries.push_back(big);
+    coclMemcpyBatchAsync(&entries[0], entries.size());
+    cudaMemcpy(&hostDst[0], dst, N, cudaMemcpyDeviceToHost);
+
+    vector<unsigned char> expected(N, 0);
+    for(auto it=entries.begin(); it != entries.end(); it++) {
+        size_t dstOffset = (unsigned char *)it->dst - dst;
+        size_t srcOffset = (const unsigned char *)it->src - src;
+        for(size_t i = 0; i < it->bytes; i++) {
+            expected[dstOffset + i] = hostSrc[srcOffset + i];
+        }
+    }
+    for(size_t i = 0; i < N; i++) {
+        if(expected[i] != hostDst[i]) {
+            cout << "i=" << i << endl;
+            ASSERT_EQ((int)expected[i], (int)hostDst[i]);
+        }
+    }
+    cudaFree(src);
+    cudaFree(dst);
+}
+
+TEST(test_memcpy_batch, DISABLED_benchmark_batch) {
+    // not run by default, since it takes a while. run with --gtest_also_run_disabled_tests
+    // many small copies between neighbouring ranges, as one batch vs one cudaMemcpyAsync each
+    const int numCopies = 4000;
+    const size_t copyBytes = 64;
+    const size_t N = numCopies * copyBytes * 2;
+    char *src;
+    char *dst;
+    cudaMalloc((void **)&src, N);
+    cudaMalloc((void **)&dst, N);
+    vector<CoclMemcpyBatchEntry> entries;
+    for(int i = 0; i < numCopies; i++) {
+        // every other slot, so they cant all merge into one
+        CoclMemcpyBatchEntry entry = {dst + i * copyBytes * 2, src + i * copyBytes * 2, copyBytes};
+        entries.push_back(entry);
+    }
+    ThreadVars *v = getThreadVars();
+    cl_command_queue queue = v->getContext()->default_stream.get()->clqueue->queue;
+    double times[2];
+    for(int method = 0; method < 2; method++) {
+        auto start = chrono::steady_clock::now();
+        if(method == 0) {
+            coclMemcpyBatchAsync(&entries[0], entries.size());
+        } else {
+            for(auto it=entries.begin(); it != entries.end(); it++) {
+                cudaMemcpyAsync(it->dst, it->src, it->bytes, cudaMemcpyDeviceToDevice);
+            }
+        }
+        clFinish(queue);
+        auto end = chrono::steady_clock::now();
+        times[method] = chrono::duration<double, milli>(end - start).count();
+    }
+    cout << "copies=" << numCopies << " batch=" << times[0] << "ms individual=" << times[1] << "ms" << endl;
+    cudaFree(src);
+    cudaFree(dst);
+}
+
+} // namespace